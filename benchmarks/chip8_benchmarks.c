@@ -0,0 +1,552 @@
+/*
+ *  chip8-benchmarks: repeatable micro and macro benchmarks for the core.
+ *
+ *  micro: chip8_cycle per opcode family, DXYN by height and wrap position,
+ *         CLS, Fx55/Fx65 with x = F, the upscaler at 1280x640 for every SIMD
+ *         level, and render() into an offscreen renderer when SDL2 is
+ *         available (CHIP8_BENCH_RENDER)
+ *  macro: the bundled ROMs run headless for a fixed number of frames, and
+ *         Pong with run-ahead (a state copy plus the speculative frames),
+ *         and Pong again with an execution trace recording every instruction,
+ *         and a batch of 4096 compact Pong instances stepped one frame at a
+ *         time, which swaps every instance in and out each frame
+ *
+ *  Every benchmark runs several times and keeps the fastest, which is the
+ *  most stable number on a busy machine. --json writes the results for
+ *  comparison between versions.
+ *
+ *  Usage: chip8-benchmarks [--json FILE] [--filter TEXT] [--repeat N] [--frames N] [--roms DIR]
+ */
+
+#include "chip8.h"
+#include "chip8_batch.h"
+#include "chip8_state.h"
+#include "chip8_trace.h"
+#include "chip8_video.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#if CHIP8_BENCH_RENDER
+#include "sdl_frontend.h"
+#include <SDL2/SDL.h>
+#endif
+
+#define DEFAULT_REPEAT 5
+#define DEFAULT_FRAMES 20000
+#define MICRO_OPS 2000000      // instructions per micro benchmark run
+#define RENDER_CALLS 2000
+#define VIDEO_CALLS 500
+#define VIDEO_SCALE 20         // 1280x640
+#define MAX_RESULTS 128
+#define PROGRAM_START INTERPRETER_RESERVED_MEMORY
+#define SCRATCH_ADDRESS 0x100  // Fx33/Fx55 target, below the program so it is never re-decoded as code
+
+typedef struct
+{
+    char name[48];
+    const char* unit;
+    double value;          // best of the runs
+    uint64_t iterations;   // per run
+    const char* error;     // set when the benchmark could not run
+} Result;
+
+static Result results[MAX_RESULTS];
+static int result_count;
+static const char* filter;
+static int repeat = DEFAULT_REPEAT;
+
+static uint64_t now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * 1000000000ull + (uint64_t) ts.tv_nsec;
+}
+
+static bool selected(const char* name)
+{
+    return filter == NULL || strstr(name, filter) != NULL;
+}
+
+static void add_result(const char* name, const char* unit, double value, uint64_t iterations, const char* error)
+{
+    if (result_count == MAX_RESULTS) { return; }
+    Result* result = &results[result_count++];
+    snprintf(result->name, sizeof(result->name), "%s", name);
+    result->unit = unit;
+    result->value = value;
+    result->iterations = iterations;
+    result->error = error;
+
+    if (error != NULL) { printf("%-28s skipped: %s\n", name, error); }
+    else { printf("%-28s %10.3f %s\n", name, value, unit); }
+}
+
+/*
+ *  Micro benchmarks
+ */
+
+// machine with fixed registers, memory from PROGRAM_START filled with one repeated opcode
+static void setup_repeated(CHIP8* cpu, uint16_t opcode)
+{
+    chip8_init(cpu);
+    chip8_seed(cpu, 1);
+    for (int address = PROGRAM_START; address + 1 < SIZE_4KB; address += 2)
+    {
+        cpu->memory[address] = (uint8_t) (opcode >> 8);
+        cpu->memory[address + 1] = (uint8_t) opcode;
+    }
+    chip8_decode_memory(cpu);
+    for (int reg = 0; reg < REGISTER_COUNT; ++reg) { cpu->v[reg] = (uint8_t) (reg * 17); }
+    cpu->i = SCRATCH_ADDRESS;
+}
+
+// small hand-written program at PROGRAM_START
+static void setup_program(CHIP8* cpu, const uint16_t* opcodes, int count)
+{
+    setup_repeated(cpu, 0x0000);
+    for (int k = 0; k < count; ++k)
+    {
+        cpu->memory[PROGRAM_START + k * 2] = (uint8_t) (opcodes[k] >> 8);
+        cpu->memory[PROGRAM_START + k * 2 + 1] = (uint8_t) opcodes[k];
+    }
+    chip8_decode_memory(cpu);
+}
+
+// ns per chip8_cycle, pc goes back to the start whenever it leaves the program area
+static void measure_cycles(const char* name, CHIP8* setup)
+{
+    if (!selected(name)) { return; }
+
+    static CHIP8 cpu;
+    double best = 0;
+    for (int run = 0; run < repeat; ++run)
+    {
+        cpu = *setup;
+        uint64_t start = now_ns();
+        for (uint32_t done = 0; done < MICRO_OPS; )
+        {
+            // at most 4 bytes per instruction, so a pass never runs past the end of memory
+            uint32_t pass = 256;
+            for (uint32_t k = 0; k < pass; ++k) { chip8_cycle(&cpu); }
+            done += pass;
+            if (cpu.pc < PROGRAM_START || cpu.pc >= SIZE_4KB - pass * 4)
+            {
+                cpu.pc = PROGRAM_START;
+                cpu.i = setup->i;
+            }
+        }
+        double ns = (double) (now_ns() - start) / MICRO_OPS;
+        if (run == 0 || ns < best) { best = ns; }
+    }
+    add_result(name, "ns/op", best, MICRO_OPS, NULL);
+}
+
+static void bench_opcode(const char* name, uint16_t opcode)
+{
+    static CHIP8 cpu;
+    setup_repeated(&cpu, opcode);
+    measure_cycles(name, &cpu);
+}
+
+static void bench_opcodes(void)
+{
+    static CHIP8 cpu;
+
+    bench_opcode("cycle/00E0_cls", 0x00E0);
+
+    // 1nnn and Bnnn jump to themselves, 2nnn/00EE as CALL, RET, JP
+    uint16_t jump_self[] = { 0x1200 };
+    setup_program(&cpu, jump_self, 1);
+    measure_cycles("cycle/1nnn_jump", &cpu);
+
+    uint16_t call_return[] = { 0x2204, 0x1200, 0x00EE };
+    setup_program(&cpu, call_return, 3);
+    measure_cycles("cycle/2nnn_00EE_call_ret_jump", &cpu);
+
+    bench_opcode("cycle/3xkk_skip_eq_byte", 0x3100);
+    bench_opcode("cycle/4xkk_skip_ne_byte", 0x4111);
+    bench_opcode("cycle/5xy0_skip_eq_y", 0x5120);
+    bench_opcode("cycle/6xkk_load_byte", 0x6142);
+    bench_opcode("cycle/7xkk_add_byte", 0x7101);
+    bench_opcode("cycle/8xy0_load_y", 0x8120);
+    bench_opcode("cycle/8xy1_or", 0x8121);
+    bench_opcode("cycle/8xy2_and", 0x8122);
+    bench_opcode("cycle/8xy3_xor", 0x8123);
+    bench_opcode("cycle/8xy4_add", 0x8124);
+    bench_opcode("cycle/8xy5_sub", 0x8125);
+    bench_opcode("cycle/8xy6_shr", 0x8126);
+    bench_opcode("cycle/8xy7_subn", 0x8127);
+    bench_opcode("cycle/8xyE_shl", 0x812E);
+    bench_opcode("cycle/9xy0_skip_ne_y", 0x9120);
+    bench_opcode("cycle/Annn_load_i", 0xA300);
+
+    uint16_t jump_v0[] = { 0xB200 };
+    setup_program(&cpu, jump_v0, 1);
+    cpu.v[0] = 0;
+    measure_cycles("cycle/Bnnn_jump_v0", &cpu);
+
+    bench_opcode("cycle/Cxkk_random", 0xC1FF);
+    bench_opcode("cycle/Ex9E_skip_key", 0xE19E);
+    bench_opcode("cycle/ExA1_skip_no_key", 0xE1A1);
+    bench_opcode("cycle/Fx07_load_dt", 0xF107);
+
+    // Fx0A with a key down, so it moves on instead of waiting
+    setup_repeated(&cpu, 0xF10A);
+    cpu.keypad[5] = 1;
+    measure_cycles("cycle/Fx0A_wait_key_pressed", &cpu);
+
+    bench_opcode("cycle/Fx15_set_dt", 0xF115);
+    bench_opcode("cycle/Fx18_set_st", 0xF118);
+    bench_opcode("cycle/Fx1E_add_i", 0xF11E);
+    bench_opcode("cycle/Fx29_load_font", 0xF129);
+    bench_opcode("cycle/Fx33_store_bcd", 0xF133);
+    bench_opcode("cycle/FF55_store_regs", 0xFF55);
+    bench_opcode("cycle/FF65_load_regs", 0xFF65);
+}
+
+static void bench_sprites(void)
+{
+    static const struct { const char* name; uint8_t height; uint8_t x; uint8_t y; } cases[] =
+    {
+        { "dxyn/h1_aligned",    1,  0,  0 },
+        { "dxyn/h5_aligned",    5,  8,  8 },
+        { "dxyn/h5_unaligned",  5,  3,  9 },
+        { "dxyn/h15_unaligned", 15, 21, 4 },
+        { "dxyn/h5_wrap_x",     5,  60, 10 },
+        { "dxyn/h15_wrap_xy",   15, 60, 28 },
+    };
+
+    static CHIP8 cpu;
+    for (size_t k = 0; k < sizeof(cases) / sizeof(cases[0]); ++k)
+    {
+        // D01n draws at (V0, V1), I points at the font so every row has pixels
+        setup_repeated(&cpu, (uint16_t) (0xD010 | cases[k].height));
+        cpu.v[0] = cases[k].x;
+        cpu.v[1] = cases[k].y;
+        cpu.i = FONTSET_STARTPOINT;
+        measure_cycles(cases[k].name, &cpu);
+    }
+}
+
+// phosphor update plus expansion of a half lit frame, one result per SIMD level the host has
+static void bench_video(void)
+{
+    static const char* const levels[] = { "scalar", "sse2", "avx2" };
+    static Chip8Video video;
+    static uint64_t display[DISPLAY_HEIGHT];
+    for (int y = 0; y < DISPLAY_HEIGHT; ++y) { display[y] = (y & 1) ? 0xF0F0F0F0F0F0F0F0ull : 0x0F0F0F0F0F0F0F0Full; }
+
+    size_t pitch = (size_t) DISPLAY_WIDTH * VIDEO_SCALE * sizeof(uint32_t);
+    uint32_t* pixels = malloc(pitch * DISPLAY_HEIGHT * VIDEO_SCALE);
+    uint32_t off;
+    uint32_t on;
+    chip8_parse_palette("amber", &off, &on);
+    chip8_video_init(&video, VIDEO_SCALE, off, on, 192);
+    uint8_t best_level = video.simd;
+
+    for (uint8_t level = CHIP8_VIDEO_SCALAR; level <= CHIP8_VIDEO_AVX2; ++level)
+    {
+        char name[48];
+        snprintf(name, sizeof(name), "video/%s x%d", levels[level], VIDEO_SCALE);
+        if (!selected(name)) { continue; }
+        if (pixels == NULL || level > best_level)
+        {
+            add_result(name, "ns/frame", 0, 0, (pixels == NULL) ? "out of memory" : "not supported by this host");
+            continue;
+        }
+
+        video.simd = level;
+        double best = 0;
+        for (int run = 0; run < repeat; ++run)
+        {
+            uint64_t start = now_ns();
+            for (int call = 0; call < VIDEO_CALLS; ++call)
+            {
+                // alternating frames keep the phosphor busy
+                display[call & (DISPLAY_HEIGHT - 1)] ^= ~0ull;
+                chip8_video_update(&video, display);
+                chip8_video_expand(&video, pixels, pitch);
+            }
+            double ns = (double) (now_ns() - start) / VIDEO_CALLS;
+            if (run == 0 || ns < best) { best = ns; }
+        }
+        add_result(name, "ns/frame", best, VIDEO_CALLS, NULL);
+    }
+    free(pixels);
+}
+
+#if CHIP8_BENCH_RENDER
+static void bench_render_case(const char* name, SDL_Renderer* renderer, SDL_Texture* texture, uint64_t row)
+{
+    if (!selected(name)) { return; }
+
+    static CHIP8 cpu;
+    static Chip8Video video;
+    chip8_init(&cpu);
+    for (int y = 0; y < DISPLAY_HEIGHT; ++y) { cpu.display[y] = row; }
+    chip8_video_init(&video, SCALE, PIXEL_OFF, PIXEL_ON, 0);
+
+    double best = 0;
+    for (int run = 0; run < repeat; ++run)
+    {
+        uint64_t start = now_ns();
+        for (int call = 0; call < RENDER_CALLS; ++call)
+        {
+            chip8_video_update(&video, cpu.display);
+            render(&video, renderer, texture);
+        }
+        double ns = (double) (now_ns() - start) / RENDER_CALLS;
+        if (run == 0 || ns < best) { best = ns; }
+    }
+    add_result(name, "ns/frame", best, RENDER_CALLS, NULL);
+}
+
+static void bench_render(void)
+{
+    if (!selected("render/")) { return; }
+
+    // software renderer on a window-sized surface, no display or GPU needed
+    SDL_Surface* surface = SDL_CreateRGBSurfaceWithFormat(0, WINDOW_WIDTH, WINDOW_HEIGHT, 32, SDL_PIXELFORMAT_ARGB8888);
+    SDL_Renderer* renderer = (surface != NULL) ? SDL_CreateSoftwareRenderer(surface) : NULL;
+    SDL_Texture* texture = (renderer != NULL) ? create_display_texture(renderer, SCALE) : NULL;
+    if (texture == NULL)
+    {
+        add_result("render/empty", "ns/frame", 0, 0, SDL_GetError());
+        add_result("render/full", "ns/frame", 0, 0, SDL_GetError());
+    }
+    else
+    {
+        bench_render_case("render/empty", renderer, texture, 0);
+        bench_render_case("render/full", renderer, texture, ~0ull);
+    }
+
+    if (texture != NULL) { SDL_DestroyTexture(texture); }
+    if (renderer != NULL) { SDL_DestroyRenderer(renderer); }
+    if (surface != NULL) { SDL_FreeSurface(surface); }
+}
+#endif
+
+/*
+ *  Macro benchmarks
+ */
+
+// traced: every instruction also goes into a chip8_trace ring, compare with rom/ for the overhead
+static void bench_rom(const char* roms_dir, const char* file, uint32_t frames, bool traced)
+{
+    char name[48];
+    snprintf(name, sizeof(name), "%s/%s", traced ? "trace" : "rom", file);
+    if (!selected(name)) { return; }
+
+    char path[1024];
+    snprintf(path, sizeof(path), "%s/%s", roms_dir, file);
+
+    static CHIP8 loaded;
+    static CHIP8 cpu;
+    chip8_init(&loaded);
+    chip8_seed(&loaded, 1);
+    if (!load_rom(&loaded, path))
+    {
+        add_result(name, "ns/frame", 0, 0, "ROM could not be loaded");
+        return;
+    }
+    Chip8Trace* trace = traced ? chip8_trace_create(CHIP8_TRACE_DEFAULT_ENTRIES) : NULL;
+    if (traced && (trace == NULL || !chip8_trace_attach(&loaded, trace)))
+    {
+        add_result(name, "ns/frame", 0, 0, "built without CHIP8_TRACE");
+        chip8_trace_destroy(trace);
+        return;
+    }
+
+    double best = 0;
+    for (int run = 0; run < repeat; ++run)
+    {
+        cpu = loaded;
+        uint64_t start = now_ns();
+        for (uint32_t frame = 0; frame < frames; ++frame)
+        {
+            chip8_run_cycles(&cpu, chip8_cycles_to_tick(&cpu));
+        }
+        double ns = (double) (now_ns() - start) / frames;
+        if (run == 0 || ns < best) { best = ns; }
+    }
+    add_result(name, "ns/frame", best, frames, NULL);
+    chip8_trace_destroy(trace);
+}
+
+// what one displayed frame costs with --run-ahead: the real frame, a copy of the machine, then `ahead` frames on the copy
+static void bench_run_ahead(const char* roms_dir, const char* file, uint32_t frames, uint32_t ahead)
+{
+    char name[48];
+    snprintf(name, sizeof(name), "ahead/%s x%u", file, ahead);
+    if (!selected(name)) { return; }
+
+    char path[1024];
+    snprintf(path, sizeof(path), "%s/%s", roms_dir, file);
+
+    static CHIP8 loaded;
+    static CHIP8 cpu;
+    static CHIP8 copy;
+    chip8_init(&loaded);
+    chip8_seed(&loaded, 1);
+    if (!load_rom(&loaded, path))
+    {
+        add_result(name, "ns/frame", 0, 0, "ROM could not be loaded");
+        return;
+    }
+
+    double best = 0;
+    for (int run = 0; run < repeat; ++run)
+    {
+        cpu = loaded;
+        copy = loaded;
+        uint64_t start = now_ns();
+        for (uint32_t frame = 0; frame < frames; ++frame)
+        {
+            chip8_run_cycles(&cpu, chip8_cycles_to_tick(&cpu));
+            chip8_copy_state(&copy, &cpu);
+            for (uint32_t extra = 0; extra < ahead; ++extra)
+            {
+                chip8_run_cycles(&copy, chip8_cycles_to_tick(&copy));
+            }
+        }
+        double ns = (double) (now_ns() - start) / frames;
+        if (run == 0 || ns < best) { best = ns; }
+    }
+    add_result(name, "ns/frame", best, frames, NULL);
+}
+
+// one worker, so the number is the per-instance cost of a frame including the swap
+static void bench_pool(const char* roms_dir, const char* file, uint32_t frames, uint32_t instances)
+{
+    char name[48];
+    snprintf(name, sizeof(name), "pool/%s x%u", file, instances);
+    if (!selected(name)) { return; }
+
+    char path[1024];
+    snprintf(path, sizeof(path), "%s/%s", roms_dir, file);
+    Chip8Batch* batch = chip8_batch_create(path, instances, 1);
+    if (batch == NULL)
+    {
+        add_result(name, "ns/frame", 0, 0, "ROM could not be loaded");
+        return;
+    }
+
+    // instance frames per run comparable to the ROM benchmarks
+    uint32_t steps = (frames + instances - 1) / instances * 16;
+    double best = 0;
+    bool ok = true;
+    for (int run = 0; run < repeat && ok; ++run)
+    {
+        uint64_t start = now_ns();
+        for (uint32_t step = 0; step < steps && ok; ++step) { ok = chip8_batch_run_frames(batch, 1); }
+        double ns = (double) (now_ns() - start) / ((double) steps * instances);
+        if (run == 0 || ns < best) { best = ns; }
+    }
+    if (ok) { add_result(name, "ns/frame", best, (uint64_t) steps * instances, NULL); }
+    else { add_result(name, "ns/frame", 0, 0, "out of memory"); }
+    chip8_batch_destroy(batch);
+}
+
+static void write_json(FILE* out)
+{
+    fprintf(out, "{\n  \"engine\": \"%s\",\n", (CHIP8_DEFAULT_ENGINE == CHIP8_ENGINE_THREADED) ? "threaded" : "switch");
+#ifdef __VERSION__
+    fprintf(out, "  \"compiler\": \"%s\",\n", __VERSION__);
+#endif
+    fprintf(out, "  \"repeat\": %d,\n  \"results\": [", repeat);
+    for (int k = 0; k < result_count; ++k)
+    {
+        const Result* result = &results[k];
+        fprintf(out, "%s\n    { \"name\": \"%s\", \"unit\": \"%s\", ", (k > 0) ? "," : "", result->name, result->unit);
+        if (result->error != NULL) { fprintf(out, "\"skipped\": \"%s\" }", result->error); }
+        else { fprintf(out, "\"value\": %.3f, \"iterations\": %llu }", result->value, (unsigned long long) result->iterations); }
+    }
+    fprintf(out, "\n  ]\n}\n");
+}
+
+static void usage(const char* program)
+{
+    printf("Usage: %s [--json FILE] [--filter TEXT] [--repeat N] [--frames N] [--roms DIR]\n", program);
+    printf("  --json FILE    also write the results as JSON (- for stdout)\n");
+    printf("  --filter TEXT  only run benchmarks whose name contains TEXT (cycle/, dxyn/, video/, render/, rom/, ahead/, trace/, pool/)\n");
+    printf("  --repeat N     runs per benchmark, the fastest is reported (default %d)\n", DEFAULT_REPEAT);
+    printf("  --frames N     frames per ROM benchmark (default %d)\n", DEFAULT_FRAMES);
+    printf("  --roms DIR     where Pong.ch8, ibmlogo.ch8 and superneatboy.ch8 are (default roms)\n");
+}
+
+int main(int argc, const char* argv[])
+{
+    const char* json_path = NULL;
+    const char* roms_dir = "roms";
+    uint32_t frames = DEFAULT_FRAMES;
+
+    for (int arg = 1; arg < argc; ++arg)
+    {
+        if (strcmp(argv[arg], "--json") == 0 && arg + 1 < argc)
+        {
+            json_path = argv[++arg];
+        }
+        else if (strcmp(argv[arg], "--filter") == 0 && arg + 1 < argc)
+        {
+            filter = argv[++arg];
+        }
+        else if (strcmp(argv[arg], "--repeat") == 0 && arg + 1 < argc)
+        {
+            repeat = atoi(argv[++arg]);
+        }
+        else if (strcmp(argv[arg], "--frames") == 0 && arg + 1 < argc)
+        {
+            frames = (uint32_t) strtoul(argv[++arg], NULL, 10);
+        }
+        else if (strcmp(argv[arg], "--roms") == 0 && arg + 1 < argc)
+        {
+            roms_dir = argv[++arg];
+        }
+        else
+        {
+            usage(argv[0]);
+            return 1;
+        }
+    }
+    if (repeat < 1 || frames == 0)
+    {
+        usage(argv[0]);
+        return 1;
+    }
+
+    bench_opcodes();
+    bench_sprites();
+    bench_video();
+#if CHIP8_BENCH_RENDER
+    bench_render();
+#endif
+    bench_rom(roms_dir, "Pong.ch8", frames, false);
+    bench_rom(roms_dir, "ibmlogo.ch8", frames, false);
+    bench_rom(roms_dir, "superneatboy.ch8", frames, false);
+    bench_run_ahead(roms_dir, "Pong.ch8", frames, 2);
+    bench_rom(roms_dir, "Pong.ch8", frames, true);
+    bench_pool(roms_dir, "Pong.ch8", frames, 4096);
+
+    if (json_path != NULL)
+    {
+        if (strcmp(json_path, "-") == 0)
+        {
+            write_json(stdout);
+            return 0;
+        }
+        FILE* file_pointer = fopen(json_path, "w");
+        if (file_pointer == NULL)
+        {
+            perror("CHIP8: Error while writing the results: ");
+            return 1;
+        }
+        write_json(file_pointer);
+        fclose(file_pointer);
+    }
+    return 0;
+}
@@ -1,12 +1,7 @@
 #include "chip8.h"
+#include "chip8_profile.h"
+#include "chip8_trace.h"
 
-#include <SDL2/SDL_error.h>
-#include <SDL2/SDL_events.h>
-#include <SDL2/SDL_log.h>
-#include <SDL2/SDL_render.h>
-#include <SDL2/SDL_timer.h>
-#include <SDL2/SDL_video.h>
-#include <SDL2/SDL_mixer.h>
 #include <errno.h>
 #include <stdint.h>
 #include <string.h>
@@ -16,7 +11,121 @@
 #include <sys/types.h>
 #include <time.h> 
 
-#include <SDL2/SDL.h>
+// CHIP8 addresses are 12 bits, anything above wraps around the 4KB memory
+#define ADDRESS_MASK (SIZE_4KB - 1)
+
+#if CHIP8_PROFILE
+#define PROFILE_INSTRUCTION(cpu, instruction) \
+    do { if ((cpu)->profile != NULL) { chip8_profile_instruction((cpu)->profile, (cpu)->pc, (instruction)); } } while (0)
+#else
+#define PROFILE_INSTRUCTION(cpu, instruction) do { } while (0)
+#endif
+
+// flattens the nested type/sub-type dispatch into a single handler index
+static uint8_t resolve_handler(const Instruction* instruction)
+{
+    switch (instruction->type)
+    {
+        case OP_SYSTEM:
+            if (instruction->nn == SUB_OP_CLS) { return EXEC_CLS; }
+            if (instruction->nn == SUB_OP_RET) { return EXEC_RET; }
+            return EXEC_NOP;
+        case OP_JUMP:           return EXEC_JUMP;
+        case OP_CALL:           return EXEC_CALL;
+        case OP_SKIP_X_EQ_BYTE: return EXEC_SKIP_X_EQ_BYTE;
+        case OP_SKIP_X_NE_BYTE: return EXEC_SKIP_X_NE_BYTE;
+        case OP_SKIP_X_EQ_Y:    return EXEC_SKIP_X_EQ_Y;
+        case OP_LOAD_X_BYTE:    return EXEC_LOAD_X_BYTE;
+        case OP_ADD_X_BYTE:     return EXEC_ADD_X_BYTE;
+        case OP_ARITHMETIC:
+            switch (instruction->n)
+            {
+                case SUB_OP_LOAD_X_Y: return EXEC_LOAD_X_Y;
+                case SUB_OP_OR_X_Y:   return EXEC_OR_X_Y;
+                case SUB_OP_AND_X_Y:  return EXEC_AND_X_Y;
+                case SUB_OP_XOR_X_Y:  return EXEC_XOR_X_Y;
+                case SUB_OP_ADD_X_Y:  return EXEC_ADD_X_Y;
+                case SUB_OP_SUB_X_Y:  return EXEC_SUB_X_Y;
+                case SUB_OP_SHR_X:    return EXEC_SHR_X;
+                case SUB_OP_SUBN_X_Y: return EXEC_SUBN_X_Y;
+                case SUB_OP_SHL_X:    return EXEC_SHL_X;
+            }
+            return EXEC_NOP;
+        case OP_SKIP_X_NE_Y:    return EXEC_SKIP_X_NE_Y;
+        case OP_LOAD_I_ADDR:    return EXEC_LOAD_I_ADDR;
+        case OP_JUMP_V0_ADDR:   return EXEC_JUMP_V0_ADDR;
+        case OP_RANDOM_X_BYTE:  return EXEC_RANDOM_X_BYTE;
+        case OP_DRAW_SPRITE:    return EXEC_DRAW_SPRITE;
+        case OP_KEY_INPUT:
+            switch (instruction->nn)
+            {
+                case SUB_OP_SKIP_IF_KEY:    return EXEC_SKIP_IF_KEY;
+                case SUB_OP_SKIP_IF_NO_KEY: return EXEC_SKIP_IF_NO_KEY;
+            }
+            return EXEC_NOP;
+        case OP_MISCELLANEOUS:
+            switch (instruction->nn)
+            {
+                case SUB_OP_LOAD_X_DT:    return EXEC_LOAD_X_DT;
+                case SUB_OP_WAIT_FOR_KEY: return EXEC_WAIT_FOR_KEY;
+                case SUB_OP_SET_DT_X:     return EXEC_SET_DT_X;
+                case SUB_OP_SET_ST_X:     return EXEC_SET_ST_X;
+                case SUB_OP_ADD_I_X:      return EXEC_ADD_I_X;
+                case SUB_OP_LOAD_F_X:     return EXEC_LOAD_F_X;
+                case SUB_OP_STORE_BCD_X:  return EXEC_STORE_BCD_X;
+                case SUB_OP_STORE_REGS_I: return EXEC_STORE_REGS_I;
+                case SUB_OP_LOAD_REGS_I:  return EXEC_LOAD_REGS_I;
+            }
+            return EXEC_NOP;
+    }
+    return EXEC_NOP;
+}
+
+static inline Instruction decode(uint16_t opcode)
+{
+    Instruction instruction;
+    instruction.type = (opcode & 0XF000) >> 12; 
+    instruction.x = (opcode & 0X0F00) >> 8;
+    instruction.y = (opcode & 0X00F0) >> 4; 
+    instruction.n = (opcode & 0X000F);
+    instruction.nn = (opcode & 0X00FF);
+    instruction.nnn = (opcode & 0x0FFF);
+    instruction.op = resolve_handler(&instruction);
+    return instruction;
+}
+
+static inline void decode_at(CHIP8* cpu, uint16_t address)
+{
+    address &= ADDRESS_MASK;
+    // big endian 
+    uint16_t opcode = ((cpu->memory[address] << 8) | cpu->memory[(address + 1) & ADDRESS_MASK]);
+    cpu->decoded[address] = decode(opcode);
+}
+
+// every write to memory goes through here so self-modifying ROMs keep a valid cache
+static inline void write_memory(CHIP8* cpu, uint16_t address, uint8_t value)
+{
+    address &= ADDRESS_MASK;
+    cpu->memory[address] = value;
+    cpu->written_pages |= 1ull << (address >> PAGE_SHIFT);
+    // the opcode starting one byte earlier also covers this address
+    decode_at(cpu, address - 1);
+    decode_at(cpu, address);
+}
+
+Instruction chip8_decode(uint16_t opcode)
+{
+    return decode(opcode);
+}
+
+void chip8_decode_memory(CHIP8* cpu)
+{
+    for (int address = 0; address < SIZE_4KB; ++address)
+    {
+        decode_at(cpu, address);
+    }
+    cpu->written_pages = ~0ull;
+}
 
 void chip8_init(CHIP8* cpu)
 {
@@ -42,26 +151,45 @@ void chip8_init(CHIP8* cpu)
     memset(cpu, 0, sizeof(CHIP8));
     //  memset(cpu->memory,0, SIZE_4KB);
     //  memset(cpu->v, 0, REGISTER_COUNT);
-    // random from current time
-    srand(time(NULL));
-    
-    Mix_OpenAudio(44100, MIX_DEFAULT_FORMAT, 2, 2048);
+    // random from current time, per instance so no libc rand() state is shared
+    chip8_seed(cpu, (uint32_t) time(NULL));
 
     for (int i = 0; i < 80; ++i)
     {
         cpu->memory[FONTSET_STARTPOINT + i] = fontset[i];
     }
     cpu->pc = INTERPRETER_RESERVED_MEMORY; // sets program counter to 512byte since 0 and 511 are reserved
-    
+    cpu->engine = CHIP8_DEFAULT_ENGINE;
+    cpu->timing = CHIP8_TIMING_CYCLES;
+    cpu->hertz = CPU_HERTZ;
+    cpu->display_dirty = 1; // the first frame always draws
+    chip8_decode_memory(cpu);
 }
 
-void load_rom(CHIP8* cpu, const char *path)
+uint32_t chip8_seed_state(uint32_t seed)
+{
+    // murmur3 finalizer, a bijection, so nearby seeds give unrelated streams
+    seed ^= seed >> 16;
+    seed *= 0x85EBCA6Bu;
+    seed ^= seed >> 13;
+    seed *= 0xC2B2AE35u;
+    seed ^= seed >> 16;
+    // xorshift never leaves zero, the one seed that maps there gets another state
+    return (seed != 0) ? seed : 0x9E3779B9u;
+}
+
+void chip8_seed(CHIP8* cpu, uint32_t seed)
+{
+    cpu->rng_state = chip8_seed_state(seed);
+}
+
+bool load_rom(CHIP8* cpu, const char *path)
 {
     FILE* file_pointer = fopen(path, (const char*) "rb");
     if (file_pointer == NULL)
     {
         perror("CHIP8: Error while opening file: ");
-        return;  
+        return false;  
     }
     fseek(file_pointer, 0, SEEK_END);
     // since .ch8 stores raw bytes data, we can check the size of the file using ftell
@@ -69,453 +197,408 @@ void load_rom(CHIP8* cpu, const char *path)
     if (size >= SIZE_4KB - INTERPRETER_RESERVED_MEMORY)
     {
         printf("CHIP8: Your file is too big for a chip 8 engine! terminating.\n");
-        return; 
+        fclose(file_pointer);
+        return false; 
     }
     // move filepointer back to the begining 
     rewind(file_pointer);
 
     fread(cpu->memory + cpu->pc, sizeof(uint8_t), size, file_pointer);
+    fclose(file_pointer);
+    // known games get the profile they were written for, anything else keeps the current one
+    chip8_lookup_quirks(cpu->memory + cpu->pc, (size_t) size, &cpu->quirks);
+    chip8_decode_memory(cpu);
+    return true;
 }
 
-void chip8_cycle(CHIP8* cpu)
+/*
+ *  Quirk profiles
+ */
+
+static const char* const quirks_names[CHIP8_QUIRKS_COUNT] = { "legacy", "vip", "chip48", "schip" };
+
+typedef struct
 {
-    Instruction instruction; 
+    uint32_t hash;   // FNV-1a of the whole ROM
+    uint16_t size;
+    uint8_t quirks;
+} KnownRom;
 
-    // big endian 
-    uint16_t opcode = ((cpu->memory[cpu->pc] << 8) | cpu->memory[cpu->pc + 1]);
-    
-    bool shouldjump = true; 
-    
-    // populating instruction struct 
-    instruction.type = (opcode & 0XF000) >> 12; 
-    instruction.x = (opcode & 0X0F00) >> 8;
-    instruction.y = (opcode & 0X00F0) >> 4; 
-    instruction.n = (opcode & 0X000F);
-    instruction.nn = (opcode & 0X00FF);
-    instruction.nnn = (opcode & 0x0FFF);
-    
-    // buffer for drawing sprite 
-    uint8_t sprite_byte;
-    
-    switch (instruction.type)
-    {  
+// add a ROM with its FNV-1a hash and size, a match needs both
+static const KnownRom known_roms[] =
+{
+    { 0x30E334A2u, 246, CHIP8_QUIRKS_VIP }, // roms/Pong.ch8
+    { 0x9E083BA1u, 132, CHIP8_QUIRKS_VIP }, // roms/ibmlogo.ch8
+    { 0x504436C3u, 260, CHIP8_QUIRKS_VIP }, // roms/debug.ch8
+};
 
-        case OP_SYSTEM:
-            if (instruction.nn == SUB_OP_CLS)
-            {
-                memset(cpu->display, 0, sizeof(cpu->display));
-                break;
-            }
-            else if(instruction.nn == SUB_OP_RET)
-            {
-                cpu->stack_pointer--; 
-                cpu->pc = cpu->stack[cpu->stack_pointer];
-                shouldjump = false;
-                break;
-            }
-            break;
-        case OP_JUMP:
-            // printf("SALTO DETECTADO: Indo para 0x%03X\n", instruction.nnn);
-            cpu->pc = instruction.nnn;
-            shouldjump = false;
-            break;
+bool chip8_parse_quirks(const char* name, uint8_t* quirks)
+{
+    for (uint8_t profile = 0; profile < CHIP8_QUIRKS_COUNT; ++profile)
+    {
+        if (strcmp(name, quirks_names[profile]) == 0)
+        {
+            *quirks = profile;
+            return true;
+        }
+    }
+    return false;
+}
 
-        case OP_CALL:
-            if (cpu->stack_pointer > 15) { return; }
-            cpu->stack[cpu->stack_pointer] = cpu->pc + 2; // + 2 because its next instruction
-            cpu->stack_pointer++;
-            cpu->pc = instruction.nnn;
-            shouldjump = false;
-            break;
+const char* chip8_quirks_name(uint8_t quirks)
+{
+    return (quirks < CHIP8_QUIRKS_COUNT) ? quirks_names[quirks] : "unknown";
+}
 
-        case OP_SKIP_X_EQ_BYTE:
-            if (cpu->v[instruction.x] == instruction.nn)
-            {
-                cpu->pc += 2; 
-            }
-            break;
-        
-        case OP_SKIP_X_NE_BYTE:
-            if (cpu->v[instruction.x] != instruction.nn)
-            {
-                cpu->pc += 2;
-            }
-            break;
+bool chip8_lookup_quirks(const uint8_t* rom, size_t size, uint8_t* quirks)
+{
+    uint32_t hash = 0x811C9DC5u;
+    for (size_t k = 0; k < size; ++k)
+    {
+        hash = (hash ^ rom[k]) * 0x01000193u;
+    }
+    for (size_t k = 0; k < sizeof(known_roms) / sizeof(known_roms[0]); ++k)
+    {
+        if (known_roms[k].hash == hash && known_roms[k].size == size)
+        {
+            *quirks = known_roms[k].quirks;
+            return true;
+        }
+    }
+    return false;
+}
 
-        case OP_SKIP_X_EQ_Y:
-            if (cpu->v[instruction.x] == cpu->v[instruction.y])
-            {
-                cpu->pc += 2;
-            }
-            break;
+// xorshift32 on the instance's own state, the top byte is the best mixed
+static inline uint8_t next_random_byte(CHIP8* cpu)
+{
+    uint32_t state = cpu->rng_state;
+    state ^= state << 13;
+    state ^= state >> 17;
+    state ^= state << 5;
+    cpu->rng_state = state;
+    return (uint8_t) (state >> 24);
+}
 
-        case OP_LOAD_X_BYTE:
-            cpu->v[instruction.x] = (uint8_t) instruction.nn; 
-            break;
+/*
+ *  Execution
+ *
+ *  chip8_core.inc is compiled once per quirk profile, chip8_cycle and
+ *  chip8_run_cycles pick the copy once per call, never per instruction.
+ */
 
-        case OP_ADD_X_BYTE:
-            cpu->v[instruction.x] += (uint8_t) instruction.nn;
-            break;
+#define CORE_NAME(name, suffix) name##_##suffix
+#define CORE_EXPAND(name, suffix) CORE_NAME(name, suffix)
+#define CORE(name) CORE_EXPAND(name, CHIP8_CORE_SUFFIX)
 
-        case OP_ARITHMETIC:
-            switch (instruction.n)
-            {
-                case SUB_OP_LOAD_X_Y:
-                    cpu->v[instruction.x] = cpu->v[instruction.y];
-                    break;
-                case SUB_OP_OR_X_Y:
-                    cpu->v[instruction.x] = cpu->v[instruction.x] | cpu->v[instruction.y];
-                    cpu->v[REGISTER_VF] = 0;
-                    break;
-                case SUB_OP_AND_X_Y:
-                    cpu->v[instruction.x] = cpu->v[instruction.x] & cpu->v[instruction.y];
-                    cpu->v[REGISTER_VF] = 0; 
-                    break;
-                case SUB_OP_XOR_X_Y:
-                    cpu->v[instruction.x] = cpu->v[instruction.x] ^ cpu->v[instruction.y];
-                    cpu->v[REGISTER_VF] = 0;
-                    break;
-
-                case SUB_OP_ADD_X_Y:
-                    {   
-                        uint8_t val_x = cpu->v[instruction.x];
-                        uint8_t val_y = cpu->v[instruction.y];
-                        uint16_t addition = (uint16_t) val_x + (uint16_t) val_y;
-                        cpu->v[instruction.x] = (uint8_t) (addition & 0xFF); // truncate for 8 bit
-                        if (addition > 255)
-                        {
-                            // v[15]
-                            cpu->v[REGISTER_VF] = 1;
-                        }
-                        else 
-                        {
-                            cpu->v[REGISTER_VF] = 0;
-                        }
-                        break;
-                    }
-
-                case SUB_OP_SUB_X_Y:
-                    {
-                        uint8_t val_x = cpu->v[instruction.x];
-                        uint8_t val_y = cpu->v[instruction.y];
-                        uint8_t not_borrow = (val_x >= val_y) ? 1 : 0;
-                    
-                        cpu->v[instruction.x] = val_x - val_y;
-                        cpu->v[REGISTER_VF] = not_borrow;
-                        break;
-                    }
-
-                case SUB_OP_SHR_X:
-                    // least_significant = cpu->v[instruction.x] & 1;
-                    if ((cpu->v[instruction.x] & 1) == 1)
-                    {
-                        cpu->v[REGISTER_VF] = 1;
-                    }
-                    else 
-                    {
-                        cpu->v[REGISTER_VF] = 0;
-                    }
-                    cpu->v[instruction.x] = cpu->v[instruction.x] >> 1;
-                    break;
-
-                case SUB_OP_SUBN_X_Y:
-                    if (cpu->v[instruction.y] >= cpu->v[instruction.x])
-                    {
-                        cpu->v[REGISTER_VF] = 1;
-                    }
-                    else 
-                    {
-                        cpu->v[REGISTER_VF] = 0;
-                    }
-                    cpu->v[instruction.x] = cpu->v[instruction.y] - cpu->v[instruction.x];
-                    break;
-
-                case SUB_OP_SHL_X:
-                    // most_significant = cpu->v[instruction.x] >> 7; 
-                    if ((cpu->v[instruction.x] >> 7) & 0x1)
-                    {
-                        cpu->v[REGISTER_VF] = 1;
-                    }
-                    else
-                    {
-                        cpu->v[REGISTER_VF] = 0;
-                    }
-                        cpu->v[instruction.x] = cpu->v[instruction.x] << 1;
-                    break;
-            } 
-            break;
+#define CHIP8_CORE_SUFFIX legacy
+#define CHIP8_CORE_QUIRKS CHIP8_QUIRK_FLAGS_LEGACY
+#include "chip8_core.inc"
 
-        case OP_SKIP_X_NE_Y:
-            if (cpu->v[instruction.x] != cpu->v[instruction.y])
-            {
-                cpu->pc += 2;
-            }
-            break;
-        case OP_LOAD_I_ADDR:
-            cpu->i = instruction.nnn; 
-            break;
-        case OP_JUMP_V0_ADDR:
-            cpu->pc = instruction.nnn + cpu->v[0];
-            shouldjump = false;
-            break;
-        case OP_RANDOM_X_BYTE:
-            // random number between 0 and 255 
-            // just simplified the formula: rand() % (max - min + 1) + min 
-            // since min is zero
-            cpu->v[instruction.x] = (rand() % 256) & instruction.nn;
-            break; 
-        case OP_DRAW_SPRITE:
-        {
-            // loop through bites and check each bit 
-            cpu->v[REGISTER_VF] = 0;
-            for (int i = 0; i < instruction.n; ++i)
-            {
-                sprite_byte = cpu->memory[cpu->i + i];
-                for (int col = 0; col < 8; col++)
-                {
-                    if ((sprite_byte & (0x80 >> col)) != 0)
-                    {
-                        uint8_t x = (cpu->v[instruction.x] + col) % 64; // % 64
-                        uint8_t y = (cpu->v[instruction.y] + i) % 32; // % 32
-                        
-                        uint16_t index = (y * 64) + x;
-                        if (index < 2048)
-                        {
-                                if (cpu->display[index] == 1)
-                                {
-                                    cpu->v[REGISTER_VF] = 1;
-                                }
-                                cpu->display[index] ^= 1;
-                        }
-                        else { printf("calcualtion error in index! \n"); }
-                    }
-                }
-            }
-            break;
-        }    
-        case OP_KEY_INPUT:
-            switch(instruction.nn)
-            {
-                case SUB_OP_SKIP_IF_KEY:
-                    if (cpu->keypad[cpu->v[instruction.x]] != 0)
-                    {
-                        cpu->pc += 2;
-                    }
-                    break;
-                case SUB_OP_SKIP_IF_NO_KEY:
-                    if (cpu->keypad[cpu->v[instruction.x]] == 0)
-                    {
-                        cpu->pc += 2;
-                    }
-            }
-            break;
+#define CHIP8_CORE_SUFFIX vip
+#define CHIP8_CORE_QUIRKS CHIP8_QUIRK_FLAGS_VIP
+#include "chip8_core.inc"
 
-        case OP_MISCELLANEOUS:
-            switch(instruction.nn)
-            {
-                case SUB_OP_LOAD_X_DT:
-                {
-                    cpu->v[instruction.x] = cpu->delay;
-                    break;
-                }
-                case SUB_OP_WAIT_FOR_KEY:
-                {   
-                    bool key_pressed = false;
-                    for (int i = 0; i < 16; ++i)
-                    {
-                        // if pressed
-                        if (cpu->keypad[i] != 0)
-                        {
-                            cpu->v[instruction.x] = i;
-                            key_pressed = true;
-                            break;
-                        }
-                    }
-                    // if not pressed, retracts pc so he will check this instruction again
-                    if (!key_pressed)
-                    {
-                        cpu->pc -= 2;    
-                    }
-                    break; 
-                }
-                case SUB_OP_SET_DT_X:
-                {
-                    cpu->delay = cpu->v[instruction.x];
-                    break;
-                }
-                case SUB_OP_SET_ST_X:
-                {
-                    cpu->sound_timer = cpu->v[instruction.x];
-                    break;
-                }
-                case SUB_OP_ADD_I_X:
-                {
-                    cpu->i += cpu->v[instruction.x];
-                    break;
-                }
-                case SUB_OP_LOAD_F_X:
-                {
-                    //  our write in the fontset costs 5 bytes
-                    cpu->i = FONTSET_STARTPOINT + (cpu->v[instruction.x] * 5); 
-                    break;
-                }
-                case SUB_OP_STORE_BCD_X:
-                {
-                    uint8_t value = cpu->v[instruction.x];
-                    
-                    // get hundreds
-                    cpu->memory[cpu->i] = value / 100;
-                    // get tens
-                    cpu->memory[cpu->i + 1] = (value / 10) % 10;
-                    // get unity
-                    cpu->memory[cpu->i + 2] = value % 10;
-                    break;
-                }
-                case SUB_OP_STORE_REGS_I:
-                {
-                        // reg stands for register 
-                    for (int reg = 0; reg <= instruction.x; ++reg)
-                    {
-                        cpu->memory[cpu->i + reg] = cpu->v[reg];
-                    }
-                    break;  
-                }
-                case SUB_OP_LOAD_REGS_I:
-                {
-                    for (int reg = 0; reg <= instruction.x; ++reg)
-                    {
-                        cpu->v[reg] = cpu->memory[cpu->i + reg]; 
-                    }
-                    break;
-                }
-            }
-            break;
+#define CHIP8_CORE_SUFFIX chip48
+#define CHIP8_CORE_QUIRKS CHIP8_QUIRK_FLAGS_CHIP48
+#include "chip8_core.inc"
+
+#define CHIP8_CORE_SUFFIX schip
+#define CHIP8_CORE_QUIRKS CHIP8_QUIRK_FLAGS_SCHIP
+#include "chip8_core.inc"
+
+void chip8_cycle(CHIP8* cpu)
+{
+    switch (cpu->quirks)
+    {
+        case CHIP8_QUIRKS_VIP:    run_switch_vip(cpu, 1); return;
+        case CHIP8_QUIRKS_CHIP48: run_switch_chip48(cpu, 1); return;
+        case CHIP8_QUIRKS_SCHIP:  run_switch_schip(cpu, 1); return;
     }
-    // jumps to the next instruction
-    if (shouldjump) { cpu->pc += 2; }
+    run_switch_legacy(cpu, 1);
 }
 
-void update_timers(CHIP8* cpu)
+// the selected engine and profile for a batch that does not reach a timer tick
+static void run_engine(CHIP8* cpu, uint32_t cycles)
 {
-    if (cpu->delay > 0)
+#if CHIP8_HAS_COMPUTED_GOTO
+    if (cpu->engine == CHIP8_ENGINE_THREADED)
     {
-        cpu->delay--;
+        switch (cpu->quirks)
+        {
+            case CHIP8_QUIRKS_VIP:    run_threaded_vip(cpu, cycles); return;
+            case CHIP8_QUIRKS_CHIP48: run_threaded_chip48(cpu, cycles); return;
+            case CHIP8_QUIRKS_SCHIP:  run_threaded_schip(cpu, cycles); return;
+        }
+        run_threaded_legacy(cpu, cycles);
+        return;
     }
-    if (cpu->sound_timer > 0)
+#endif
+    switch (cpu->quirks)
     {
-        cpu->sound_timer--;
+        case CHIP8_QUIRKS_VIP:    run_switch_vip(cpu, cycles); return;
+        case CHIP8_QUIRKS_CHIP48: run_switch_chip48(cpu, cycles); return;
+        case CHIP8_QUIRKS_SCHIP:  run_switch_schip(cpu, cycles); return;
     }
+    run_switch_legacy(cpu, cycles);
 }
 
-void render(CHIP8* cpu, SDL_Renderer* renderer)
+/*
+ *  Timing: the clock counts cycles, and the timers tick every time the
+ *  cycles add up to another 1/60 s of the model's hertz. The fraction
+ *  carries over, so 500 Hz ticks after 9, 8, 8, 9, ... cycles. Results only
+ *  depend on the cycles run, never on how a host slices them into calls.
+ */
+
+static const char* const timing_names[] = { "host", "cycles", "vip" };
+
+bool chip8_parse_timing(const char* name, CHIP8* cpu)
 {
-    // black background
-    SDL_SetRenderDrawColor(renderer, 0, 0, 0, 255);
-    SDL_RenderClear(renderer);
-    
-    // draw white pixel
-    SDL_SetRenderDrawColor(renderer, 255, 255, 255, 255);
+    for (uint8_t timing = 0; timing < sizeof(timing_names) / sizeof(timing_names[0]); ++timing)
+    {
+        if (strcmp(name, timing_names[timing]) != 0) { continue; }
+        cpu->timing = timing;
+        cpu->hertz = (timing == CHIP8_TIMING_VIP) ? CHIP8_VIP_HERTZ : CPU_HERTZ;
+        cpu->timer_phase = 0;
+        cpu->busy_cycles = 0;
+        return true;
+    }
+    return false;
+}
 
-    // display array
-    for (int y = 0; y < 32; ++y)
+const char* chip8_timing_name(uint8_t timing)
+{
+    return (timing < sizeof(timing_names) / sizeof(timing_names[0])) ? timing_names[timing] : "unknown";
+}
+
+uint32_t chip8_advance_clock(CHIP8* cpu, uint32_t cycles)
+{
+    cpu->clock += cycles;
+    uint64_t phase = cpu->timer_phase + (uint64_t) cycles * TIMER_HERTZ;
+    // batches end at a tick, so this is nearly always no tick or exactly one, without a division
+    uint32_t ticks = 0;
+    if (phase >= cpu->hertz)
     {
-        for (int x = 0; x < 64; ++x)
+        phase -= cpu->hertz;
+        ticks = 1;
+        if (phase >= cpu->hertz)
         {
-            // if has a value, it means it has a pixel 
-            if (cpu->display[y * 64 + x])
-            {
-                SDL_Rect rect;
-                rect.x = x * SCALE;
-                rect.y = y * SCALE;
-                rect.h = SCALE;
-                rect.w = SCALE;
-                SDL_RenderFillRect(renderer, &rect);
-            }
+            ticks += (uint32_t) (phase / cpu->hertz);
+            phase %= cpu->hertz;
         }
     }
+    cpu->timer_phase = (uint32_t) phase;
+    if (ticks == 0 || cpu->timing == CHIP8_TIMING_HOST) { return ticks; }
 
-    // updates screen 
-    SDL_RenderPresent(renderer);
+    cpu->delay = (cpu->delay > ticks) ? (uint8_t) (cpu->delay - ticks) : 0;
+    cpu->sound_timer = (cpu->sound_timer > ticks) ? (uint8_t) (cpu->sound_timer - ticks) : 0;
+    return ticks;
 }
 
-void chip8_run(CHIP8* cpu)
+/*
+ *  COSMAC VIP timing. Machine cycles (8 clocks of the 1.76 MHz 1802) per
+ *  instruction, approximated from the VIP interpreter: 40 for fetch and
+ *  decode plus the handler. Skips that are taken cost 4 more, DXYN first
+ *  waits for the next 60 Hz interrupt, and every interrupt together with
+ *  its display DMA takes VIP_FRAME_CYCLES from whatever runs at the time.
+ *  Close to the original's pace, not cycle exact.
+ */
+
+#define VIP_FETCH_CYCLES 40
+#define VIP_SKIP_CYCLES 4
+#define VIP_FRAME_CYCLES 1100     // interrupt routine and 128 lines of display DMA
+#define VIP_SPRITE_ROW_CYCLES 46  // shifting and XORing one sprite row into the display
+
+static const uint16_t vip_cycles[EXEC_COUNT] =
+{
+    [EXEC_NOP] = 10,             [EXEC_CLS] = 3078,           [EXEC_RET] = 10,
+    [EXEC_JUMP] = 12,            [EXEC_CALL] = 26,            [EXEC_SKIP_X_EQ_BYTE] = 10,
+    [EXEC_SKIP_X_NE_BYTE] = 10,  [EXEC_SKIP_X_EQ_Y] = 14,     [EXEC_LOAD_X_BYTE] = 6,
+    [EXEC_ADD_X_BYTE] = 10,      [EXEC_LOAD_X_Y] = 12,        [EXEC_OR_X_Y] = 44,
+    [EXEC_AND_X_Y] = 44,         [EXEC_XOR_X_Y] = 44,         [EXEC_ADD_X_Y] = 44,
+    [EXEC_SUB_X_Y] = 44,         [EXEC_SHR_X] = 44,           [EXEC_SUBN_X_Y] = 44,
+    [EXEC_SHL_X] = 44,           [EXEC_SKIP_X_NE_Y] = 14,     [EXEC_LOAD_I_ADDR] = 12,
+    [EXEC_JUMP_V0_ADDR] = 22,    [EXEC_RANDOM_X_BYTE] = 36,   [EXEC_DRAW_SPRITE] = 26,
+    [EXEC_SKIP_IF_KEY] = 14,     [EXEC_SKIP_IF_NO_KEY] = 14,  [EXEC_LOAD_X_DT] = 10,
+    [EXEC_WAIT_FOR_KEY] = 10,    [EXEC_SET_DT_X] = 10,        [EXEC_SET_ST_X] = 10,
+    [EXEC_ADD_I_X] = 16,         [EXEC_LOAD_F_X] = 16,        [EXEC_STORE_BCD_X] = 84,
+    [EXEC_STORE_REGS_I] = 14,    [EXEC_LOAD_REGS_I] = 14,
+};
+
+// what the instruction that just ran from pc_before takes on the VIP
+static uint32_t vip_instruction_cycles(const CHIP8* cpu, const Instruction* instruction, uint16_t pc_before)
 {
-    bool game_running = true;
+    uint32_t cycles = VIP_FETCH_CYCLES + vip_cycles[instruction->op];
+    switch (instruction->op)
+    {
+        case EXEC_SKIP_X_EQ_BYTE:
+        case EXEC_SKIP_X_NE_BYTE:
+        case EXEC_SKIP_X_EQ_Y:
+        case EXEC_SKIP_X_NE_Y:
+        case EXEC_SKIP_IF_KEY:
+        case EXEC_SKIP_IF_NO_KEY:
+            if (cpu->pc == (uint16_t) (pc_before + 4)) { cycles += VIP_SKIP_CYCLES; }
+            break;
+        case EXEC_DRAW_SPRITE:
+            cycles += chip8_cycles_to_tick(cpu) + instruction->n * VIP_SPRITE_ROW_CYCLES;
+            break;
+        case EXEC_STORE_REGS_I:
+        case EXEC_LOAD_REGS_I:
+            cycles += (instruction->x + 1u) * 14;
+            break;
+    }
+    return cycles;
+}
 
-    SDL_Window* pwindow = SDL_CreateWindow("CHIP8", SDL_WINDOWPOS_CENTERED, SDL_WINDOWPOS_CENTERED, WINDOW_WIDTH, WINDOW_HEIGHT, 0);
-    if (!pwindow) { printf("Error while creating SDL window\n%s", SDL_GetError()); return; }
-    
-    SDL_Renderer* prenderer = SDL_CreateRenderer(pwindow, -1, 0);
-    if (!prenderer) { printf("Error while generating renderer\n%s", SDL_GetError()); return; }
+uint32_t chip8_step(CHIP8* cpu, uint32_t cycles)
+{
+    if (cycles == 0) { return 0; }
+    if (cpu->timing != CHIP8_TIMING_VIP)
+    {
+        chip8_cycle(cpu);
+        chip8_advance_clock(cpu, 1);
+        return 1;
+    }
 
-    uint32_t last_tick = SDL_GetTicks();
-    
-    Mix_Chunk* coin_sound = Mix_LoadWAV("assets/coin.wav");
-    
-    while (game_running)
+    if (cpu->busy_cycles == 0)
+    {
+        uint16_t pc = cpu->pc;
+        Instruction instruction = cpu->decoded[pc & ADDRESS_MASK];
+        chip8_cycle(cpu);
+        cpu->busy_cycles = vip_instruction_cycles(cpu, &instruction, pc);
+    }
+    uint32_t passed = (cpu->busy_cycles < cycles) ? cpu->busy_cycles : cycles;
+    cpu->busy_cycles -= passed;
+    // the interrupt and the display DMA land in the middle of whatever is running
+    cpu->busy_cycles += chip8_advance_clock(cpu, passed) * VIP_FRAME_CYCLES;
+    return passed;
+}
+
+void chip8_run_cycles(CHIP8* cpu, uint32_t cycles)
+{
+    if (cpu->timing == CHIP8_TIMING_VIP)
     {
-        SDL_Event event;
-        while (SDL_PollEvent(&event))
+        while (cycles > 0) { cycles -= chip8_step(cpu, cycles); }
+        return;
+    }
+    // the engines run straight up to each tick, and the timers tick in between
+    while (cycles > 0)
+    {
+        uint32_t batch = chip8_cycles_to_tick(cpu);
+        if (batch > cycles) { batch = cycles; }
+        run_engine(cpu, batch);
+        chip8_advance_clock(cpu, batch);
+        cycles -= batch;
+    }
+}
+
+uint32_t chip8_run_frame(CHIP8* cpu)
+{
+    uint32_t cycles = chip8_cycles_to_tick(cpu);
+    uint32_t skipped = chip8_skip_idle(cpu, cycles);
+    chip8_run_cycles(cpu, cycles - skipped);
+    if (cpu->timing == CHIP8_TIMING_HOST) { update_timers(cpu); }
+    return cycles;
+}
+
+/*
+ *  Idle detection: the patterns below only loop until a key goes down or a
+ *  timer ticks. Keys change between chip8_run_cycles calls and a skip stops
+ *  at the next tick, so the skipped cycles change nothing but pc and Vx.
+ */
+
+// Fx07, 3xkk, 1nnn back to the Fx07: spins while DT != kk
+static bool is_delay_loop(const CHIP8* cpu, int start)
+{
+    if (start < 0 || start + 4 >= SIZE_4KB) { return false; }
+    const Instruction* load = &cpu->decoded[start];
+    const Instruction* skip = &cpu->decoded[start + 2];
+    const Instruction* jump = &cpu->decoded[start + 4];
+    return load->op == EXEC_LOAD_X_DT && skip->op == EXEC_SKIP_X_EQ_BYTE && skip->x == load->x
+        && jump->op == EXEC_JUMP && jump->nnn == start;
+}
+
+// start of the delay loop pc is spinning in, -1 if there is none
+static int find_delay_loop(const CHIP8* cpu)
+{
+    for (int position = 0; position < 3; ++position)
+    {
+        int start = (int) cpu->pc - position * 2;
+        if (!is_delay_loop(cpu, start)) { continue; }
+
+        uint8_t target = cpu->decoded[start + 2].nn;
+        if (cpu->delay == target) { return -1; }
+        // entering at the skip, the Vx it tests is from an older Fx07
+        if (position == 1 && cpu->v[cpu->decoded[start].x] == target) { return -1; }
+        return start;
+    }
+    return -1;
+}
+
+uint8_t chip8_idle_state(const CHIP8* cpu)
+{
+    if (cpu->pc >= SIZE_4KB) { return CHIP8_IDLE_NONE; }
+
+    const Instruction* instruction = &cpu->decoded[cpu->pc];
+    if (instruction->op == EXEC_WAIT_FOR_KEY)
+    {
+        for (int key = 0; key < 16; ++key)
         {
-            if (event.type == SDL_QUIT)
-            {
-                printf("exiting chip8!\n");
-                game_running = false;
-            }
-            if (event.type == SDL_KEYDOWN || event.type == SDL_KEYUP) 
-            {
-                uint8_t state = (event.type == SDL_KEYDOWN) ? 1 : 0;
-                
-                switch (event.key.keysym.sym) 
-                {
-                    case SDLK_x: cpu->keypad[0] = state; break;
-                    case SDLK_1: cpu->keypad[1] = state; break;
-                    case SDLK_2: cpu->keypad[2] = state; break;
-                    case SDLK_3: cpu->keypad[3] = state; break;
-                    case SDLK_q: cpu->keypad[4] = state; break;
-                    case SDLK_w: cpu->keypad[5] = state; break;
-                    case SDLK_e: cpu->keypad[6] = state; break;
-                    case SDLK_a: cpu->keypad[7] = state; break;
-                    case SDLK_s: cpu->keypad[8] = state; break;
-                    case SDLK_d: cpu->keypad[9] = state; break;
-                    case SDLK_z: cpu->keypad[10] = state; break;
-                    case SDLK_c: cpu->keypad[11] = state; break;
-                    case SDLK_4: cpu->keypad[12] = state; break;
-                    case SDLK_r: cpu->keypad[13] = state; break;
-                    case SDLK_f: cpu->keypad[14] = state; break;
-                    case SDLK_v: cpu->keypad[15] = state; break;
-                }
-            } 
+            if (cpu->keypad[key] != 0) { return CHIP8_IDLE_NONE; }
         }
-        
-        uint32_t current_time = SDL_GetTicks();
+        return CHIP8_IDLE_KEY;
+    }
+    if (instruction->op == EXEC_JUMP && instruction->nnn == cpu->pc) { return CHIP8_IDLE_HALT; }
+    if (find_delay_loop(cpu) >= 0) { return CHIP8_IDLE_DELAY; }
+    return CHIP8_IDLE_NONE;
+}
 
-        if (current_time - last_tick >= 16) // 
-        {
-            for (int i = 0; i < CYCLES_PER_FRAME; i++)
-            {
-                chip8_cycle(cpu);
-            }
+uint32_t chip8_skip_idle(CHIP8* cpu, uint32_t cycles)
+{
+    uint8_t idle = chip8_idle_state(cpu);
+    if (idle == CHIP8_IDLE_NONE || cycles == 0) { return 0; }
+    // VIP cycles are not instructions, only loops where nothing moves can be skipped
+    if (cpu->timing == CHIP8_TIMING_VIP && (idle == CHIP8_IDLE_DELAY || cpu->busy_cycles != 0)) { return 0; }
+    // the tick ends the idle loop, or at least might
+    if (cpu->timing != CHIP8_TIMING_HOST && cycles > chip8_cycles_to_tick(cpu)) { cycles = chip8_cycles_to_tick(cpu); }
+#if CHIP8_PROFILE
+    if (cpu->profile != NULL) { cpu->profile->idle_skipped += cycles; }
+#endif
+    if (idle != CHIP8_IDLE_DELAY)
+    {
+        uint32_t ticks = chip8_advance_clock(cpu, cycles);
+        if (cpu->timing == CHIP8_TIMING_VIP) { cpu->busy_cycles = ticks * VIP_FRAME_CYCLES; }
+        return cycles;
+    }
 
-            update_timers(cpu);
-            if (cpu->sound_timer > 0)
-            {
-                if (!Mix_Playing(0))
-                {
-                    Mix_PlayChannel(0, coin_sound, -1); // -1 for loop
-                }
-                else
-                {
-                    Mix_HaltChannel(0); // stops when timer is over
-                }
-            }
-            render(cpu, prenderer);
-            last_tick = current_time;
+    // the loop is three instructions long, only pc and Vx move
+    int start = find_delay_loop(cpu);
+    uint32_t position = (uint32_t) (cpu->pc - start) / 2;
+    bool loads_delay = (position == 0) || (position == 1 && cycles >= 3) || (position == 2 && cycles >= 2);
+    if (loads_delay) { cpu->v[cpu->decoded[start].x] = cpu->delay; }
+    cpu->pc = (uint16_t) (start + ((position + cycles) % 3) * 2);
+    chip8_advance_clock(cpu, cycles);
+    return cycles;
+}
+
+void chip8_unpack_display(const CHIP8* cpu, uint8_t pixels[DISPLAY_SIZE])
+{
+    for (int y = 0; y < DISPLAY_HEIGHT; ++y)
+    {
+        for (int x = 0; x < DISPLAY_WIDTH; ++x)
+        {
+            pixels[y * DISPLAY_WIDTH + x] = chip8_get_pixel(cpu, x, y);
         }
-        SDL_Delay(1);
     }
-    SDL_DestroyRenderer(prenderer);
-    SDL_DestroyWindow(pwindow);
 }
 
-
+void update_timers(CHIP8* cpu)
+{
+    if (cpu->delay > 0)
+    {
+        cpu->delay--;
+    }
+    if (cpu->sound_timer > 0)
+    {
+        cpu->sound_timer--;
+    }
+}
@@ -1,15 +1,20 @@
 #ifndef CHIP8_H
 #define CHIP8_H
 
+#include <stdbool.h>
+#include <stddef.h>
 #include <stdint.h>
 
 #define SIZE_4KB 4096
-#define DISPLAY_SIZE 64 * 32
+#define DISPLAY_WIDTH 64
+#define DISPLAY_HEIGHT 32
+#define DISPLAY_SIZE (DISPLAY_WIDTH * DISPLAY_HEIGHT)
 #define REGISTER_COUNT 16 
 #define REGISTER_VF 0xF
 #define STACK_SIZE 16 
 #define INTERPRETER_RESERVED_MEMORY 0x200
 #define FONTSET_STARTPOINT 0x50
+#define PAGE_SHIFT 6  // 64-byte pages, so the 4KB memory fits in one uint64_t bitmask
 
 #define WINDOW_WIDTH 640
 #define WINDOW_HEIGHT 320
@@ -19,6 +24,63 @@
 #define TIMER_HERTZ 60
 #define CYCLES_PER_FRAME  (CPU_HERTZ / TIMER_HERTZ) 
 
+// execution engines for chip8_run_cycles
+#define CHIP8_ENGINE_SWITCH   0  // portable switch over the pre-decoded handler index
+#define CHIP8_ENGINE_THREADED 1  // computed-goto dispatch, falls back to the switch without GCC/Clang
+
+// idle loops reported by chip8_idle_state, nothing changes until the named event
+#define CHIP8_IDLE_NONE  0  // running
+#define CHIP8_IDLE_KEY   1  // Fx0A with no key down, waits for input
+#define CHIP8_IDLE_DELAY 2  // Fx07 / 3xkk / 1nnn loop polling the delay timer
+#define CHIP8_IDLE_HALT  3  // 1nnn jumping to itself, waits forever
+
+// timing models for CHIP8.timing, how cycles map to the 60 Hz delay and sound timers
+#define CHIP8_TIMING_HOST   0  // the caller ticks the timers with update_timers, the clock only counts
+#define CHIP8_TIMING_CYCLES 1  // one cycle per instruction, the timers tick every hertz / TIMER_HERTZ cycles (default)
+#define CHIP8_TIMING_VIP    2  // COSMAC VIP machine cycles per instruction, DXYN waits for the next tick
+#define CHIP8_VIP_HERTZ 220080 // 1802 machine cycles per second, 1.76064 MHz / 8
+
+// quirk profiles for CHIP8.quirks, each one runs on its own specialized copy of the interpreter
+#define CHIP8_QUIRKS_LEGACY 0  // this interpreter's original behavior, the default
+#define CHIP8_QUIRKS_VIP    1  // COSMAC VIP CHIP-8
+#define CHIP8_QUIRKS_CHIP48 2  // CHIP-48 on the HP-48
+#define CHIP8_QUIRKS_SCHIP  3  // SUPER-CHIP 1.1, low resolution only
+#define CHIP8_QUIRKS_COUNT  4
+
+// the behaviors a profile is made of
+#define CHIP8_QUIRK_VF_RESET   0x01  // 8xy1/8xy2/8xy3 clear VF
+#define CHIP8_QUIRK_SHIFT_VY   0x02  // 8xy6/8xyE shift Vy into Vx, otherwise Vx is shifted in place
+#define CHIP8_QUIRK_MEMORY_X   0x04  // Fx55/Fx65 leave I = I + x
+#define CHIP8_QUIRK_MEMORY_X1  0x08  // Fx55/Fx65 leave I = I + x + 1
+#define CHIP8_QUIRK_JUMP_VX    0x10  // Bxnn jumps to xnn + Vx instead of nnn + V0
+#define CHIP8_QUIRK_CLIP       0x20  // sprites are cut at the screen edges instead of wrapping
+
+#define CHIP8_QUIRK_FLAGS_LEGACY (CHIP8_QUIRK_VF_RESET)
+#define CHIP8_QUIRK_FLAGS_VIP    (CHIP8_QUIRK_VF_RESET | CHIP8_QUIRK_SHIFT_VY | CHIP8_QUIRK_MEMORY_X1 | CHIP8_QUIRK_CLIP)
+#define CHIP8_QUIRK_FLAGS_CHIP48 (CHIP8_QUIRK_MEMORY_X | CHIP8_QUIRK_JUMP_VX | CHIP8_QUIRK_CLIP)
+#define CHIP8_QUIRK_FLAGS_SCHIP  (CHIP8_QUIRK_JUMP_VX | CHIP8_QUIRK_CLIP)
+
+#if defined(__GNUC__) || defined(__clang__)
+#define CHIP8_HAS_COMPUTED_GOTO 1
+#else
+#define CHIP8_HAS_COMPUTED_GOTO 0
+#endif
+
+// profiler hooks in the interpreter, off unless built with -DCHIP8_PROFILE=1 (cmake option CHIP8_PROFILE)
+#ifndef CHIP8_PROFILE
+#define CHIP8_PROFILE 0
+#endif
+
+// execution trace hooks in the interpreter, on unless built with -DCHIP8_TRACE=0 (cmake option CHIP8_TRACE)
+#ifndef CHIP8_TRACE
+#define CHIP8_TRACE 1
+#endif
+
+// build-time default, override with -DCHIP8_DEFAULT_ENGINE=... (cmake option CHIP8_THREADED_DISPATCH)
+#ifndef CHIP8_DEFAULT_ENGINE
+#define CHIP8_DEFAULT_ENGINE CHIP8_ENGINE_THREADED
+#endif
+
 /*
  *  The follow defines was extracted by Cowgod's Chip-8 Thecnical Reference v1.0
  *  http://devernay.free.fr/hacks/chip8/C8TECH10.HTM#0.0
@@ -73,10 +135,70 @@
 #define SUB_OP_LOAD_REGS_I    0x65 // Fx65 - Read V0 through Vx from memory[I]
 
 
+// X-macro of every handler: the EXEC_* index stored in Instruction.op and the function that runs it
+#define CHIP8_HANDLERS(HANDLER)                        \
+    HANDLER(EXEC_NOP,             exec_nop)            \
+    HANDLER(EXEC_CLS,             exec_cls)            \
+    HANDLER(EXEC_RET,             exec_ret)            \
+    HANDLER(EXEC_JUMP,            exec_jump)           \
+    HANDLER(EXEC_CALL,            exec_call)           \
+    HANDLER(EXEC_SKIP_X_EQ_BYTE,  exec_skip_x_eq_byte) \
+    HANDLER(EXEC_SKIP_X_NE_BYTE,  exec_skip_x_ne_byte) \
+    HANDLER(EXEC_SKIP_X_EQ_Y,     exec_skip_x_eq_y)    \
+    HANDLER(EXEC_LOAD_X_BYTE,     exec_load_x_byte)    \
+    HANDLER(EXEC_ADD_X_BYTE,      exec_add_x_byte)     \
+    HANDLER(EXEC_LOAD_X_Y,        exec_load_x_y)       \
+    HANDLER(EXEC_OR_X_Y,          exec_or_x_y)         \
+    HANDLER(EXEC_AND_X_Y,         exec_and_x_y)        \
+    HANDLER(EXEC_XOR_X_Y,         exec_xor_x_y)        \
+    HANDLER(EXEC_ADD_X_Y,         exec_add_x_y)        \
+    HANDLER(EXEC_SUB_X_Y,         exec_sub_x_y)        \
+    HANDLER(EXEC_SHR_X,           exec_shr_x)          \
+    HANDLER(EXEC_SUBN_X_Y,        exec_subn_x_y)       \
+    HANDLER(EXEC_SHL_X,           exec_shl_x)          \
+    HANDLER(EXEC_SKIP_X_NE_Y,     exec_skip_x_ne_y)    \
+    HANDLER(EXEC_LOAD_I_ADDR,     exec_load_i_addr)    \
+    HANDLER(EXEC_JUMP_V0_ADDR,    exec_jump_v0_addr)   \
+    HANDLER(EXEC_RANDOM_X_BYTE,   exec_random_x_byte)  \
+    HANDLER(EXEC_DRAW_SPRITE,     exec_draw_sprite)    \
+    HANDLER(EXEC_SKIP_IF_KEY,     exec_skip_if_key)    \
+    HANDLER(EXEC_SKIP_IF_NO_KEY,  exec_skip_if_no_key) \
+    HANDLER(EXEC_LOAD_X_DT,       exec_load_x_dt)      \
+    HANDLER(EXEC_WAIT_FOR_KEY,    exec_wait_for_key)   \
+    HANDLER(EXEC_SET_DT_X,        exec_set_dt_x)       \
+    HANDLER(EXEC_SET_ST_X,        exec_set_st_x)       \
+    HANDLER(EXEC_ADD_I_X,         exec_add_i_x)        \
+    HANDLER(EXEC_LOAD_F_X,        exec_load_f_x)       \
+    HANDLER(EXEC_STORE_BCD_X,     exec_store_bcd_x)    \
+    HANDLER(EXEC_STORE_REGS_I,    exec_store_regs_i)   \
+    HANDLER(EXEC_LOAD_REGS_I,     exec_load_regs_i)
+
+// handler indices stored in Instruction.op, one per distinct operation (EXEC_NOP covers unknown opcodes)
+#define CHIP8_HANDLER_ENUM(index, function) index,
+enum
+{
+    CHIP8_HANDLERS(CHIP8_HANDLER_ENUM)
+    EXEC_COUNT
+};
+#undef CHIP8_HANDLER_ENUM
+
+typedef struct 
+{
+    uint8_t type;  // nibble 1
+    uint8_t x;     // nibble 2
+    uint8_t y;     // nibble 3 
+    uint8_t n;     // nibble 4 
+    uint8_t nn;    // last 8bits 
+    uint16_t nnn;  // last 16bits 
+    uint8_t op;    // resolved handler index, filled by the decoder
+} Instruction;
+
+
 typedef struct CHIP8 
 {
     uint8_t memory[SIZE_4KB];
-    uint8_t display[DISPLAY_SIZE];
+    uint64_t display[DISPLAY_HEIGHT]; // one row per word, bit 63 is x = 0 (see chip8_get_pixel)
+    uint8_t display_dirty;         // set by DXYN and CLS, cleared by the renderer once drawn
     uint8_t v[REGISTER_COUNT];     // registers 
     uint16_t i;                    // index register  
     uint16_t pc;                   // program counter 
@@ -85,26 +207,91 @@ typedef struct CHIP8
     uint8_t stack_pointer;         // normal stack pointer, points to the top 
     uint8_t delay;                 // delay at 60hz 
     uint8_t sound_timer;            
+    uint8_t engine;                // CHIP8_ENGINE_* used by chip8_run_cycles
+    uint8_t quirks;                // CHIP8_QUIRKS_* profile, set by load_rom for known ROMs
+    uint32_t rng_state;            // xorshift32 state for Cxkk, never zero
+    uint8_t timing;                // CHIP8_TIMING_*, chip8_init picks CHIP8_TIMING_CYCLES
+    uint32_t hertz;                // cycles per second of the timing model, CPU_HERTZ after chip8_init
+    uint32_t timer_phase;          // TIMER_HERTZ per cycle run, the timers tick each time it passes hertz
+    uint32_t busy_cycles;          // CHIP8_TIMING_VIP: what the instruction in progress still takes
+    uint64_t clock;                // cycles run since chip8_init, skipped idle cycles included
+    uint64_t written_pages;        // one bit per 64-byte page written since a translator last cleared it
+#if CHIP8_PROFILE
+    struct Chip8Profile* profile;  // counters while profiling, NULL otherwise (see chip8_profile.h)
+#endif
+#if CHIP8_TRACE
+    struct Chip8Trace* trace;      // ring buffer of the last instructions while tracing, NULL otherwise (see chip8_trace.h)
+#endif
+    Instruction decoded[SIZE_4KB]; // pre-decoded opcode starting at each address, kept in sync with memory
 } CHIP8;
 
 
-typedef struct 
-{
-    uint8_t type;  // nibble 1
-    uint8_t x;     // nibble 2
-    uint8_t y;     // nibble 3 
-    uint8_t n;     // nibble 4 
-    uint8_t nn;    // last 8bits 
-    uint16_t nnn;  // last 16bits 
-} Instruction;
-
-
 // initialize all values and points the stackpointer before the first 512 bits
 void chip8_init(CHIP8* cpu);
-// load game
-void load_rom(CHIP8* cpu, const char* path);
-// fetch-decode-execute
+// makes Cxkk reproducible: same seed and same input give the same run, chip8_init seeds from the clock
+void chip8_seed(CHIP8* cpu, uint32_t seed);
+// the rng_state chip8_seed sets for seed
+uint32_t chip8_seed_state(uint32_t seed);
+// load game, returns false if the file could not be read
+bool load_rom(CHIP8* cpu, const char* path);
+// rebuilds the decoded instruction cache, call it after writing to cpu->memory directly
+void chip8_decode_memory(CHIP8* cpu);
+// the decoded form of one opcode, as chip8_decode_memory stores it
+Instruction chip8_decode(uint16_t opcode);
+// fetch-decode-execute, no time passes (see chip8_step)
 void chip8_cycle(CHIP8* cpu);
-void chip8_run(CHIP8* cpu);
+// executes a batch of cycles with the selected engine, the timers tick where the cycles reach them
+void chip8_run_cycles(CHIP8* cpu, uint32_t cycles);
+// one instruction and its time, at most cycles of it: returns the cycles that passed, an instruction
+// longer than that (CHIP8_TIMING_VIP) is finished by the next calls before another one starts
+uint32_t chip8_step(CHIP8* cpu, uint32_t cycles);
+// one 60 Hz frame, up to and including the next timer tick, idle loops skipped; returns its cycles
+uint32_t chip8_run_frame(CHIP8* cpu);
+// counts cycles that passed on the clock and ticks the timers they reach (not in CHIP8_TIMING_HOST),
+// returns the ticks; engines call it between batches that end at chip8_cycles_to_tick
+uint32_t chip8_advance_clock(CHIP8* cpu, uint32_t cycles);
+// one tick of the delay and sound timers
 void update_timers(CHIP8* cpu);
+// timing model by name ("host", "cycles", "vip"), also sets the matching clock rate; false for anything else
+bool chip8_parse_timing(const char* name, CHIP8* cpu);
+const char* chip8_timing_name(uint8_t timing);
+
+// cycles until the timers tick next, at least 1
+static inline uint32_t chip8_cycles_to_tick(const CHIP8* cpu)
+{
+    // a clock just slowed down below the phase ticks right away
+    if (cpu->timer_phase >= cpu->hertz) { return 1; }
+    return (cpu->hertz - cpu->timer_phase + TIMER_HERTZ - 1) / TIMER_HERTZ;
+}
+
+// CHIP8_QUIRK_* flags of a CHIP8_QUIRKS_* profile
+static inline uint8_t chip8_quirk_flags(uint8_t quirks)
+{
+    switch (quirks)
+    {
+        case CHIP8_QUIRKS_VIP:    return CHIP8_QUIRK_FLAGS_VIP;
+        case CHIP8_QUIRKS_CHIP48: return CHIP8_QUIRK_FLAGS_CHIP48;
+        case CHIP8_QUIRKS_SCHIP:  return CHIP8_QUIRK_FLAGS_SCHIP;
+    }
+    return CHIP8_QUIRK_FLAGS_LEGACY;
+}
+// profile by name ("legacy", "vip", "chip48", "schip"), returns false for anything else
+bool chip8_parse_quirks(const char* name, uint8_t* quirks);
+const char* chip8_quirks_name(uint8_t quirks);
+// looks the ROM up in the table of known games, returns false if it is not there
+bool chip8_lookup_quirks(const uint8_t* rom, size_t size, uint8_t* quirks);
+
+// CHIP8_IDLE_* for the loop at pc, valid until the keypad or the timers change
+uint8_t chip8_idle_state(const CHIP8* cpu);
+// if the machine is idle, lets the cycles up to the next tick (all of them in CHIP8_TIMING_HOST) pass
+// exactly as running them would and returns how many, otherwise returns 0
+uint32_t chip8_skip_idle(CHIP8* cpu, uint32_t cycles);
+
+// 1 if the pixel at (x, y) is lit, coordinates must be inside the 64x32 display
+static inline uint8_t chip8_get_pixel(const CHIP8* cpu, int x, int y)
+{
+    return (uint8_t) ((cpu->display[y] >> (DISPLAY_WIDTH - 1 - x)) & 1);
+}
+// expands the packed display to one byte per pixel, row major (y * 64 + x)
+void chip8_unpack_display(const CHIP8* cpu, uint8_t pixels[DISPLAY_SIZE]);
 #endif 
@@ -0,0 +1,139 @@
+#include "chip8_aot.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+struct Chip8Aot
+{
+    const Chip8AotProgram* program;
+    const CHIP8* cpu;         // machine the flags below describe
+    uint8_t* valid;           // one flag per block
+    uint64_t* block_pages;    // pages holding each block's bytes
+    uint64_t code_pages;      // union of block_pages
+    uint64_t compiled_cycles;
+    uint64_t interpreted_cycles;
+};
+
+static uint64_t range_pages(uint16_t start, uint16_t end)
+{
+    uint64_t pages = 0;
+    for (uint32_t page = start >> PAGE_SHIFT; page <= (uint32_t) ((end - 1) >> PAGE_SHIFT); ++page)
+    {
+        pages |= 1ull << page;
+    }
+    return pages;
+}
+
+// a block stays usable exactly while its bytes match the ROM it was compiled from
+static void revalidate(Chip8Aot* aot, const CHIP8* cpu, uint64_t written_pages)
+{
+    const Chip8AotProgram* program = aot->program;
+    for (uint16_t k = 0; k < program->block_count; ++k)
+    {
+        if ((aot->block_pages[k] & written_pages) == 0) { continue; }
+        const Chip8AotBlock* block = &program->blocks[k];
+        const uint8_t* original = program->rom + (block->start - INTERPRETER_RESERVED_MEMORY);
+        aot->valid[k] = memcmp(cpu->memory + block->start, original, block->end - block->start) == 0;
+    }
+}
+
+Chip8Aot* chip8_aot_create(const Chip8AotProgram* program)
+{
+    Chip8Aot* aot = calloc(1, sizeof(Chip8Aot));
+    if (aot == NULL) { return NULL; }
+    aot->program = program;
+    aot->valid = calloc(program->block_count + 1, sizeof(uint8_t));
+    aot->block_pages = calloc(program->block_count + 1, sizeof(uint64_t));
+    if (aot->valid == NULL || aot->block_pages == NULL)
+    {
+        chip8_aot_destroy(aot);
+        return NULL;
+    }
+    for (uint16_t k = 0; k < program->block_count; ++k)
+    {
+        aot->block_pages[k] = range_pages(program->blocks[k].start, program->blocks[k].end);
+        aot->code_pages |= aot->block_pages[k];
+    }
+    return aot;
+}
+
+void chip8_aot_destroy(Chip8Aot* aot)
+{
+    if (aot == NULL) { return; }
+    free(aot->block_pages);
+    free(aot->valid);
+    free(aot);
+}
+
+void chip8_aot_load(const Chip8AotProgram* program, CHIP8* cpu)
+{
+    memcpy(cpu->memory + INTERPRETER_RESERVED_MEMORY, program->rom, program->rom_size);
+    cpu->quirks = program->quirks;
+    chip8_decode_memory(cpu);
+}
+
+// cycles that end at or before the next timer tick
+static void run_compiled(Chip8Aot* aot, CHIP8* cpu, uint32_t cycles)
+{
+    while (cycles > 0)
+    {
+        // Fx33/Fx55 (or a reload) wrote memory since we last looked
+        if (cpu->written_pages != 0)
+        {
+            if (cpu->written_pages & aot->code_pages) { revalidate(aot, cpu, cpu->written_pages); }
+            cpu->written_pages = 0;
+        }
+
+        uint32_t left = aot->program->run(cpu, cycles, aot->valid);
+        aot->compiled_cycles += cycles - left;
+        if (left == cycles)
+        {
+            // no usable compiled code at pc
+            chip8_cycle(cpu);
+            aot->interpreted_cycles++;
+            left--;
+        }
+        cycles = left;
+    }
+}
+
+void chip8_aot_run_cycles(Chip8Aot* aot, CHIP8* cpu, uint32_t cycles)
+{
+    // the code was generated for one profile, and has no profiler counters or trace hooks or VIP cycle costs
+    bool interpret = (aot == NULL) || cpu->quirks != aot->program->quirks || cpu->timing == CHIP8_TIMING_VIP;
+#if CHIP8_PROFILE
+    interpret = interpret || cpu->profile != NULL;
+#endif
+#if CHIP8_TRACE
+    interpret = interpret || cpu->trace != NULL;
+#endif
+    if (interpret)
+    {
+        if (aot != NULL) { aot->interpreted_cycles += cycles; }
+        chip8_run_cycles(cpu, cycles);
+        return;
+    }
+
+    if (aot->cpu != cpu)
+    {
+        aot->cpu = cpu;
+        revalidate(aot, cpu, ~0ull);
+    }
+    // the timers tick between batches, as in chip8_run_cycles
+    while (cycles > 0)
+    {
+        uint32_t batch = chip8_cycles_to_tick(cpu);
+        if (batch > cycles) { batch = cycles; }
+        run_compiled(aot, cpu, batch);
+        chip8_advance_clock(cpu, batch);
+        cycles -= batch;
+    }
+}
+
+void chip8_aot_stats(const Chip8Aot* aot, uint64_t* compiled, uint64_t* interpreted)
+{
+    *compiled = aot->compiled_cycles;
+    *interpreted = aot->interpreted_cycles;
+}
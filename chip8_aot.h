@@ -0,0 +1,48 @@
+#ifndef CHIP8_AOT_H
+#define CHIP8_AOT_H
+
+#include "chip8.h"
+
+/*
+ *  Ahead-of-time recompiled ROMs. chip8-aot turns a ROM into C with one label
+ *  per basic block (see tools/chip8_aot.c), and the program it emits runs on
+ *  this runtime. Blocks are only entered while memory still holds the bytes
+ *  they were compiled from; self-modified code, jumps to addresses between
+ *  instructions and anything the generator did not find run on the interpreter.
+ */
+
+// bytes [start, end) of memory a block was compiled from
+typedef struct
+{
+    uint16_t start;
+    uint16_t end;
+} Chip8AotBlock;
+
+// runs compiled code from cpu->pc until the cycles run out or it reaches an address it has no
+// code for, returns the cycles left; valid[k] is nonzero while block k may be entered
+typedef uint32_t (*Chip8AotRun)(CHIP8* cpu, uint32_t cycles, const uint8_t* valid);
+
+// what a generated file defines, as chip8_aot_program
+typedef struct
+{
+    const char* name;            // file name of the ROM
+    const uint8_t* rom;
+    uint16_t rom_size;
+    uint8_t quirks;              // CHIP8_QUIRKS_* baked into the code, other profiles interpret
+    const Chip8AotBlock* blocks;
+    uint16_t block_count;
+    Chip8AotRun run;
+} Chip8AotProgram;
+
+typedef struct Chip8Aot Chip8Aot;
+
+// one per CHIP8, NULL if out of memory
+Chip8Aot* chip8_aot_create(const Chip8AotProgram* program);
+void chip8_aot_destroy(Chip8Aot* aot);
+// loads the program's ROM and quirk profile into an initialized machine, like load_rom
+void chip8_aot_load(const Chip8AotProgram* program, CHIP8* cpu);
+// same result as chip8_run_cycles, compiled blocks where possible
+void chip8_aot_run_cycles(Chip8Aot* aot, CHIP8* cpu, uint32_t cycles);
+// cycles run by compiled blocks and by the interpreter since chip8_aot_create
+void chip8_aot_stats(const Chip8Aot* aot, uint64_t* compiled, uint64_t* interpreted);
+#endif
@@ -0,0 +1,416 @@
+#include "chip8_batch.h"
+#include "chip8_rom.h"
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+// instances per task, small enough to balance, large enough to amortize the queue
+#define CHUNK_INSTANCES 4
+
+typedef struct
+{
+    Chip8Compact machine;
+    uint16_t* input;       // one keypad mask per frame, owned by the batch
+    uint32_t input_frames;
+    uint64_t input_start;  // batch frame the sequence starts at
+    bool failed;           // a written page could not be stored, the instance no longer runs
+} BatchInstance;
+
+// a worker's share of chunks, [begin, end) packed in one word so owner and thieves agree with a single CAS
+typedef struct
+{
+    _Alignas(64) _Atomic uint64_t range;
+} WorkQueue;
+
+struct Chip8Batch
+{
+    Chip8Rom* rom;          // read once, its pages are shared by every instance
+    BatchInstance* instances;
+    uint32_t count;
+    uint64_t frame;
+    _Atomic uint32_t failed;  // instances stopped because their pages could not be stored
+
+    Chip8FrameCallback callback;
+    void* user_data;
+
+    // current run, read by the workers once they are woken up
+    uint32_t run_frames;
+    WorkQueue* queues;
+    Chip8Workspace* workspaces;  // one per worker, the instance being run is swapped into it
+    Chip8Workspace* view;        // chip8_batch_instance expands into this one
+
+    uint32_t thread_count;  // including the calling thread, which works as worker 0
+    pthread_t* threads;
+    pthread_mutex_t lock;
+    pthread_cond_t start;
+    pthread_cond_t done;
+    uint64_t generation;
+    uint32_t busy_workers;
+    bool shutting_down;
+};
+
+typedef struct
+{
+    Chip8Batch* batch;
+    uint32_t id;
+} WorkerArgs;
+
+static uint64_t pack_range(uint32_t begin, uint32_t end)
+{
+    return ((uint64_t) end << 32) | begin;
+}
+
+static bool take_front(WorkQueue* queue, uint32_t* chunk)
+{
+    uint64_t range = atomic_load(&queue->range);
+    for (;;)
+    {
+        uint32_t begin = (uint32_t) range;
+        uint32_t end = (uint32_t) (range >> 32);
+        if (begin >= end) { return false; }
+        if (atomic_compare_exchange_weak(&queue->range, &range, pack_range(begin + 1, end)))
+        {
+            *chunk = begin;
+            return true;
+        }
+    }
+}
+
+static bool steal_back(WorkQueue* queue, uint32_t* chunk)
+{
+    uint64_t range = atomic_load(&queue->range);
+    for (;;)
+    {
+        uint32_t begin = (uint32_t) range;
+        uint32_t end = (uint32_t) (range >> 32);
+        if (begin >= end) { return false; }
+        if (atomic_compare_exchange_weak(&queue->range, &range, pack_range(begin, end - 1)))
+        {
+            *chunk = end - 1;
+            return true;
+        }
+    }
+}
+
+static void run_instance(Chip8Batch* batch, Chip8Workspace* workspace, uint32_t index)
+{
+    BatchInstance* instance = &batch->instances[index];
+    CHIP8* cpu = &workspace->cpu;
+    if (instance->failed) { return; }
+    chip8_compact_load(workspace, &instance->machine);
+
+    for (uint32_t step = 0; step < batch->run_frames; ++step)
+    {
+        uint64_t frame = batch->frame + step;
+        uint16_t keys = 0;
+        if (frame >= instance->input_start && frame - instance->input_start < instance->input_frames)
+        {
+            keys = instance->input[frame - instance->input_start];
+        }
+        for (int key = 0; key < 16; ++key)
+        {
+            cpu->keypad[key] = (keys >> key) & 1;
+        }
+
+        // idle machines (waiting for a key or the delay timer) jump straight to the next tick
+        chip8_run_frame(cpu);
+
+        if (batch->callback != NULL)
+        {
+            batch->callback(index, frame + 1, cpu, batch->user_data);
+        }
+    }
+    // its memory no longer matches its registers, so it stays where it is
+    if (!chip8_compact_store(workspace, &instance->machine))
+    {
+        instance->failed = true;
+        atomic_fetch_add(&batch->failed, 1);
+    }
+}
+
+static void run_chunk(Chip8Batch* batch, uint32_t id, uint32_t chunk)
+{
+    uint32_t first = chunk * CHUNK_INSTANCES;
+    uint32_t last = first + CHUNK_INSTANCES;
+    if (last > batch->count) { last = batch->count; }
+    // instance-major: one machine stays hot in cache for all its frames
+    for (uint32_t index = first; index < last; ++index)
+    {
+        run_instance(batch, &batch->workspaces[id], index);
+    }
+}
+
+static void work(Chip8Batch* batch, uint32_t id)
+{
+    uint32_t chunk;
+    for (;;)
+    {
+        if (take_front(&batch->queues[id], &chunk))
+        {
+            run_chunk(batch, id, chunk);
+            continue;
+        }
+        // own queue is empty, take the last chunk of someone else's
+        bool stolen = false;
+        for (uint32_t offset = 1; offset < batch->thread_count && !stolen; ++offset)
+        {
+            stolen = steal_back(&batch->queues[(id + offset) % batch->thread_count], &chunk);
+        }
+        if (!stolen) { return; }
+        run_chunk(batch, id, chunk);
+    }
+}
+
+static void* worker_main(void* argument)
+{
+    WorkerArgs args = *(WorkerArgs*) argument;
+    free(argument);
+    Chip8Batch* batch = args.batch;
+    uint64_t seen_generation = 0;
+
+    for (;;)
+    {
+        pthread_mutex_lock(&batch->lock);
+        while (batch->generation == seen_generation && !batch->shutting_down)
+        {
+            pthread_cond_wait(&batch->start, &batch->lock);
+        }
+        if (batch->shutting_down)
+        {
+            pthread_mutex_unlock(&batch->lock);
+            return NULL;
+        }
+        seen_generation = batch->generation;
+        pthread_mutex_unlock(&batch->lock);
+
+        work(batch, args.id);
+
+        pthread_mutex_lock(&batch->lock);
+        if (--batch->busy_workers == 0)
+        {
+            pthread_cond_signal(&batch->done);
+        }
+        pthread_mutex_unlock(&batch->lock);
+    }
+}
+
+static uint32_t online_cores(void)
+{
+    long cores = sysconf(_SC_NPROCESSORS_ONLN);
+    return (cores > 0) ? (uint32_t) cores : 1;
+}
+
+// everything chip8_batch_create allocates, whatever part of it succeeded (instances is NULL or fully initialized)
+static void free_batch(Chip8Batch* batch)
+{
+    for (uint32_t index = 0; batch->instances != NULL && index < batch->count; ++index)
+    {
+        free(batch->instances[index].input);
+        chip8_compact_free(&batch->instances[index].machine);
+    }
+    free(batch->threads);
+    free(batch->queues);
+    free(batch->workspaces);
+    free(batch->instances);
+    chip8_rom_close(batch->rom);
+    free(batch);
+}
+
+Chip8Batch* chip8_batch_create(const char* rom_path, uint32_t count, uint32_t threads)
+{
+    if (count == 0) { return NULL; }
+
+    Chip8Batch* batch = calloc(1, sizeof(Chip8Batch));
+    if (batch == NULL) { return NULL; }
+
+    // read the ROM once, every instance starts out as its booted machine without a page of its own
+    batch->count = count;
+    batch->rom = chip8_rom_open(rom_path);
+    batch->instances = aligned_alloc(64, ((sizeof(BatchInstance) * count + 63) / 64) * 64);
+    if (batch->rom == NULL || batch->instances == NULL)
+    {
+        free(batch->instances);
+        batch->instances = NULL;
+        free_batch(batch);
+        return NULL;
+    }
+    memset(batch->instances, 0, sizeof(BatchInstance) * count);
+    atomic_init(&batch->failed, 0);
+    for (uint32_t index = 0; index < count; ++index)
+    {
+        chip8_compact_init(&batch->instances[index].machine, batch->rom);
+    }
+    chip8_batch_seed(batch, 0);
+
+    if (threads == 0) { threads = online_cores(); }
+    uint32_t chunks = (count + CHUNK_INSTANCES - 1) / CHUNK_INSTANCES;
+    if (threads > chunks) { threads = chunks; }
+    batch->thread_count = threads;
+
+    // a workspace per worker plus the view, each on its own cache lines
+    batch->workspaces = aligned_alloc(64, ((sizeof(Chip8Workspace) * (threads + 1) + 63) / 64) * 64);
+    batch->queues = aligned_alloc(64, ((sizeof(WorkQueue) * threads + 63) / 64) * 64);
+    batch->threads = calloc(threads, sizeof(pthread_t));
+    if (batch->workspaces == NULL || batch->queues == NULL || batch->threads == NULL)
+    {
+        free_batch(batch);
+        return NULL;
+    }
+    for (uint32_t id = 0; id <= threads; ++id)
+    {
+        chip8_workspace_init(&batch->workspaces[id], batch->rom);
+    }
+    batch->view = &batch->workspaces[threads];
+
+    pthread_mutex_init(&batch->lock, NULL);
+    pthread_cond_init(&batch->start, NULL);
+    pthread_cond_init(&batch->done, NULL);
+    for (uint32_t id = 0; id < threads; ++id)
+    {
+        atomic_init(&batch->queues[id].range, 0);
+    }
+
+    // worker 0 is whoever calls chip8_batch_run_frames
+    for (uint32_t id = 1; id < threads; ++id)
+    {
+        WorkerArgs* args = malloc(sizeof(WorkerArgs));
+        if (args != NULL)
+        {
+            args->batch = batch;
+            args->id = id;
+        }
+        // the workers started so far share the chunks, like with a thread that did not start
+        if (args == NULL || pthread_create(&batch->threads[id], NULL, worker_main, args) != 0)
+        {
+            free(args);
+            printf("CHIP8: could not start batch worker %u\n", id);
+            batch->thread_count = id;
+            break;
+        }
+    }
+    return batch;
+}
+
+void chip8_batch_destroy(Chip8Batch* batch)
+{
+    if (batch == NULL) { return; }
+
+    pthread_mutex_lock(&batch->lock);
+    batch->shutting_down = true;
+    pthread_cond_broadcast(&batch->start);
+    pthread_mutex_unlock(&batch->lock);
+    for (uint32_t id = 1; id < batch->thread_count; ++id)
+    {
+        pthread_join(batch->threads[id], NULL);
+    }
+
+    pthread_cond_destroy(&batch->done);
+    pthread_cond_destroy(&batch->start);
+    pthread_mutex_destroy(&batch->lock);
+    free_batch(batch);
+}
+
+uint32_t chip8_batch_count(const Chip8Batch* batch)
+{
+    return batch->count;
+}
+
+uint32_t chip8_batch_threads(const Chip8Batch* batch)
+{
+    return batch->thread_count;
+}
+
+uint64_t chip8_batch_frame(const Chip8Batch* batch)
+{
+    return batch->frame;
+}
+
+const CHIP8* chip8_batch_instance(Chip8Batch* batch, uint32_t index)
+{
+    chip8_compact_load(batch->view, &batch->instances[index].machine);
+    return &batch->view->cpu;
+}
+
+bool chip8_batch_instance_failed(const Chip8Batch* batch, uint32_t index)
+{
+    return batch->instances[index].failed;
+}
+
+size_t chip8_batch_instance_bytes(const Chip8Batch* batch)
+{
+    size_t bytes = 0;
+    for (uint32_t index = 0; index < batch->count; ++index)
+    {
+        bytes += chip8_compact_size(&batch->instances[index].machine);
+    }
+    return bytes;
+}
+
+void chip8_batch_seed(Chip8Batch* batch, uint32_t seed)
+{
+    // distinct, reproducible random streams per instance
+    for (uint32_t index = 0; index < batch->count; ++index)
+    {
+        chip8_compact_seed(&batch->instances[index].machine, seed + index);
+    }
+}
+
+void chip8_batch_set_input(Chip8Batch* batch, uint32_t index, const uint16_t* keys, uint32_t frames)
+{
+    BatchInstance* instance = &batch->instances[index];
+    free(instance->input);
+    instance->input = NULL;
+    instance->input_frames = 0;
+    instance->input_start = batch->frame;
+    if (frames == 0) { return; }
+
+    instance->input = malloc(sizeof(uint16_t) * frames);
+    if (instance->input == NULL) { return; }
+    memcpy(instance->input, keys, sizeof(uint16_t) * frames);
+    instance->input_frames = frames;
+}
+
+void chip8_batch_set_frame_callback(Chip8Batch* batch, Chip8FrameCallback callback, void* user_data)
+{
+    batch->callback = callback;
+    batch->user_data = user_data;
+}
+
+bool chip8_batch_run_frames(Chip8Batch* batch, uint32_t frames)
+{
+    if (frames == 0) { return atomic_load(&batch->failed) == 0; }
+
+    // hand every worker an even slice of the chunks, stealing evens out the rest
+    uint32_t chunks = (batch->count + CHUNK_INSTANCES - 1) / CHUNK_INSTANCES;
+    uint32_t threads = batch->thread_count;
+    pthread_mutex_lock(&batch->lock);
+    batch->run_frames = frames;
+    for (uint32_t id = 0; id < threads; ++id)
+    {
+        uint32_t begin = (uint32_t) ((uint64_t) chunks * id / threads);
+        uint32_t end = (uint32_t) ((uint64_t) chunks * (id + 1) / threads);
+        atomic_store(&batch->queues[id].range, pack_range(begin, end));
+    }
+    batch->busy_workers = threads - 1;
+    batch->generation++;
+    pthread_cond_broadcast(&batch->start);
+    pthread_mutex_unlock(&batch->lock);
+
+    work(batch, 0);
+
+    pthread_mutex_lock(&batch->lock);
+    while (batch->busy_workers > 0)
+    {
+        pthread_cond_wait(&batch->done, &batch->lock);
+    }
+    pthread_mutex_unlock(&batch->lock);
+
+    batch->frame += frames;
+    return atomic_load(&batch->failed) == 0;
+}
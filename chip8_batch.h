@@ -0,0 +1,45 @@
+#ifndef CHIP8_BATCH_H
+#define CHIP8_BATCH_H
+
+#include "chip8.h"
+
+/*
+ *  Batch runner: a pool of independent CHIP8 instances advanced in frame
+ *  sized chunks by a work-stealing thread pool. Each one has its own keypad
+ *  input sequence and random state. Instances are kept compact (see
+ *  chip8_rom.h): they share the ROM's memory pages and hold private copies
+ *  of only the pages they wrote, and are swapped into a full machine on the
+ *  worker's thread while they run.
+ */
+
+typedef struct Chip8Batch Chip8Batch;
+
+// called from worker threads after every frame of an instance, must only touch that instance's data;
+// cpu is the worker's machine and only holds the instance until the instance's frames are done
+typedef void (*Chip8FrameCallback)(uint32_t index, uint64_t frame, const CHIP8* cpu, void* user_data);
+
+// count instances of the same ROM (read once), threads = 0 uses one thread per online core
+Chip8Batch* chip8_batch_create(const char* rom_path, uint32_t count, uint32_t threads);
+void chip8_batch_destroy(Chip8Batch* batch);
+
+uint32_t chip8_batch_count(const Chip8Batch* batch);
+uint32_t chip8_batch_threads(const Chip8Batch* batch);
+// frames every instance has run so far
+uint64_t chip8_batch_frame(const Chip8Batch* batch);
+// the instance expanded into a machine owned by the batch, valid until the next call, only between runs
+const CHIP8* chip8_batch_instance(Chip8Batch* batch, uint32_t index);
+// true once the instance has stopped because a page it wrote could not be allocated
+bool chip8_batch_instance_failed(const Chip8Batch* batch, uint32_t index);
+// bytes of machine state across all instances, their private pages included (input sequences are not)
+size_t chip8_batch_instance_bytes(const Chip8Batch* batch);
+
+// instance k gets chip8_seed(seed + k), batches start out as chip8_batch_seed(batch, 0)
+void chip8_batch_seed(Chip8Batch* batch, uint32_t seed);
+// keypad masks (bit k = key k) applied one per frame starting at the current frame, keys are released after the last one
+void chip8_batch_set_input(Chip8Batch* batch, uint32_t index, const uint16_t* keys, uint32_t frames);
+void chip8_batch_set_frame_callback(Chip8Batch* batch, Chip8FrameCallback callback, void* user_data);
+
+// advances every instance by frames frames (chip8_run_frame, one timer tick each),
+// false if an instance has failed (see chip8_batch_instance_failed), the others keep running
+bool chip8_batch_run_frames(Chip8Batch* batch, uint32_t frames);
+#endif
@@ -0,0 +1,351 @@
+#include "chip8_capture.h"
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define PNG_PATH_MAX 4096
+#define PNG_ROW_BYTES (1 + DISPLAY_WIDTH / 8)  // filter byte + one bit per pixel
+#define PNG_IMAGE_BYTES (PNG_ROW_BYTES * DISPLAY_HEIGHT)
+#define PNG_MAX_BYTES 512                      // signature, IHDR, IDAT with a stored deflate block, IEND
+
+struct Chip8Capture
+{
+    FILE* raw;
+    FILE* hashes;
+    const char* png_prefix;
+    bool failed;
+    Chip8CaptureStats stats;
+
+    // frames handed over by chip8_capture_frame, [tail, head) are waiting for the writer
+    uint64_t (*queue)[DISPLAY_HEIGHT];
+    uint64_t head;
+    uint64_t tail;
+    bool closing;
+    pthread_mutex_t lock;
+    pthread_cond_t has_frames;
+    pthread_cond_t has_space;
+    pthread_t writer;
+
+    // writer only: one packed batch for a single fwrite, and the last frame that went to a PNG
+    uint8_t* packed;
+    uint8_t last_png[CHIP8_CAPTURE_FRAME_BYTES];
+    bool has_png;
+};
+
+static void pack_display(const uint64_t display[DISPLAY_HEIGHT], uint8_t frame[CHIP8_CAPTURE_FRAME_BYTES])
+{
+    // bit 63 is x = 0, so the big-endian bytes of a row are the 1bpp row, MSB first
+    for (int y = 0; y < DISPLAY_HEIGHT; ++y)
+    {
+        for (int byte = 0; byte < DISPLAY_WIDTH / 8; ++byte)
+        {
+            frame[y * (DISPLAY_WIDTH / 8) + byte] = (uint8_t) (display[y] >> (DISPLAY_WIDTH - 8 - byte * 8));
+        }
+    }
+}
+
+void chip8_capture_pack(const CHIP8* cpu, uint8_t frame[CHIP8_CAPTURE_FRAME_BYTES])
+{
+    pack_display(cpu->display, frame);
+}
+
+uint64_t chip8_capture_hash(const uint8_t frame[CHIP8_CAPTURE_FRAME_BYTES])
+{
+    uint64_t hash = 0xcbf29ce484222325ull;
+    for (int k = 0; k < CHIP8_CAPTURE_FRAME_BYTES; ++k)
+    {
+        hash = (hash ^ frame[k]) * 0x100000001b3ull;
+    }
+    return hash;
+}
+
+/*
+ *  PNG: 1-bit grayscale, no compression. A 64x32 image is 288 bytes of
+ *  scanlines, so a stored deflate block is smaller than any zlib setup and
+ *  leaves nothing to depend on.
+ */
+
+static uint32_t crc_table[256];
+static pthread_once_t crc_once = PTHREAD_ONCE_INIT;
+
+static void build_crc_table(void)
+{
+    for (uint32_t n = 0; n < 256; ++n)
+    {
+        uint32_t c = n;
+        for (int k = 0; k < 8; ++k)
+        {
+            c = (c & 1) ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+        }
+        crc_table[n] = c;
+    }
+}
+
+static uint32_t crc32(const uint8_t* bytes, size_t length)
+{
+    uint32_t c = 0xFFFFFFFFu;
+    for (size_t k = 0; k < length; ++k)
+    {
+        c = crc_table[(c ^ bytes[k]) & 0xFF] ^ (c >> 8);
+    }
+    return c ^ 0xFFFFFFFFu;
+}
+
+static uint8_t* put_u32_be(uint8_t* at, uint32_t value)
+{
+    at[0] = (uint8_t) (value >> 24);
+    at[1] = (uint8_t) (value >> 16);
+    at[2] = (uint8_t) (value >> 8);
+    at[3] = (uint8_t) value;
+    return at + 4;
+}
+
+// length, type, data and the CRC of type + data, returns the end of the chunk
+static uint8_t* put_chunk(uint8_t* at, const char type[4], const uint8_t* data, uint32_t length)
+{
+    at = put_u32_be(at, length);
+    uint8_t* crc_start = at;
+    memcpy(at, type, 4);
+    at += 4;
+    if (length > 0) { memcpy(at, data, length); }
+    at += length;
+    return put_u32_be(at, crc32(crc_start, length + 4));
+}
+
+// encodes a packed frame, lit pixels white, returns the size of the file
+static size_t encode_png(const uint8_t frame[CHIP8_CAPTURE_FRAME_BYTES], uint8_t out[PNG_MAX_BYTES])
+{
+    static const uint8_t signature[8] = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n' };
+    uint8_t* at = out;
+    memcpy(at, signature, sizeof(signature));
+    at += sizeof(signature);
+
+    uint8_t header[13];
+    put_u32_be(header, DISPLAY_WIDTH);
+    put_u32_be(header + 4, DISPLAY_HEIGHT);
+    header[8] = 1;   // bit depth
+    header[9] = 0;   // grayscale
+    header[10] = 0;  // deflate
+    header[11] = 0;  // adaptive filtering, every row uses filter 0
+    header[12] = 0;  // no interlace
+    at = put_chunk(at, "IHDR", header, sizeof(header));
+
+    // zlib header, one final stored block, then the Adler-32 of the scanlines
+    uint8_t data[2 + 5 + PNG_IMAGE_BYTES + 4];
+    uint8_t* image = data + 7;
+    data[0] = 0x78;
+    data[1] = 0x01;
+    data[2] = 0x01;
+    data[3] = (uint8_t) (PNG_IMAGE_BYTES & 0xFF);
+    data[4] = (uint8_t) (PNG_IMAGE_BYTES >> 8);
+    data[5] = (uint8_t) ~data[3];
+    data[6] = (uint8_t) ~data[4];
+    uint32_t a = 1;
+    uint32_t b = 0;
+    for (int y = 0; y < DISPLAY_HEIGHT; ++y)
+    {
+        uint8_t* row = image + y * PNG_ROW_BYTES;
+        row[0] = 0;
+        memcpy(row + 1, frame + y * (DISPLAY_WIDTH / 8), DISPLAY_WIDTH / 8);
+        for (int k = 0; k < PNG_ROW_BYTES; ++k)
+        {
+            a = (a + row[k]) % 65521;
+            b = (b + a) % 65521;
+        }
+    }
+    put_u32_be(image + PNG_IMAGE_BYTES, (b << 16) | a);
+    at = put_chunk(at, "IDAT", data, sizeof(data));
+    at = put_chunk(at, "IEND", NULL, 0);
+    return (size_t) (at - out);
+}
+
+static bool write_png(Chip8Capture* capture, const uint8_t frame[CHIP8_CAPTURE_FRAME_BYTES], uint64_t number)
+{
+    char path[PNG_PATH_MAX];
+    snprintf(path, sizeof(path), "%s%06llu.png", capture->png_prefix, (unsigned long long) number);
+    uint8_t png[PNG_MAX_BYTES];
+    size_t size = encode_png(frame, png);
+
+    FILE* file_pointer = fopen(path, "wb");
+    if (file_pointer == NULL)
+    {
+        perror("CHIP8: Error while writing a capture PNG: ");
+        return false;
+    }
+    bool written = fwrite(png, 1, size, file_pointer) == size;
+    return (fclose(file_pointer) == 0) && written;
+}
+
+/*
+ *  Writer thread
+ */
+
+// everything for frames [first, end), the queue slots stay untouched until tail moves past them
+static void write_frames(Chip8Capture* capture, uint64_t first, uint64_t end)
+{
+    uint8_t* packed = capture->packed;
+    for (uint64_t frame = first; frame < end; ++frame)
+    {
+        uint8_t* bytes = packed + (frame - first) * CHIP8_CAPTURE_FRAME_BYTES;
+        pack_display(capture->queue[frame % CHIP8_CAPTURE_QUEUE_FRAMES], bytes);
+
+        if (capture->hashes != NULL)
+        {
+            fprintf(capture->hashes, "%llu %016llx\n", (unsigned long long) frame, (unsigned long long) chip8_capture_hash(bytes));
+        }
+        if (capture->png_prefix != NULL && (!capture->has_png || memcmp(bytes, capture->last_png, CHIP8_CAPTURE_FRAME_BYTES) != 0))
+        {
+            if (!write_png(capture, bytes, frame))
+            {
+                // the next file would fail the same way, report it once and stop writing PNGs
+                capture->failed = true;
+                capture->png_prefix = NULL;
+                continue;
+            }
+            memcpy(capture->last_png, bytes, CHIP8_CAPTURE_FRAME_BYTES);
+            capture->has_png = true;
+            capture->stats.png_written++;
+        }
+    }
+
+    // the whole batch of the raw stream in one write
+    size_t size = (size_t) (end - first) * CHIP8_CAPTURE_FRAME_BYTES;
+    if (capture->raw != NULL)
+    {
+        if (fwrite(packed, 1, size, capture->raw) != size) { capture->failed = true; }
+        capture->stats.raw_bytes += size;
+    }
+    capture->stats.frames = end;
+}
+
+static void* writer_main(void* argument)
+{
+    Chip8Capture* capture = argument;
+    pthread_mutex_lock(&capture->lock);
+    for (;;)
+    {
+        while (capture->head == capture->tail && !capture->closing)
+        {
+            pthread_cond_wait(&capture->has_frames, &capture->lock);
+        }
+        if (capture->head == capture->tail) { break; }
+
+        // take everything queued so far, the emulation thread keeps going meanwhile
+        uint64_t first = capture->tail;
+        uint64_t end = capture->head;
+        pthread_mutex_unlock(&capture->lock);
+        write_frames(capture, first, end);
+        pthread_mutex_lock(&capture->lock);
+
+        capture->tail = end;
+        pthread_cond_signal(&capture->has_space);
+    }
+    pthread_mutex_unlock(&capture->lock);
+    return NULL;
+}
+
+static FILE* open_output(const char* path, const char* mode)
+{
+    if (strcmp(path, "-") == 0) { return stdout; }
+    FILE* file_pointer = fopen(path, mode);
+    if (file_pointer == NULL)
+    {
+        perror("CHIP8: Error while opening a capture output: ");
+    }
+    return file_pointer;
+}
+
+static bool close_output(FILE* file_pointer)
+{
+    if (file_pointer == NULL) { return true; }
+    if (file_pointer == stdout) { return fflush(stdout) == 0; }
+    return fclose(file_pointer) == 0;
+}
+
+// frees what chip8_capture_open got so far, the writer is not running
+static void discard(Chip8Capture* capture)
+{
+    close_output(capture->raw);
+    close_output(capture->hashes);
+    free(capture->packed);
+    free(capture->queue);
+    free(capture);
+}
+
+Chip8Capture* chip8_capture_open(const Chip8CaptureOptions* options)
+{
+    pthread_once(&crc_once, build_crc_table);
+
+    Chip8Capture* capture = calloc(1, sizeof(Chip8Capture));
+    if (capture == NULL) { return NULL; }
+    capture->queue = malloc(sizeof(capture->queue[0]) * CHIP8_CAPTURE_QUEUE_FRAMES);
+    capture->packed = malloc((size_t) CHIP8_CAPTURE_FRAME_BYTES * CHIP8_CAPTURE_QUEUE_FRAMES);
+    capture->png_prefix = options->png_prefix;
+    if (options->raw_path != NULL) { capture->raw = open_output(options->raw_path, "wb"); }
+    if (options->hash_path != NULL) { capture->hashes = open_output(options->hash_path, "w"); }
+    if (capture->queue == NULL || capture->packed == NULL
+        || (options->raw_path != NULL && capture->raw == NULL)
+        || (options->hash_path != NULL && capture->hashes == NULL))
+    {
+        discard(capture);
+        return NULL;
+    }
+
+    pthread_mutex_init(&capture->lock, NULL);
+    pthread_cond_init(&capture->has_frames, NULL);
+    pthread_cond_init(&capture->has_space, NULL);
+    if (pthread_create(&capture->writer, NULL, writer_main, capture) != 0)
+    {
+        pthread_cond_destroy(&capture->has_space);
+        pthread_cond_destroy(&capture->has_frames);
+        pthread_mutex_destroy(&capture->lock);
+        discard(capture);
+        return NULL;
+    }
+    return capture;
+}
+
+void chip8_capture_frame(Chip8Capture* capture, const CHIP8* cpu)
+{
+    pthread_mutex_lock(&capture->lock);
+    while (capture->head - capture->tail == CHIP8_CAPTURE_QUEUE_FRAMES)
+    {
+        pthread_cond_wait(&capture->has_space, &capture->lock);
+    }
+    pthread_mutex_unlock(&capture->lock);
+
+    // the slot at head is not visible to the writer until head moves, so the copy needs no lock
+    memcpy(capture->queue[capture->head % CHIP8_CAPTURE_QUEUE_FRAMES], cpu->display, sizeof(cpu->display));
+
+    pthread_mutex_lock(&capture->lock);
+    capture->head++;
+    pthread_cond_signal(&capture->has_frames);
+    pthread_mutex_unlock(&capture->lock);
+}
+
+bool chip8_capture_close(Chip8Capture* capture, Chip8CaptureStats* stats)
+{
+    if (capture == NULL) { return false; }
+    pthread_mutex_lock(&capture->lock);
+    capture->closing = true;
+    pthread_cond_signal(&capture->has_frames);
+    pthread_mutex_unlock(&capture->lock);
+    pthread_join(capture->writer, NULL);
+
+    bool ok = !capture->failed;
+    if (!close_output(capture->raw)) { ok = false; }
+    if (!close_output(capture->hashes)) { ok = false; }
+    if (stats != NULL) { *stats = capture->stats; }
+
+    pthread_cond_destroy(&capture->has_space);
+    pthread_cond_destroy(&capture->has_frames);
+    pthread_mutex_destroy(&capture->lock);
+    capture->raw = NULL;
+    capture->hashes = NULL;
+    discard(capture);
+    return ok;
+}
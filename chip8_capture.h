@@ -0,0 +1,43 @@
+#ifndef CHIP8_CAPTURE_H
+#define CHIP8_CAPTURE_H
+
+#include "chip8.h"
+
+/*
+ *  Headless frame capture: every captured display goes to a writer thread,
+ *  which writes a raw 1bpp stream, a PNG per changed frame and a hash log.
+ *  The emulation thread only copies 256 bytes per frame.
+ */
+
+// one frame of the raw stream: 64x32, 1 bit per pixel, rows top to bottom, leftmost pixel in the MSB
+#define CHIP8_CAPTURE_FRAME_BYTES (DISPLAY_SIZE / 8)
+// frames queued for the writer before chip8_capture_frame waits for it
+#define CHIP8_CAPTURE_QUEUE_FRAMES 1024
+
+typedef struct Chip8Capture Chip8Capture;
+
+typedef struct
+{
+    const char* raw_path;    // raw stream (ffmpeg -f rawvideo -pix_fmt monob -s 64x32), "-" for stdout, NULL for none
+    const char* png_prefix;  // <prefix>NNNNNN.png for every frame that differs from the last one written, NULL for none
+    const char* hash_path;   // one "frame hash" line per frame, "-" for stdout, NULL for none
+} Chip8CaptureOptions;
+
+typedef struct
+{
+    uint64_t frames;       // frames captured
+    uint64_t png_written;  // PNG files, frames equal to the previous one are skipped
+    uint64_t raw_bytes;    // bytes of the raw stream
+} Chip8CaptureStats;
+
+// opens every output and starts the writer thread, NULL if an output could not be opened
+Chip8Capture* chip8_capture_open(const Chip8CaptureOptions* options);
+// queues the current display as the next frame, waits only if the writer is CHIP8_CAPTURE_QUEUE_FRAMES behind
+void chip8_capture_frame(Chip8Capture* capture, const CHIP8* cpu);
+// writes what is queued, stops the writer and closes the outputs, returns false if any write failed
+bool chip8_capture_close(Chip8Capture* capture, Chip8CaptureStats* stats);
+
+// the frame as the raw stream stores it, and its FNV-1a hash as the hash log prints it
+void chip8_capture_pack(const CHIP8* cpu, uint8_t frame[CHIP8_CAPTURE_FRAME_BYTES]);
+uint64_t chip8_capture_hash(const uint8_t frame[CHIP8_CAPTURE_FRAME_BYTES]);
+#endif
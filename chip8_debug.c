@@ -0,0 +1,263 @@
+#include "chip8_debug.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define ADDRESS_MASK (SIZE_4KB - 1)
+#define REGISTER_WATCH_COUNT (CHIP8_DEBUG_REGISTER_I + 1)
+
+struct Chip8Debugger
+{
+    uint64_t breakpoints[SIZE_4KB / 64];  // one bit per address
+    uint32_t breakpoint_count;
+    uint8_t watch[SIZE_4KB];              // CHIP8_WATCH_* per address
+    uint32_t watch_count;                 // addresses with a watch
+    uint32_t register_mask;               // bit per watched register
+    bool paused;
+    bool step_over;                       // ignore the breakpoint at resume_pc until pc moves on
+    uint16_t resume_pc;
+    Chip8DebugStop stop;
+    uint64_t stops;
+};
+
+Chip8Debugger* chip8_debug_create(void)
+{
+    return calloc(1, sizeof(Chip8Debugger));
+}
+
+void chip8_debug_destroy(Chip8Debugger* debugger)
+{
+    free(debugger);
+}
+
+void chip8_debug_set_breakpoint(Chip8Debugger* debugger, uint16_t address, bool on)
+{
+    address &= ADDRESS_MASK;
+    if (chip8_debug_has_breakpoint(debugger, address) == on) { return; }
+    debugger->breakpoints[address >> 6] ^= 1ull << (address & 63);
+    debugger->breakpoint_count += on ? 1 : -1;
+}
+
+bool chip8_debug_has_breakpoint(const Chip8Debugger* debugger, uint16_t address)
+{
+    address &= ADDRESS_MASK;
+    return (debugger->breakpoints[address >> 6] >> (address & 63)) & 1;
+}
+
+void chip8_debug_set_watch(Chip8Debugger* debugger, uint16_t address, uint16_t length, uint8_t access)
+{
+    access &= CHIP8_WATCH_READ | CHIP8_WATCH_WRITE;
+    for (uint16_t k = 0; k < length && k < SIZE_4KB; ++k)
+    {
+        uint8_t* watch = &debugger->watch[(address + k) & ADDRESS_MASK];
+        debugger->watch_count += (access != 0) - (*watch != 0);
+        *watch = access;
+    }
+}
+
+void chip8_debug_watch_register(Chip8Debugger* debugger, uint8_t reg, bool on)
+{
+    if (reg >= REGISTER_WATCH_COUNT) { return; }
+    if (on) { debugger->register_mask |= 1u << reg; }
+    else { debugger->register_mask &= ~(1u << reg); }
+}
+
+void chip8_debug_clear(Chip8Debugger* debugger)
+{
+    memset(debugger->breakpoints, 0, sizeof(debugger->breakpoints));
+    memset(debugger->watch, 0, sizeof(debugger->watch));
+    debugger->breakpoint_count = 0;
+    debugger->watch_count = 0;
+    debugger->register_mask = 0;
+}
+
+static void stop(Chip8Debugger* debugger, const CHIP8* cpu, uint8_t reason)
+{
+    memset(&debugger->stop, 0, sizeof(debugger->stop));
+    debugger->stop.reason = reason;
+    debugger->stop.pc = cpu->pc;
+    debugger->paused = true;
+    debugger->stops++;
+}
+
+void chip8_debug_pause(Chip8Debugger* debugger, const CHIP8* cpu)
+{
+    if (!debugger->paused) { stop(debugger, cpu, CHIP8_STOP_PAUSE); }
+}
+
+void chip8_debug_continue(Chip8Debugger* debugger, const CHIP8* cpu)
+{
+    debugger->paused = false;
+    debugger->step_over = true;
+    debugger->resume_pc = cpu->pc;
+    debugger->stop.reason = CHIP8_STOP_NONE;
+}
+
+bool chip8_debug_paused(const Chip8Debugger* debugger)
+{
+    return debugger->paused;
+}
+
+bool chip8_debug_active(const Chip8Debugger* debugger)
+{
+    return debugger->paused || debugger->breakpoint_count > 0 || debugger->watch_count > 0 || debugger->register_mask != 0;
+}
+
+// the bytes an instruction reads or writes through I; sprite rows clipped at the bottom still count
+static uint8_t memory_access(const Instruction* instruction, uint16_t* length)
+{
+    switch (instruction->op)
+    {
+        case EXEC_DRAW_SPRITE:  *length = instruction->n; return CHIP8_WATCH_READ;
+        case EXEC_LOAD_REGS_I:  *length = instruction->x + 1; return CHIP8_WATCH_READ;
+        case EXEC_STORE_BCD_X:  *length = 3; return CHIP8_WATCH_WRITE;
+        case EXEC_STORE_REGS_I: *length = instruction->x + 1; return CHIP8_WATCH_WRITE;
+    }
+    *length = 0;
+    return 0;
+}
+
+static uint16_t register_value(const CHIP8* cpu, uint8_t reg)
+{
+    return (reg == CHIP8_DEBUG_REGISTER_I) ? cpu->i : cpu->v[reg];
+}
+
+// runs one instruction (and at most cycles of its time, into *passed) and checks the watchpoints
+// around it, true if one of them stopped the machine
+static bool execute(Chip8Debugger* debugger, CHIP8* cpu, uint32_t cycles, uint32_t* passed)
+{
+    // the bytes it touches and the registers are taken before, the instruction may change I and both
+    int watched_address = -1;
+    uint8_t access = 0;
+    if (debugger->watch_count > 0)
+    {
+        uint16_t length;
+        access = memory_access(&cpu->decoded[cpu->pc & ADDRESS_MASK], &length);
+        for (uint16_t k = 0; k < length; ++k)
+        {
+            uint16_t address = (cpu->i + k) & ADDRESS_MASK;
+            if (debugger->watch[address] & access) { watched_address = address; break; }
+        }
+    }
+    uint16_t before[REGISTER_WATCH_COUNT];
+    for (uint8_t reg = 0; debugger->register_mask != 0 && reg < REGISTER_WATCH_COUNT; ++reg)
+    {
+        before[reg] = register_value(cpu, reg);
+    }
+
+    *passed = chip8_step(cpu, cycles);
+    if (cpu->pc != debugger->resume_pc) { debugger->step_over = false; }
+
+    if (watched_address >= 0)
+    {
+        stop(debugger, cpu, (access == CHIP8_WATCH_READ) ? CHIP8_STOP_WATCH_READ : CHIP8_STOP_WATCH_WRITE);
+        debugger->stop.address = (uint16_t) watched_address;
+        return true;
+    }
+    for (uint8_t reg = 0; debugger->register_mask != 0 && reg < REGISTER_WATCH_COUNT; ++reg)
+    {
+        if (!(debugger->register_mask & (1u << reg)) || register_value(cpu, reg) == before[reg]) { continue; }
+        stop(debugger, cpu, CHIP8_STOP_REGISTER);
+        debugger->stop.reg = reg;
+        debugger->stop.old_value = before[reg];
+        debugger->stop.new_value = register_value(cpu, reg);
+        return true;
+    }
+    return false;
+}
+
+uint32_t chip8_debug_run_cycles(Chip8Debugger* debugger, CHIP8* cpu, uint32_t cycles)
+{
+    if (debugger->paused) { return 0; }
+    // nothing to check, the normal engines at full speed
+    if (!chip8_debug_active(debugger))
+    {
+        chip8_run_cycles(cpu, cycles);
+        return cycles;
+    }
+
+    uint32_t ran = 0;
+    while (ran < cycles)
+    {
+        // the rest of an instruction that is still running (CHIP8_TIMING_VIP), nothing new to check
+        if (cpu->busy_cycles > 0)
+        {
+            ran += chip8_step(cpu, cycles - ran);
+            continue;
+        }
+        bool resuming = debugger->step_over && cpu->pc == debugger->resume_pc;
+        if (!resuming && chip8_debug_has_breakpoint(debugger, cpu->pc))
+        {
+            stop(debugger, cpu, CHIP8_STOP_BREAKPOINT);
+            return ran;
+        }
+        uint32_t passed;
+        bool stopped = execute(debugger, cpu, cycles - ran, &passed);
+        ran += passed;
+        if (stopped) { return ran; }
+    }
+    return cycles;
+}
+
+void chip8_debug_step(Chip8Debugger* debugger, CHIP8* cpu)
+{
+    debugger->step_over = false;
+    // the instruction in progress finishes first, then the next one runs with all of its time
+    while (cpu->busy_cycles > 0) { chip8_step(cpu, cpu->busy_cycles); }
+    uint32_t passed;
+    if (!execute(debugger, cpu, UINT32_MAX, &passed)) { stop(debugger, cpu, CHIP8_STOP_STEP); }
+}
+
+const Chip8DebugStop* chip8_debug_last_stop(const Chip8Debugger* debugger, uint64_t* stops)
+{
+    if (stops != NULL) { *stops = debugger->stops; }
+    return &debugger->stop;
+}
+
+int chip8_disassemble(const Instruction* instruction, char* text, size_t size)
+{
+    uint8_t x = instruction->x;
+    uint8_t y = instruction->y;
+    switch (instruction->op)
+    {
+        case EXEC_CLS:             return snprintf(text, size, "CLS");
+        case EXEC_RET:             return snprintf(text, size, "RET");
+        case EXEC_JUMP:            return snprintf(text, size, "JP 0x%03X", instruction->nnn);
+        case EXEC_CALL:            return snprintf(text, size, "CALL 0x%03X", instruction->nnn);
+        case EXEC_SKIP_X_EQ_BYTE:  return snprintf(text, size, "SE V%X, 0x%02X", x, instruction->nn);
+        case EXEC_SKIP_X_NE_BYTE:  return snprintf(text, size, "SNE V%X, 0x%02X", x, instruction->nn);
+        case EXEC_SKIP_X_EQ_Y:     return snprintf(text, size, "SE V%X, V%X", x, y);
+        case EXEC_LOAD_X_BYTE:     return snprintf(text, size, "LD V%X, 0x%02X", x, instruction->nn);
+        case EXEC_ADD_X_BYTE:      return snprintf(text, size, "ADD V%X, 0x%02X", x, instruction->nn);
+        case EXEC_LOAD_X_Y:        return snprintf(text, size, "LD V%X, V%X", x, y);
+        case EXEC_OR_X_Y:          return snprintf(text, size, "OR V%X, V%X", x, y);
+        case EXEC_AND_X_Y:         return snprintf(text, size, "AND V%X, V%X", x, y);
+        case EXEC_XOR_X_Y:         return snprintf(text, size, "XOR V%X, V%X", x, y);
+        case EXEC_ADD_X_Y:         return snprintf(text, size, "ADD V%X, V%X", x, y);
+        case EXEC_SUB_X_Y:         return snprintf(text, size, "SUB V%X, V%X", x, y);
+        case EXEC_SHR_X:           return snprintf(text, size, "SHR V%X, V%X", x, y);
+        case EXEC_SUBN_X_Y:        return snprintf(text, size, "SUBN V%X, V%X", x, y);
+        case EXEC_SHL_X:           return snprintf(text, size, "SHL V%X, V%X", x, y);
+        case EXEC_SKIP_X_NE_Y:     return snprintf(text, size, "SNE V%X, V%X", x, y);
+        case EXEC_LOAD_I_ADDR:     return snprintf(text, size, "LD I, 0x%03X", instruction->nnn);
+        case EXEC_JUMP_V0_ADDR:    return snprintf(text, size, "JP V0, 0x%03X", instruction->nnn);
+        case EXEC_RANDOM_X_BYTE:   return snprintf(text, size, "RND V%X, 0x%02X", x, instruction->nn);
+        case EXEC_DRAW_SPRITE:     return snprintf(text, size, "DRW V%X, V%X, %u", x, y, instruction->n);
+        case EXEC_SKIP_IF_KEY:     return snprintf(text, size, "SKP V%X", x);
+        case EXEC_SKIP_IF_NO_KEY:  return snprintf(text, size, "SKNP V%X", x);
+        case EXEC_LOAD_X_DT:       return snprintf(text, size, "LD V%X, DT", x);
+        case EXEC_WAIT_FOR_KEY:    return snprintf(text, size, "LD V%X, K", x);
+        case EXEC_SET_DT_X:        return snprintf(text, size, "LD DT, V%X", x);
+        case EXEC_SET_ST_X:        return snprintf(text, size, "LD ST, V%X", x);
+        case EXEC_ADD_I_X:         return snprintf(text, size, "ADD I, V%X", x);
+        case EXEC_LOAD_F_X:        return snprintf(text, size, "LD F, V%X", x);
+        case EXEC_STORE_BCD_X:     return snprintf(text, size, "LD B, V%X", x);
+        case EXEC_STORE_REGS_I:    return snprintf(text, size, "LD [I], V%X", x);
+        case EXEC_LOAD_REGS_I:     return snprintf(text, size, "LD V%X, [I]", x);
+    }
+    // 0nnn machine calls and unknown opcodes, as data
+    return snprintf(text, size, "DW 0x%04X", (instruction->type << 12) | instruction->nnn);
+}
@@ -0,0 +1,90 @@
+#ifndef CHIP8_DEBUG_H
+#define CHIP8_DEBUG_H
+
+#include "chip8.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ *  Debugger: PC breakpoints, watchpoints on memory accessed through I and on
+ *  registers, single-step and a disassembler. chip8_debug_run_cycles runs
+ *  the normal engines while nothing is set, and switches to an instrumented
+ *  loop (one chip8_cycle at a time, checked before and after) only while a
+ *  breakpoint or watchpoint exists or the machine is paused.
+ *
+ *  The debug server puts the same operations on a local Unix socket with a
+ *  line-based text protocol, see chip8_debug_server_poll.
+ */
+
+// why the machine stopped, in Chip8DebugStop.reason
+#define CHIP8_STOP_NONE        0  // running
+#define CHIP8_STOP_PAUSE       1  // chip8_debug_pause, or the debugger attached
+#define CHIP8_STOP_STEP        2  // chip8_debug_step ran its instruction
+#define CHIP8_STOP_BREAKPOINT  3  // pc reached a breakpoint, the instruction there has not run
+#define CHIP8_STOP_WATCH_READ  4  // the instruction before pc read a watched byte
+#define CHIP8_STOP_WATCH_WRITE 5  // the instruction before pc wrote a watched byte
+#define CHIP8_STOP_REGISTER    6  // the instruction before pc changed a watched register
+
+// memory watchpoint access kinds, only instructions that go through I touch memory:
+// Dxyn and Fx65 read it, Fx33 and Fx55 write it
+#define CHIP8_WATCH_READ  0x1
+#define CHIP8_WATCH_WRITE 0x2
+
+// register watchpoints: V0..VF are 0..15
+#define CHIP8_DEBUG_REGISTER_I 16
+
+typedef struct
+{
+    uint8_t reason;      // CHIP8_STOP_*
+    uint16_t pc;         // where the machine is now
+    uint16_t address;    // the watched byte for CHIP8_STOP_WATCH_*
+    uint8_t reg;         // the register for CHIP8_STOP_REGISTER
+    uint16_t old_value;  // CHIP8_STOP_REGISTER: before and after the instruction
+    uint16_t new_value;
+} Chip8DebugStop;
+
+typedef struct Chip8Debugger Chip8Debugger;
+
+// starts running with nothing set, NULL if out of memory
+Chip8Debugger* chip8_debug_create(void);
+void chip8_debug_destroy(Chip8Debugger* debugger);
+
+void chip8_debug_set_breakpoint(Chip8Debugger* debugger, uint16_t address, bool on);
+bool chip8_debug_has_breakpoint(const Chip8Debugger* debugger, uint16_t address);
+// access is a CHIP8_WATCH_* mask for [address, address + length), 0 removes the watchpoint
+void chip8_debug_set_watch(Chip8Debugger* debugger, uint16_t address, uint16_t length, uint8_t access);
+// stops whenever the register changes, reg is 0..15 or CHIP8_DEBUG_REGISTER_I
+void chip8_debug_watch_register(Chip8Debugger* debugger, uint8_t reg, bool on);
+// removes every breakpoint and watchpoint
+void chip8_debug_clear(Chip8Debugger* debugger);
+
+void chip8_debug_pause(Chip8Debugger* debugger, const CHIP8* cpu);
+// runs again from pc; a breakpoint at pc itself is stepped over
+void chip8_debug_continue(Chip8Debugger* debugger, const CHIP8* cpu);
+bool chip8_debug_paused(const Chip8Debugger* debugger);
+// true while the instrumented loop is needed: something is set or the machine is paused
+bool chip8_debug_active(const Chip8Debugger* debugger);
+
+// like chip8_run_cycles, but stops early on a breakpoint or watchpoint; returns the cycles run,
+// 0 while paused (the timers tick only where the cycles that did run reach them)
+uint32_t chip8_debug_run_cycles(Chip8Debugger* debugger, CHIP8* cpu, uint32_t cycles);
+// runs exactly one instruction and stays paused, watchpoints it hits are reported as the stop
+void chip8_debug_step(Chip8Debugger* debugger, CHIP8* cpu);
+// the last stop; stops counts every one since chip8_debug_create, so pollers can tell a new one apart
+const Chip8DebugStop* chip8_debug_last_stop(const Chip8Debugger* debugger, uint64_t* stops);
+
+// one instruction in Cowgod's mnemonics, "LD VA, 0x02", returns the length like snprintf
+int chip8_disassemble(const Instruction* instruction, char* text, size_t size);
+
+typedef struct Chip8DebugServer Chip8DebugServer;
+
+// listens on a Unix socket at path (an old socket file there is replaced), NULL on failure
+Chip8DebugServer* chip8_debug_server_open(const char* path);
+// closes the client and the socket and removes the socket file
+void chip8_debug_server_close(Chip8DebugServer* server);
+// accepts a client, runs the commands it sent and reports new stops, waiting at most timeout_ms
+// (-1 forever) for something to happen; returns false once the client asked the host to exit
+bool chip8_debug_server_poll(Chip8DebugServer* server, Chip8Debugger* debugger, CHIP8* cpu, int timeout_ms);
+#endif
@@ -0,0 +1,447 @@
+/*
+ *  Debug server: one client at a time on a local Unix socket, one command per
+ *  line. Every command answers with zero or more lines and then "ok" or
+ *  "error <why>". A stop the client has not seen yet is reported as a
+ *  "stop <reason> pc=0x..." line as soon as it happens, so after "continue"
+ *  a client just reads until the next stop line.
+ *
+ *  Numbers are decimal or 0x hex. Commands:
+ *      status                      running or paused
+ *      regs                        pc, I, sp, timers, V0..VF and the stack
+ *      mem ADDR [LEN]              hex dump, 16 bytes per line
+ *      poke ADDR BYTE...           writes bytes into memory
+ *      set pc|i|dt|st|vX VALUE
+ *      dis [ADDR [COUNT]]          disassembly, from pc by default
+ *      display                     the screen, '#' for lit pixels
+ *      break ADDR / delete ADDR
+ *      watch ADDR [LEN] [r|w|rw]   memory watchpoint, writes by default
+ *      unwatch ADDR [LEN]
+ *      watchreg vX|i / unwatchreg vX|i
+ *      clear                       removes every breakpoint and watchpoint
+ *      pause / continue / step [N]
+ *      detach                      clears everything, resumes and disconnects
+ *      kill                        asks the host to exit
+ *
+ *  Commands run on the caller's thread inside chip8_debug_server_poll, between
+ *  two chip8_debug_run_cycles, so they never race the machine.
+ */
+
+#include "chip8_debug.h"
+
+#include <errno.h>
+#include <poll.h>
+#include <stdarg.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#define ADDRESS_MASK (SIZE_4KB - 1)
+#define LINE_BYTES 256
+#define MAX_ARGUMENTS 20
+#define DEFAULT_DISASSEMBLY 10
+
+struct Chip8DebugServer
+{
+    int listener;
+    int client;           // -1 while nobody is attached
+    char path[sizeof(((struct sockaddr_un*) NULL)->sun_path)];
+    char line[LINE_BYTES];
+    size_t line_length;
+    uint64_t reported;    // stops the client has been told about
+};
+
+static const char* stop_names[] = { "none", "pause", "step", "breakpoint", "watch-read", "watch-write", "register" };
+
+// best effort: a client that stopped reading is dropped on its next read
+static void reply(Chip8DebugServer* server, const char* format, ...)
+{
+    char text[LINE_BYTES * 2];
+    va_list arguments;
+    va_start(arguments, format);
+    int length = vsnprintf(text, sizeof(text) - 1, format, arguments);
+    va_end(arguments);
+    if (length < 0) { return; }
+    if ((size_t) length > sizeof(text) - 2) { length = (int) sizeof(text) - 2; }
+    text[length++] = '\n';
+
+    for (int sent = 0; sent < length && server->client >= 0;)
+    {
+        ssize_t written = send(server->client, text + sent, (size_t) (length - sent), MSG_NOSIGNAL);
+        if (written < 0 && errno == EINTR) { continue; }
+        if (written <= 0) { return; }
+        sent += (int) written;
+    }
+}
+
+static void report_stop(Chip8DebugServer* server, const Chip8Debugger* debugger)
+{
+    uint64_t stops;
+    const Chip8DebugStop* stop = chip8_debug_last_stop(debugger, &stops);
+    if (stops == server->reported) { return; }
+    server->reported = stops;
+
+    switch (stop->reason)
+    {
+        case CHIP8_STOP_WATCH_READ:
+        case CHIP8_STOP_WATCH_WRITE:
+            reply(server, "stop %s pc=0x%03X address=0x%03X", stop_names[stop->reason], stop->pc, stop->address);
+            break;
+        case CHIP8_STOP_REGISTER:
+            if (stop->reg == CHIP8_DEBUG_REGISTER_I)
+            {
+                reply(server, "stop register pc=0x%03X reg=I old=0x%03X new=0x%03X", stop->pc, stop->old_value, stop->new_value);
+            }
+            else
+            {
+                reply(server, "stop register pc=0x%03X reg=V%X old=0x%02X new=0x%02X", stop->pc, stop->reg, stop->old_value, stop->new_value);
+            }
+            break;
+        default:
+            reply(server, "stop %s pc=0x%03X", stop_names[stop->reason], stop->pc);
+            break;
+    }
+}
+
+static bool parse_number(const char* text, uint32_t* value)
+{
+    char* end;
+    unsigned long parsed = strtoul(text, &end, 0);
+    if (end == text || *end != '\0') { return false; }
+    *value = (uint32_t) parsed;
+    return true;
+}
+
+// V0..VF are 0..15, I is CHIP8_DEBUG_REGISTER_I
+static bool parse_register(const char* text, uint8_t* reg)
+{
+    if ((text[0] == 'i' || text[0] == 'I') && text[1] == '\0')
+    {
+        *reg = CHIP8_DEBUG_REGISTER_I;
+        return true;
+    }
+    if ((text[0] != 'v' && text[0] != 'V') || text[1] == '\0' || text[2] != '\0') { return false; }
+    char* end;
+    unsigned long index = strtoul(text + 1, &end, 16);
+    if (*end != '\0') { return false; }
+    *reg = (uint8_t) index;
+    return true;
+}
+
+static void command_regs(Chip8DebugServer* server, const CHIP8* cpu)
+{
+    char registers[REGISTER_COUNT * 3 + 1] = "";
+    char stack[STACK_SIZE * 6 + 1] = "";
+    size_t used = 0;
+    for (int reg = 0; reg < REGISTER_COUNT; ++reg)
+    {
+        used += (size_t) snprintf(registers + used, sizeof(registers) - used, "%s%02X", reg ? "," : "", cpu->v[reg]);
+    }
+    used = 0;
+    for (int level = 0; level < cpu->stack_pointer && level < STACK_SIZE; ++level)
+    {
+        used += (size_t) snprintf(stack + used, sizeof(stack) - used, "%s0x%03X", level ? "," : "", cpu->stack[level]);
+    }
+    reply(server, "pc=0x%03X i=0x%03X sp=%u dt=%u st=%u v=%s stack=%s", cpu->pc, cpu->i, cpu->stack_pointer, cpu->delay,
+          cpu->sound_timer, registers, stack);
+}
+
+static void command_mem(Chip8DebugServer* server, const CHIP8* cpu, uint32_t address, uint32_t length)
+{
+    for (uint32_t row = 0; row < length; row += 16)
+    {
+        char text[16 * 3 + 1] = "";
+        for (uint32_t k = row; k < length && k < row + 16; ++k)
+        {
+            snprintf(text + (k - row) * 3, 4, " %02X", cpu->memory[(address + k) & ADDRESS_MASK]);
+        }
+        reply(server, "0x%03X:%s", (address + row) & ADDRESS_MASK, text);
+    }
+}
+
+static void command_dis(Chip8DebugServer* server, const Chip8Debugger* debugger, const CHIP8* cpu, uint32_t address, uint32_t count)
+{
+    for (uint32_t k = 0; k < count; ++k)
+    {
+        uint16_t at = (address + k * 2) & ADDRESS_MASK;
+        char text[32];
+        chip8_disassemble(&cpu->decoded[at], text, sizeof(text));
+        reply(server, "%s0x%03X: %02X%02X  %s", (at == cpu->pc) ? "=>" : (chip8_debug_has_breakpoint(debugger, at) ? " *" : "  "),
+              at, cpu->memory[at], cpu->memory[(at + 1) & ADDRESS_MASK], text);
+    }
+}
+
+static void command_display(Chip8DebugServer* server, const CHIP8* cpu)
+{
+    for (int y = 0; y < DISPLAY_HEIGHT; ++y)
+    {
+        char row[DISPLAY_WIDTH + 1];
+        for (int x = 0; x < DISPLAY_WIDTH; ++x)
+        {
+            row[x] = chip8_get_pixel(cpu, x, y) ? '#' : '.';
+        }
+        row[DISPLAY_WIDTH] = '\0';
+        reply(server, "%s", row);
+    }
+}
+
+static void detach(Chip8DebugServer* server, Chip8Debugger* debugger, const CHIP8* cpu)
+{
+    // a debugger that went away must not leave the machine paused or slowed down
+    chip8_debug_clear(debugger);
+    if (chip8_debug_paused(debugger)) { chip8_debug_continue(debugger, cpu); }
+    close(server->client);
+    server->client = -1;
+    server->line_length = 0;
+}
+
+// runs one command line; NULL is success, otherwise the error text
+static const char* run_command(Chip8DebugServer* server, Chip8Debugger* debugger, CHIP8* cpu, char* line, bool* keep_running)
+{
+    char* arguments[MAX_ARGUMENTS];
+    int count = 0;
+    for (char* token = strtok(line, " \t\r"); token != NULL && count < MAX_ARGUMENTS; token = strtok(NULL, " \t\r"))
+    {
+        arguments[count++] = token;
+    }
+    if (count == 0) { return NULL; }
+
+    const char* name = arguments[0];
+    uint32_t numbers[2] = { 0, 0 };
+    for (int k = 1; k < count && k < 3; ++k)
+    {
+        // not every command takes numbers, those that do check the result below
+        if (!parse_number(arguments[k], &numbers[k - 1])) { numbers[k - 1] = UINT32_MAX; }
+    }
+
+    if (strcmp(name, "status") == 0)
+    {
+        reply(server, chip8_debug_paused(debugger) ? "paused pc=0x%03X" : "running pc=0x%03X", cpu->pc);
+    }
+    else if (strcmp(name, "regs") == 0)
+    {
+        command_regs(server, cpu);
+    }
+    else if (strcmp(name, "mem") == 0)
+    {
+        uint32_t length = (count > 2) ? numbers[1] : 16;
+        if (count < 2 || numbers[0] == UINT32_MAX || length > SIZE_4KB) { return "usage: mem ADDR [LEN]"; }
+        command_mem(server, cpu, numbers[0], length);
+    }
+    else if (strcmp(name, "poke") == 0)
+    {
+        if (count < 3 || numbers[0] == UINT32_MAX) { return "usage: poke ADDR BYTE..."; }
+        uint8_t bytes[MAX_ARGUMENTS];
+        for (int k = 2; k < count; ++k)
+        {
+            uint32_t value;
+            if (!parse_number(arguments[k], &value) || value > 0xFF) { return "bytes are 0..255"; }
+            bytes[k - 2] = (uint8_t) value;
+        }
+        for (int k = 2; k < count; ++k)
+        {
+            cpu->memory[(numbers[0] + k - 2) & ADDRESS_MASK] = bytes[k - 2];
+        }
+        // also marks every page written, so translators drop what they cached
+        chip8_decode_memory(cpu);
+    }
+    else if (strcmp(name, "set") == 0)
+    {
+        if (count != 3 || numbers[1] == UINT32_MAX) { return "usage: set pc|i|dt|st|vX VALUE"; }
+        uint8_t reg;
+        if (strcmp(arguments[1], "pc") == 0) { cpu->pc = numbers[1] & ADDRESS_MASK; }
+        else if (strcmp(arguments[1], "dt") == 0) { cpu->delay = (uint8_t) numbers[1]; }
+        else if (strcmp(arguments[1], "st") == 0) { cpu->sound_timer = (uint8_t) numbers[1]; }
+        else if (parse_register(arguments[1], &reg) && reg == CHIP8_DEBUG_REGISTER_I) { cpu->i = numbers[1] & 0xFFFF; }
+        else if (parse_register(arguments[1], &reg) && reg < REGISTER_COUNT) { cpu->v[reg] = (uint8_t) numbers[1]; }
+        else { return "unknown register"; }
+    }
+    else if (strcmp(name, "dis") == 0)
+    {
+        uint32_t address = (count > 1) ? numbers[0] : cpu->pc;
+        uint32_t instructions = (count > 2) ? numbers[1] : DEFAULT_DISASSEMBLY;
+        if (address == UINT32_MAX || instructions > SIZE_4KB / 2) { return "usage: dis [ADDR [COUNT]]"; }
+        command_dis(server, debugger, cpu, address, instructions);
+    }
+    else if (strcmp(name, "display") == 0)
+    {
+        command_display(server, cpu);
+    }
+    else if (strcmp(name, "break") == 0 || strcmp(name, "delete") == 0)
+    {
+        if (count != 2 || numbers[0] == UINT32_MAX) { return "usage: break|delete ADDR"; }
+        chip8_debug_set_breakpoint(debugger, (uint16_t) numbers[0], name[0] == 'b');
+    }
+    else if (strcmp(name, "watch") == 0 || strcmp(name, "unwatch") == 0)
+    {
+        bool on = (name[0] == 'w');
+        uint32_t length = (count > 2) ? numbers[1] : 1;
+        const char* kind = (on && count > 3) ? arguments[3] : "w";
+        uint8_t access = 0;
+        if (strchr(kind, 'r')) { access |= CHIP8_WATCH_READ; }
+        if (strchr(kind, 'w')) { access |= CHIP8_WATCH_WRITE; }
+        if (count < 2 || numbers[0] == UINT32_MAX || length == 0 || length > SIZE_4KB || access == 0)
+        {
+            return "usage: watch ADDR [LEN] [r|w|rw], unwatch ADDR [LEN]";
+        }
+        chip8_debug_set_watch(debugger, (uint16_t) numbers[0], (uint16_t) length, on ? access : 0);
+    }
+    else if (strcmp(name, "watchreg") == 0 || strcmp(name, "unwatchreg") == 0)
+    {
+        uint8_t reg;
+        if (count != 2 || !parse_register(arguments[1], &reg)) { return "usage: watchreg|unwatchreg vX|i"; }
+        chip8_debug_watch_register(debugger, reg, name[0] == 'w');
+    }
+    else if (strcmp(name, "clear") == 0)
+    {
+        chip8_debug_clear(debugger);
+    }
+    else if (strcmp(name, "pause") == 0)
+    {
+        chip8_debug_pause(debugger, cpu);
+    }
+    else if (strcmp(name, "continue") == 0)
+    {
+        if (!chip8_debug_paused(debugger)) { return "already running"; }
+        chip8_debug_continue(debugger, cpu);
+    }
+    else if (strcmp(name, "step") == 0)
+    {
+        uint32_t steps = (count > 1) ? numbers[0] : 1;
+        if (steps == UINT32_MAX) { return "usage: step [N]"; }
+        chip8_debug_pause(debugger, cpu);
+        // the pause that steps start from is not news, only where the steps end is
+        chip8_debug_last_stop(debugger, &server->reported);
+        for (uint32_t step = 0; step < steps; ++step)
+        {
+            chip8_debug_step(debugger, cpu);
+            // a watchpoint ends the steps early
+            if (chip8_debug_last_stop(debugger, NULL)->reason != CHIP8_STOP_STEP) { break; }
+        }
+    }
+    else if (strcmp(name, "detach") == 0)
+    {
+        reply(server, "ok");
+        detach(server, debugger, cpu);
+        return NULL;
+    }
+    else if (strcmp(name, "kill") == 0)
+    {
+        *keep_running = false;
+    }
+    else
+    {
+        return "unknown command";
+    }
+    report_stop(server, debugger);
+    reply(server, "ok");
+    return NULL;
+}
+
+Chip8DebugServer* chip8_debug_server_open(const char* path)
+{
+    Chip8DebugServer* server = calloc(1, sizeof(Chip8DebugServer));
+    if (server == NULL) { return NULL; }
+    server->client = -1;
+    if (strlen(path) >= sizeof(server->path))
+    {
+        printf("CHIP8: debug socket path is too long: %s\n", path);
+        free(server);
+        return NULL;
+    }
+    strcpy(server->path, path);
+
+    struct sockaddr_un address;
+    memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    strcpy(address.sun_path, path);
+
+    server->listener = socket(AF_UNIX, SOCK_STREAM, 0);
+    // a socket file left by an earlier run would make bind fail
+    unlink(path);
+    if (server->listener < 0 || bind(server->listener, (struct sockaddr*) &address, sizeof(address)) != 0 || listen(server->listener, 1) != 0)
+    {
+        perror("CHIP8: Error while opening the debug socket: ");
+        if (server->listener >= 0) { close(server->listener); }
+        free(server);
+        return NULL;
+    }
+    return server;
+}
+
+void chip8_debug_server_close(Chip8DebugServer* server)
+{
+    if (server == NULL) { return; }
+    if (server->client >= 0) { close(server->client); }
+    close(server->listener);
+    unlink(server->path);
+    free(server);
+}
+
+bool chip8_debug_server_poll(Chip8DebugServer* server, Chip8Debugger* debugger, CHIP8* cpu, int timeout_ms)
+{
+    // a stop that happened since the last poll, before anything new
+    if (server->client >= 0) { report_stop(server, debugger); }
+
+    struct pollfd descriptors[2] = { { server->listener, POLLIN, 0 }, { server->client, POLLIN, 0 } };
+    if (poll(descriptors, 2, timeout_ms) <= 0) { return true; }
+
+    if (descriptors[0].revents & POLLIN)
+    {
+        int client = accept(server->listener, NULL, NULL);
+        if (client >= 0 && server->client >= 0)
+        {
+            const char busy[] = "error another debugger is attached\n";
+            (void) !send(client, busy, sizeof(busy) - 1, MSG_NOSIGNAL);
+            close(client);
+        }
+        else if (client >= 0)
+        {
+            // attaching stops the machine where it is, like a debugger attaching to a process
+            server->client = client;
+            server->line_length = 0;
+            chip8_debug_pause(debugger, cpu);
+            chip8_debug_last_stop(debugger, &server->reported);
+            reply(server, "chip8-debug 1");
+            reply(server, "stop pause pc=0x%03X", cpu->pc);
+        }
+    }
+
+    bool keep_running = true;
+    if (server->client >= 0 && (descriptors[1].revents & (POLLIN | POLLHUP | POLLERR)))
+    {
+        ssize_t received = recv(server->client, server->line + server->line_length, sizeof(server->line) - 1 - server->line_length, MSG_DONTWAIT);
+        if (received <= 0 && !(received < 0 && (errno == EAGAIN || errno == EINTR)))
+        {
+            detach(server, debugger, cpu);
+            return true;
+        }
+        if (received > 0) { server->line_length += (size_t) received; }
+
+        char* start = server->line;
+        char* end;
+        while (server->client >= 0 && keep_running && (end = memchr(start, '\n', server->line_length - (size_t) (start - server->line))) != NULL)
+        {
+            *end = '\0';
+            const char* error = run_command(server, debugger, cpu, start, &keep_running);
+            if (error != NULL) { reply(server, "error %s", error); }
+            start = end + 1;
+        }
+        if (server->client >= 0)
+        {
+            // keep the unfinished line, a full buffer without a newline is dropped
+            server->line_length -= (size_t) (start - server->line);
+            memmove(server->line, start, server->line_length);
+            if (server->line_length == sizeof(server->line) - 1)
+            {
+                reply(server, "error line too long");
+                server->line_length = 0;
+            }
+        }
+    }
+    return keep_running;
+}
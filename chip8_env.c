@@ -0,0 +1,289 @@
+#include "chip8_env.h"
+#include "chip8_rom.h"
+
+#include <fcntl.h>
+#include <sched.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+// a waiting side spins this often, then yields this often, then sleeps between checks
+#define SPIN_WAITS 1000
+#define YIELD_WAITS 10000
+#define SLEEP_WAIT_NS 50000
+
+struct Chip8Env
+{
+    Chip8EnvHeader* header;
+    size_t region_bytes;
+    bool owner;             // created the region and runs the machines
+    char name[256];         // shared memory object, empty for anonymous memory
+    Chip8Rom* rom;          // owner only: the loaded ROM every reset starts from
+};
+
+// the layout this build uses, attached regions must match it field for field
+static void describe_layout(Chip8EnvHeader* header, uint32_t count)
+{
+    header->magic = CHIP8_ENV_MAGIC;
+    header->version = CHIP8_ENV_VERSION;
+    header->count = count;
+    header->instance_offset = (uint32_t) ((sizeof(Chip8EnvHeader) + 63) & ~(size_t) 63);
+    header->instance_stride = (uint32_t) sizeof(Chip8EnvInstance);
+    header->region_bytes = header->instance_offset + (uint64_t) header->instance_stride * count;
+
+    size_t cpu = offsetof(Chip8EnvInstance, cpu);
+    header->action_offset = (uint32_t) offsetof(Chip8EnvInstance, action);
+    header->probe_value_offset = (uint32_t) offsetof(Chip8EnvInstance, probe_value);
+    header->reward_offset = (uint32_t) offsetof(Chip8EnvInstance, reward);
+    header->frames_offset = (uint32_t) offsetof(Chip8EnvInstance, frames);
+    header->display_offset = (uint32_t) (cpu + offsetof(CHIP8, display));
+    header->registers_offset = (uint32_t) (cpu + offsetof(CHIP8, v));
+    header->i_offset = (uint32_t) (cpu + offsetof(CHIP8, i));
+    header->pc_offset = (uint32_t) (cpu + offsetof(CHIP8, pc));
+    header->memory_offset = (uint32_t) (cpu + offsetof(CHIP8, memory));
+}
+
+static bool same_layout(const Chip8EnvHeader* a, const Chip8EnvHeader* b)
+{
+    size_t first = offsetof(Chip8EnvHeader, instance_offset);
+    size_t last = offsetof(Chip8EnvHeader, memory_offset) + sizeof(a->memory_offset);
+    return a->magic == b->magic && a->version == b->version && a->region_bytes == b->region_bytes &&
+           memcmp((const uint8_t*) a + first, (const uint8_t*) b + first, last - first) == 0;
+}
+
+static void backoff(uint32_t* waits)
+{
+    (*waits)++;
+    if (*waits < SPIN_WAITS) { return; }
+    if (*waits < YIELD_WAITS)
+    {
+        sched_yield();
+        return;
+    }
+    struct timespec pause = { 0, SLEEP_WAIT_NS };
+    nanosleep(&pause, NULL);
+}
+
+static Chip8Env* map_region(const char* shm_name, size_t bytes, bool create)
+{
+    Chip8Env* env = calloc(1, sizeof(Chip8Env));
+    if (env == NULL) { return NULL; }
+    if (shm_name != NULL && strlen(shm_name) >= sizeof(env->name))
+    {
+        printf("CHIP8: shared memory name is too long: %s\n", shm_name);
+        free(env);
+        return NULL;
+    }
+
+    void* region = MAP_FAILED;
+    if (shm_name == NULL)
+    {
+        region = mmap(NULL, bytes, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    }
+    else
+    {
+        // a region left by an earlier run is replaced, not reused with a stale layout
+        if (create) { shm_unlink(shm_name); }
+        int fd = shm_open(shm_name, create ? (O_CREAT | O_EXCL | O_RDWR) : O_RDWR, 0600);
+        struct stat info;
+        if (fd >= 0 && !create && fstat(fd, &info) == 0) { bytes = (size_t) info.st_size; }
+        if (fd >= 0 && bytes >= sizeof(Chip8EnvHeader) && (!create || ftruncate(fd, (off_t) bytes) == 0))
+        {
+            region = mmap(NULL, bytes, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        }
+        if (fd >= 0) { close(fd); }
+        if (region == MAP_FAILED && create) { shm_unlink(shm_name); }
+        strcpy(env->name, shm_name);
+    }
+    if (region == MAP_FAILED)
+    {
+        perror("CHIP8: Error while mapping the environment's shared memory: ");
+        free(env);
+        return NULL;
+    }
+    env->header = region;
+    env->region_bytes = bytes;
+    env->owner = create;
+    return env;
+}
+
+Chip8Env* chip8_env_create(const char* rom_path, uint32_t count, const char* shm_name)
+{
+    if (count == 0) { return NULL; }
+
+    Chip8Rom* rom = chip8_rom_open(rom_path);
+    if (rom == NULL) { return NULL; }
+
+    Chip8EnvHeader layout;
+    memset(&layout, 0, sizeof(layout));
+    describe_layout(&layout, count);
+    Chip8Env* env = map_region(shm_name, (size_t) layout.region_bytes, true);
+    if (env == NULL)
+    {
+        chip8_rom_close(rom);
+        return NULL;
+    }
+    env->rom = rom;
+
+    // fresh memory is zero, so request == completed and the request/completed atomics start out valid
+    Chip8EnvHeader* header = env->header;
+    describe_layout(header, count);
+    atomic_init(&header->request, 0);
+    atomic_init(&header->completed, 0);
+    chip8_env_reset(env, 0);
+    return env;
+}
+
+Chip8Env* chip8_env_attach(const char* shm_name)
+{
+    Chip8Env* env = map_region(shm_name, 0, false);
+    if (env == NULL) { return NULL; }
+
+    Chip8EnvHeader expected;
+    memset(&expected, 0, sizeof(expected));
+    describe_layout(&expected, env->header->count);
+    if (env->region_bytes < expected.region_bytes || !same_layout(env->header, &expected))
+    {
+        printf("CHIP8: %s was not created by this build of chip8_env\n", shm_name);
+        chip8_env_destroy(env);
+        return NULL;
+    }
+    return env;
+}
+
+void chip8_env_destroy(Chip8Env* env)
+{
+    if (env == NULL) { return; }
+    munmap(env->header, env->region_bytes);
+    if (env->owner && env->name[0] != '\0') { shm_unlink(env->name); }
+    chip8_rom_close(env->rom);
+    free(env);
+}
+
+Chip8EnvHeader* chip8_env_header(Chip8Env* env)
+{
+    return env->header;
+}
+
+Chip8EnvInstance* chip8_env_instance(Chip8Env* env, uint32_t index)
+{
+    return (Chip8EnvInstance*) ((uint8_t*) env->header + env->header->instance_offset + (size_t) env->header->instance_stride * index);
+}
+
+void chip8_env_set_probe(Chip8Env* env, uint16_t address)
+{
+    env->header->probe_address = address & (SIZE_4KB - 1);
+}
+
+static void run_reset(Chip8Env* env, uint32_t seed)
+{
+    uint16_t probe = env->header->probe_address;
+    for (uint32_t index = 0; index < env->header->count; ++index)
+    {
+        Chip8EnvInstance* instance = chip8_env_instance(env, index);
+        chip8_rom_instantiate(env->rom, &instance->cpu);
+        chip8_seed(&instance->cpu, seed + index);
+        instance->action = 0;
+        instance->probe_value = instance->cpu.memory[probe];
+        instance->reward = 0;
+        instance->frames = 0;
+    }
+}
+
+static void run_step(Chip8Env* env, const uint16_t* actions, uint32_t frames)
+{
+    uint16_t probe = env->header->probe_address;
+    for (uint32_t index = 0; index < env->header->count; ++index)
+    {
+        Chip8EnvInstance* instance = chip8_env_instance(env, index);
+        CHIP8* cpu = &instance->cpu;
+        if (actions != NULL) { instance->action = actions[index]; }
+        for (int key = 0; key < 16; ++key)
+        {
+            cpu->keypad[key] = (instance->action >> key) & 1;
+        }
+
+        uint8_t before = cpu->memory[probe];
+        for (uint32_t frame = 0; frame < frames; ++frame)
+        {
+            // idle machines (waiting for a key or the delay timer) jump straight to the next tick
+            chip8_run_frame(cpu);
+        }
+        instance->probe_value = cpu->memory[probe];
+        instance->reward = (int32_t) instance->probe_value - (int32_t) before;
+        instance->frames += frames;
+    }
+    env->header->steps++;
+}
+
+// driver side: hands one call to the creator's chip8_env_serve and waits for it
+static void call(Chip8Env* env, uint32_t command, uint32_t frames, uint32_t seed)
+{
+    Chip8EnvHeader* header = env->header;
+    header->command = command;
+    header->frames = frames;
+    header->seed = seed;
+    uint32_t request = atomic_load_explicit(&header->request, memory_order_relaxed) + 1;
+    atomic_store_explicit(&header->request, request, memory_order_release);
+
+    uint32_t waits = 0;
+    while (atomic_load_explicit(&header->completed, memory_order_acquire) != request)
+    {
+        backoff(&waits);
+    }
+}
+
+void chip8_env_reset(Chip8Env* env, uint32_t seed)
+{
+    if (env->owner) { run_reset(env, seed); }
+    else { call(env, CHIP8_ENV_RESET, 0, seed); }
+}
+
+void chip8_env_step(Chip8Env* env, const uint16_t* actions, uint32_t frames)
+{
+    if (env->owner)
+    {
+        run_step(env, actions, frames);
+        return;
+    }
+    // the actions go into the slots, where the creator reads them
+    for (uint32_t index = 0; actions != NULL && index < env->header->count; ++index)
+    {
+        chip8_env_instance(env, index)->action = actions[index];
+    }
+    call(env, CHIP8_ENV_STEP, frames, 0);
+}
+
+void chip8_env_serve(Chip8Env* env)
+{
+    Chip8EnvHeader* header = env->header;
+    for (;;)
+    {
+        uint32_t waits = 0;
+        uint32_t request;
+        while ((request = atomic_load_explicit(&header->request, memory_order_acquire)) ==
+               atomic_load_explicit(&header->completed, memory_order_relaxed))
+        {
+            backoff(&waits);
+        }
+
+        uint32_t command = header->command;
+        if (command == CHIP8_ENV_STEP) { run_step(env, NULL, header->frames); }
+        else if (command == CHIP8_ENV_RESET) { run_reset(env, header->seed); }
+        atomic_store_explicit(&header->completed, request, memory_order_release);
+        if (command == CHIP8_ENV_QUIT) { return; }
+    }
+}
+
+void chip8_env_quit(Chip8Env* env)
+{
+    if (!env->owner) { call(env, CHIP8_ENV_QUIT, 0, 0); }
+}
@@ -0,0 +1,105 @@
+#ifndef CHIP8_ENV_H
+#define CHIP8_ENV_H
+
+#include "chip8.h"
+
+#include <stdatomic.h>
+
+/*
+ *  Vectorized environment for agents: count instances of one ROM laid out
+ *  in a single shared-memory region. Every instance's CHIP8 lives in the
+ *  region itself, so the interpreter writes the framebuffer and registers
+ *  in place and a reader in another process sees them with no copy.
+ *
+ *  Region: a Chip8EnvHeader at offset 0, then count Chip8EnvInstance slots
+ *  starting at instance_offset, instance_stride bytes apart. The header
+ *  lists the offset of every field inside a slot, so a reader in any
+ *  language (numpy over the mapping, say) needs no C headers.
+ *
+ *  The process that creates the region runs the machines. Another process
+ *  drives it through the header: write the actions, command and frames,
+ *  increment request, then wait until completed == request.
+ *  chip8_env_attach / chip8_env_step / chip8_env_reset do exactly that from C.
+ *
+ *  Each env runs on one thread; run one env per core to use them all.
+ */
+
+#define CHIP8_ENV_MAGIC 0x56453843u  // "C8EV"
+#define CHIP8_ENV_VERSION 1
+
+// Chip8EnvHeader.command
+#define CHIP8_ENV_STEP  1  // every instance runs `frames` frames holding its action
+#define CHIP8_ENV_RESET 2  // every instance goes back to the loaded ROM, instance k seeded with seed + k
+#define CHIP8_ENV_QUIT  3  // chip8_env_serve returns
+
+typedef struct
+{
+    uint32_t magic;             // CHIP8_ENV_MAGIC
+    uint32_t version;           // CHIP8_ENV_VERSION
+    uint32_t count;             // instances
+    uint32_t reserved0;
+    uint64_t region_bytes;
+
+    // the layout, the same for every region one build creates
+    uint32_t instance_offset;   // bytes from the start of the region to instance 0
+    uint32_t instance_stride;   // bytes from one instance to the next
+
+    // where the fields are inside an instance
+    uint32_t action_offset;       // uint16_t keypad mask, bit k = key k
+    uint32_t probe_value_offset;  // uint8_t
+    uint32_t reward_offset;       // int32_t
+    uint32_t frames_offset;       // uint64_t
+    uint32_t display_offset;      // 32 x uint64_t rows, bit 63 is x = 0
+    uint32_t registers_offset;    // V0..VF, uint8_t each
+    uint32_t i_offset;            // uint16_t
+    uint32_t pc_offset;           // uint16_t
+    uint32_t memory_offset;       // 4096 x uint8_t
+
+    uint16_t probe_address;     // the reward probe, memory[probe_address] of every instance
+    uint16_t reserved1;
+
+    // the next call, written by the driver before it increments request
+    uint32_t command;           // CHIP8_ENV_*
+    uint32_t frames;            // CHIP8_ENV_STEP: frames per step
+    uint32_t seed;              // CHIP8_ENV_RESET
+    _Alignas(64) _Atomic uint32_t request;    // driver: one more than the last call
+    _Alignas(64) _Atomic uint32_t completed;  // emulator: the request it finished
+    uint64_t steps;             // steps run since the region was created
+} Chip8EnvHeader;
+
+typedef struct
+{
+    uint16_t action;       // keys held during the next step, written by the driver
+    uint8_t probe_value;   // memory[probe_address] after the last step or reset
+    uint8_t reserved;
+    int32_t reward;        // probe_value after the last step minus before it, 0 after a reset
+    uint64_t frames;       // frames run since the last reset
+    _Alignas(64) CHIP8 cpu;  // the machine itself, updated in place
+} Chip8EnvInstance;
+
+typedef struct Chip8Env Chip8Env;
+
+// loads the ROM into count instances in a new region: a POSIX shared memory object named
+// shm_name ("/chip8-env"), replaced if it exists, or private anonymous memory for NULL;
+// NULL if the ROM or the memory could not be had
+Chip8Env* chip8_env_create(const char* rom_path, uint32_t count, const char* shm_name);
+// maps a region another process created, to drive it; NULL if it is missing or from another layout
+Chip8Env* chip8_env_attach(const char* shm_name);
+// unmaps, and the creator also removes the shared memory object
+void chip8_env_destroy(Chip8Env* env);
+
+Chip8EnvHeader* chip8_env_header(Chip8Env* env);
+Chip8EnvInstance* chip8_env_instance(Chip8Env* env, uint32_t index);
+// the reward probe for every instance, takes effect at the next step or reset
+void chip8_env_set_probe(Chip8Env* env, uint16_t address);
+
+// instance k back to the freshly loaded ROM with chip8_seed(seed + k)
+void chip8_env_reset(Chip8Env* env, uint32_t seed);
+// instance k holds actions[k] (NULL: the action already in its slot) for frames frames,
+// then its probe and reward are updated; attached envs have the creator run it
+void chip8_env_step(Chip8Env* env, const uint16_t* actions, uint32_t frames);
+// creator side: runs the calls attached drivers make until one sends CHIP8_ENV_QUIT
+void chip8_env_serve(Chip8Env* env);
+// driver side: asks the creator's chip8_env_serve to return
+void chip8_env_quit(Chip8Env* env);
+#endif
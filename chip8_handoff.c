@@ -0,0 +1,69 @@
+#include "chip8_handoff.h"
+
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+void chip8_triple_init(Chip8TripleBuffer* buffer)
+{
+    buffer->back = 0;
+    atomic_init(&buffer->middle, 1);
+    buffer->front = 2;
+}
+
+bool chip8_triple_publish(Chip8TripleBuffer* buffer)
+{
+    // release: the slot's contents are visible before the reader can swap it in
+    unsigned previous = atomic_exchange_explicit(&buffer->middle, buffer->back | CHIP8_TRIPLE_FRESH, memory_order_acq_rel);
+    buffer->back = previous & ~CHIP8_TRIPLE_FRESH;
+    return (previous & CHIP8_TRIPLE_FRESH) == 0;
+}
+
+unsigned chip8_triple_acquire(Chip8TripleBuffer* buffer, bool* fresh)
+{
+    *fresh = (atomic_load_explicit(&buffer->middle, memory_order_relaxed) & CHIP8_TRIPLE_FRESH) != 0;
+    if (*fresh)
+    {
+        unsigned latest = atomic_exchange_explicit(&buffer->middle, buffer->front, memory_order_acq_rel);
+        buffer->front = latest & ~CHIP8_TRIPLE_FRESH;
+    }
+    return buffer->front;
+}
+
+void chip8_input_init(Chip8InputQueue* queue)
+{
+    atomic_init(&queue->head, 0);
+    atomic_init(&queue->tail, 0);
+}
+
+bool chip8_input_push(Chip8InputQueue* queue, uint32_t type, uint32_t value)
+{
+    // the counters run freely and wrap, only their difference matters
+    unsigned tail = atomic_load_explicit(&queue->tail, memory_order_relaxed);
+    unsigned head = atomic_load_explicit(&queue->head, memory_order_acquire);
+    if (tail - head == CHIP8_INPUT_QUEUE_SIZE) { return false; }
+
+    Chip8Input* input = &queue->items[tail & (CHIP8_INPUT_QUEUE_SIZE - 1)];
+    input->type = type;
+    input->value = value;
+    atomic_store_explicit(&queue->tail, tail + 1, memory_order_release);
+    return true;
+}
+
+bool chip8_input_pop(Chip8InputQueue* queue, Chip8Input* input)
+{
+    unsigned head = atomic_load_explicit(&queue->head, memory_order_relaxed);
+    unsigned tail = atomic_load_explicit(&queue->tail, memory_order_acquire);
+    if (head == tail) { return false; }
+
+    *input = queue->items[head & (CHIP8_INPUT_QUEUE_SIZE - 1)];
+    atomic_store_explicit(&queue->head, head + 1, memory_order_release);
+    return true;
+}
+
+bool chip8_input_apply(CHIP8* cpu, const Chip8Input* input)
+{
+    if (input->type != CHIP8_INPUT_KEY_DOWN && input->type != CHIP8_INPUT_KEY_UP) { return false; }
+    if (input->value < 16) { cpu->keypad[input->value] = (input->type == CHIP8_INPUT_KEY_DOWN); }
+    return true;
+}
@@ -0,0 +1,63 @@
+#ifndef CHIP8_HANDOFF_H
+#define CHIP8_HANDOFF_H
+
+#include "chip8.h"
+
+#include <stdatomic.h>
+
+/*
+ *  Lock-free handoff between an emulation thread and the thread that shows
+ *  its frames and reads its input. Frames go one way through a triple
+ *  buffer, input goes the other way through a single-producer
+ *  single-consumer queue. Neither side ever waits for the other.
+ */
+
+// three slots of the caller's own type: the writer fills slot `back`, the reader shows slot `front`,
+// the third holds the latest published frame until one of them swaps it out
+typedef struct
+{
+    atomic_uint middle;  // slot index, plus CHIP8_TRIPLE_FRESH while the reader has not taken it
+    unsigned back;       // writer only
+    unsigned front;      // reader only
+} Chip8TripleBuffer;
+
+#define CHIP8_TRIPLE_FRESH 4u
+
+void chip8_triple_init(Chip8TripleBuffer* buffer);
+// the slot the writer may fill
+static inline unsigned chip8_triple_back(const Chip8TripleBuffer* buffer) { return buffer->back; }
+// makes the back slot the latest frame, true if the reader had taken the one before
+// (so a reader that sleeps between frames needs waking up)
+bool chip8_triple_publish(Chip8TripleBuffer* buffer);
+// the slot the reader may show, swapped for the latest frame first if there is one; *fresh says which
+unsigned chip8_triple_acquire(Chip8TripleBuffer* buffer, bool* fresh);
+
+// CHIP8_INPUT_KEY_* are keypad changes, types from CHIP8_INPUT_USER up mean whatever the two threads agree on
+#define CHIP8_INPUT_KEY_DOWN 0
+#define CHIP8_INPUT_KEY_UP 1
+#define CHIP8_INPUT_USER 16
+
+typedef struct
+{
+    uint32_t type;
+    uint32_t value;  // the key for CHIP8_INPUT_KEY_*
+} Chip8Input;
+
+// a power of two, far more than one frame of input
+#define CHIP8_INPUT_QUEUE_SIZE 256
+
+typedef struct
+{
+    Chip8Input items[CHIP8_INPUT_QUEUE_SIZE];
+    atomic_uint head;  // next item to pop, written by the consumer
+    atomic_uint tail;  // next free item, written by the producer
+} Chip8InputQueue;
+
+void chip8_input_init(Chip8InputQueue* queue);
+// producer side, false if the queue is full
+bool chip8_input_push(Chip8InputQueue* queue, uint32_t type, uint32_t value);
+// consumer side, false if the queue is empty
+bool chip8_input_pop(Chip8InputQueue* queue, Chip8Input* input);
+// applies a CHIP8_INPUT_KEY_* to the keypad, false for any other type
+bool chip8_input_apply(CHIP8* cpu, const Chip8Input* input);
+#endif
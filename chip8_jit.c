@@ -0,0 +1,838 @@
+#include "chip8_jit.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if CHIP8_HAS_JIT
+
+#include <sys/mman.h>
+
+#define CODE_BUFFER_SIZE (4 * 1024 * 1024)
+#define MAX_BLOCK_INSTRUCTIONS 64
+#define MAX_BLOCK_BYTES 8192  // worst case for one translated block, checked before translating
+
+// host registers, numbered as in the ModRM encoding
+enum { RAX, RCX, RDX, RBX, RSP, RBP, RSI, RDI, R8, R9, R10, R11, R12, R13, R14, R15 };
+
+// x86 condition codes used by the translator
+#define CC_AE 0x3
+#define CC_E  0x4
+#define CC_NE 0x5
+#define CC_A  0x7
+
+// guest registers: V0..VF are 0..15, the index register I is 16
+#define GUEST_I 16
+#define GUEST_COUNT 17
+
+// host registers a block may pin guest registers to, caller-saved first so
+// short blocks need no push/pop. RDI holds the CHIP8 pointer, ESI the cycle
+// budget, RAX/RCX are scratch.
+static const uint8_t allocatable[] = { R8, R9, R10, R11, RDX, RBX, RBP, R12, R13, R14, R15 };
+#define ALLOCATABLE_COUNT ((int) (sizeof(allocatable) / sizeof(allocatable[0])))
+
+#define OFFSET_V     ((int32_t) offsetof(CHIP8, v))
+#define OFFSET_I     ((int32_t) offsetof(CHIP8, i))
+#define OFFSET_PC    ((int32_t) offsetof(CHIP8, pc))
+#define OFFSET_STACK ((int32_t) offsetof(CHIP8, stack))
+#define OFFSET_SP    ((int32_t) offsetof(CHIP8, stack_pointer))
+#define OFFSET_DELAY ((int32_t) offsetof(CHIP8, delay))
+#define OFFSET_SOUND ((int32_t) offsetof(CHIP8, sound_timer))
+
+// runs at most cycles instructions of the block and returns the cycles left
+typedef uint32_t (*BlockFunction)(CHIP8* cpu, uint32_t cycles);
+
+typedef struct
+{
+    BlockFunction code;   // NULL when this address runs on the interpreter
+    uint64_t pages;       // pages holding the bytes the block was translated from
+    uint16_t length;      // instructions in the block, a call stops early when its budget runs out
+    bool translated;      // false until the address has been looked at
+} JitBlock;
+
+struct Chip8Jit
+{
+    uint8_t* code_buffer;
+    size_t code_used;
+    uint64_t code_pages;  // union of the pages of every live block
+    uint8_t quirks;       // CHIP8_QUIRKS_* profile the blocks were translated for
+    JitBlock blocks[SIZE_4KB];
+};
+
+/*
+ *  x86-64 emitter, only the handful of encodings the translator needs.
+ *  Register operands are 32 bits wide, memory operands are [rdi + disp32].
+ */
+
+typedef struct
+{
+    uint8_t* at;
+} Emitter;
+
+static void emit8(Emitter* e, uint8_t byte) { *e->at++ = byte; }
+static void emit16(Emitter* e, uint16_t value) { memcpy(e->at, &value, 2); e->at += 2; }
+static void emit32(Emitter* e, uint32_t value) { memcpy(e->at, &value, 4); e->at += 4; }
+
+static void emit_rex(Emitter* e, int reg, int rm, bool force)
+{
+    uint8_t rex = 0x40 | ((reg >> 3) << 2) | (rm >> 3);
+    // byte access to sil/dil/bpl needs a REX prefix even when no bit is set
+    if (rex != 0x40 || force) { emit8(e, rex); }
+}
+
+// ModRM for [rdi + disp32]
+static void emit_cpu_operand(Emitter* e, int reg, int32_t disp)
+{
+    emit8(e, 0x80 | ((reg & 7) << 3) | RDI);
+    emit32(e, (uint32_t) disp);
+}
+
+// <op> dst, src for the 01/09/21/29/31/39/89 family
+static void emit_alu_rr(Emitter* e, uint8_t opcode, int dst, int src)
+{
+    emit_rex(e, src, dst, false);
+    emit8(e, opcode);
+    emit8(e, 0xC0 | ((src & 7) << 3) | (dst & 7));
+}
+
+#define ALU_ADD 0x01
+#define ALU_OR  0x09
+#define ALU_AND 0x21
+#define ALU_SUB 0x29
+#define ALU_XOR 0x31
+#define ALU_CMP 0x39
+#define ALU_MOV 0x89
+
+// <op> dst, imm32 through 81 /ext
+static void emit_alu_ri(Emitter* e, int ext, int dst, uint32_t imm)
+{
+    emit_rex(e, 0, dst, false);
+    emit8(e, 0x81);
+    emit8(e, 0xC0 | (ext << 3) | (dst & 7));
+    emit32(e, imm);
+}
+
+#define EXT_ADD 0
+#define EXT_AND 4
+#define EXT_CMP 7
+
+static void emit_mov_ri(Emitter* e, int dst, uint32_t imm)
+{
+    emit_rex(e, 0, dst, false);
+    emit8(e, 0xB8 + (dst & 7));
+    emit32(e, imm);
+}
+
+#define EXT_SHL 4
+#define EXT_SHR 5
+
+static void emit_shift(Emitter* e, int ext, int dst, uint8_t amount)
+{
+    emit_rex(e, 0, dst, false);
+    if (amount == 1)
+    {
+        emit8(e, 0xD1);
+        emit8(e, 0xC0 | (ext << 3) | (dst & 7));
+    }
+    else
+    {
+        emit8(e, 0xC1);
+        emit8(e, 0xC0 | (ext << 3) | (dst & 7));
+        emit8(e, amount);
+    }
+}
+
+static void emit_movzx_byte(Emitter* e, int dst, int32_t disp)
+{
+    emit_rex(e, dst, RDI, false);
+    emit8(e, 0x0F);
+    emit8(e, 0xB6);
+    emit_cpu_operand(e, dst, disp);
+}
+
+static void emit_movzx_word(Emitter* e, int dst, int32_t disp)
+{
+    emit_rex(e, dst, RDI, false);
+    emit8(e, 0x0F);
+    emit8(e, 0xB7);
+    emit_cpu_operand(e, dst, disp);
+}
+
+static void emit_store_byte(Emitter* e, int32_t disp, int src)
+{
+    emit_rex(e, src, RDI, true);
+    emit8(e, 0x88);
+    emit_cpu_operand(e, src, disp);
+}
+
+static void emit_store_word(Emitter* e, int32_t disp, int src)
+{
+    emit8(e, 0x66);
+    emit_rex(e, src, RDI, false);
+    emit8(e, 0x89);
+    emit_cpu_operand(e, src, disp);
+}
+
+static void emit_store_word_imm(Emitter* e, int32_t disp, uint16_t imm)
+{
+    emit8(e, 0x66);
+    emit8(e, 0xC7);
+    emit_cpu_operand(e, 0, disp);
+    emit16(e, imm);
+}
+
+static void emit_setcc_cl(Emitter* e, int cc)
+{
+    emit8(e, 0x0F);
+    emit8(e, 0x90 | cc);
+    emit8(e, 0xC0 | RCX);
+}
+
+static void emit_cmov(Emitter* e, int cc, int dst, int src)
+{
+    emit_rex(e, dst, src, false);
+    emit8(e, 0x0F);
+    emit8(e, 0x40 | cc);
+    emit8(e, 0xC0 | ((dst & 7) << 3) | (src & 7));
+}
+
+static void emit_dec(Emitter* e, int reg)
+{
+    emit_rex(e, 0, reg, false);
+    emit8(e, 0xFF);
+    emit8(e, 0xC0 | (1 << 3) | (reg & 7));
+}
+
+// jcc rel32, returns where the displacement goes so it can be patched
+static uint8_t* emit_jcc(Emitter* e, int cc)
+{
+    emit8(e, 0x0F);
+    emit8(e, 0x80 | cc);
+    uint8_t* displacement = e->at;
+    emit32(e, 0);
+    return displacement;
+}
+
+static void emit_jmp(Emitter* e, const uint8_t* target)
+{
+    emit8(e, 0xE9);
+    emit32(e, (uint32_t) (target - (e->at + 4)));
+}
+
+static void patch_rel32(uint8_t* displacement, const uint8_t* target)
+{
+    uint32_t value = (uint32_t) (target - (displacement + 4));
+    memcpy(displacement, &value, 4);
+}
+
+static void emit_push(Emitter* e, int reg)
+{
+    if (reg >= 8) { emit8(e, 0x41); }
+    emit8(e, 0x50 + (reg & 7));
+}
+
+static void emit_pop(Emitter* e, int reg)
+{
+    if (reg >= 8) { emit8(e, 0x41); }
+    emit8(e, 0x58 + (reg & 7));
+}
+
+/*
+ *  Translation
+ */
+
+static bool is_callee_saved(int reg)
+{
+    return reg == RBX || reg == RBP || reg >= R12;
+}
+
+// straight-line instructions that only touch registers and timers
+static bool is_straight_line(uint8_t op)
+{
+    switch (op)
+    {
+        case EXEC_NOP:
+        case EXEC_LOAD_X_BYTE:
+        case EXEC_ADD_X_BYTE:
+        case EXEC_LOAD_X_Y:
+        case EXEC_OR_X_Y:
+        case EXEC_AND_X_Y:
+        case EXEC_XOR_X_Y:
+        case EXEC_ADD_X_Y:
+        case EXEC_SUB_X_Y:
+        case EXEC_SHR_X:
+        case EXEC_SUBN_X_Y:
+        case EXEC_SHL_X:
+        case EXEC_LOAD_I_ADDR:
+        case EXEC_ADD_I_X:
+        case EXEC_LOAD_F_X:
+        case EXEC_LOAD_X_DT:
+        case EXEC_SET_DT_X:
+        case EXEC_SET_ST_X:
+            return true;
+    }
+    return false;
+}
+
+// control flow the translator handles itself, always the last instruction of a block
+static bool is_terminator(uint8_t op)
+{
+    switch (op)
+    {
+        case EXEC_JUMP:
+        case EXEC_CALL:
+        case EXEC_RET:
+        case EXEC_SKIP_X_EQ_BYTE:
+        case EXEC_SKIP_X_NE_BYTE:
+        case EXEC_SKIP_X_EQ_Y:
+        case EXEC_SKIP_X_NE_Y:
+        case EXEC_JUMP_V0_ADDR:
+            return true;
+    }
+    return false;
+}
+
+#define GUEST_BIT(guest) (1u << (guest))
+
+// guest registers read or written by an instruction, flags are the CHIP8_QUIRK_* of the profile
+static uint32_t guest_registers(const Instruction* instruction, uint8_t flags)
+{
+    uint32_t x = GUEST_BIT(instruction->x);
+    uint32_t y = GUEST_BIT(instruction->y);
+    uint32_t vf = GUEST_BIT(REGISTER_VF);
+    uint32_t index = GUEST_BIT(GUEST_I);
+
+    switch (instruction->op)
+    {
+        case EXEC_LOAD_X_BYTE:
+        case EXEC_ADD_X_BYTE:
+        case EXEC_LOAD_X_DT:
+        case EXEC_SET_DT_X:
+        case EXEC_SET_ST_X:
+        case EXEC_SKIP_X_EQ_BYTE:
+        case EXEC_SKIP_X_NE_BYTE:
+            return x;
+        case EXEC_LOAD_X_Y:
+        case EXEC_SKIP_X_EQ_Y:
+        case EXEC_SKIP_X_NE_Y:
+            return x | y;
+        case EXEC_OR_X_Y:
+        case EXEC_AND_X_Y:
+        case EXEC_XOR_X_Y:
+        case EXEC_ADD_X_Y:
+        case EXEC_SUB_X_Y:
+        case EXEC_SUBN_X_Y:
+            return x | y | vf;
+        case EXEC_SHR_X:
+        case EXEC_SHL_X:
+            return x | vf | ((flags & CHIP8_QUIRK_SHIFT_VY) ? y : 0);
+        case EXEC_LOAD_I_ADDR:
+            return index;
+        case EXEC_ADD_I_X:
+        case EXEC_LOAD_F_X:
+            return index | x;
+        case EXEC_JUMP_V0_ADDR:
+            return (flags & CHIP8_QUIRK_JUMP_VX) ? x : GUEST_BIT(0);
+    }
+    return 0;
+}
+
+// guest registers an instruction writes, so only those are stored back
+static uint32_t guest_writes(const Instruction* instruction, uint8_t flags)
+{
+    uint32_t x = GUEST_BIT(instruction->x);
+    uint32_t vf = GUEST_BIT(REGISTER_VF);
+
+    switch (instruction->op)
+    {
+        case EXEC_LOAD_X_BYTE:
+        case EXEC_ADD_X_BYTE:
+        case EXEC_LOAD_X_DT:
+        case EXEC_LOAD_X_Y:
+            return x;
+        case EXEC_OR_X_Y:
+        case EXEC_AND_X_Y:
+        case EXEC_XOR_X_Y:
+            return x | ((flags & CHIP8_QUIRK_VF_RESET) ? vf : 0);
+        case EXEC_ADD_X_Y:
+        case EXEC_SUB_X_Y:
+        case EXEC_SUBN_X_Y:
+        case EXEC_SHR_X:
+        case EXEC_SHL_X:
+            return x | vf;
+        case EXEC_LOAD_I_ADDR:
+        case EXEC_ADD_I_X:
+        case EXEC_LOAD_F_X:
+            return GUEST_BIT(GUEST_I);
+    }
+    return 0;
+}
+
+static int popcount(uint32_t bits)
+{
+    int count = 0;
+    for (; bits != 0; bits &= bits - 1) { count++; }
+    return count;
+}
+
+static uint64_t instruction_pages(uint16_t address)
+{
+    return (1ull << (address >> PAGE_SHIFT)) | (1ull << (((address + 1) & (SIZE_4KB - 1)) >> PAGE_SHIFT));
+}
+
+// a straight-line instruction, guest values live in host registers
+static void translate_instruction(Emitter* e, const Instruction* instruction, const int8_t* host, uint8_t flags)
+{
+    int x = host[instruction->x];
+    int y = host[instruction->y];
+    int vf = host[REGISTER_VF];
+    int index = host[GUEST_I];
+
+    switch (instruction->op)
+    {
+        case EXEC_NOP:
+            break;
+        case EXEC_LOAD_X_BYTE:
+            emit_mov_ri(e, x, instruction->nn);
+            break;
+        case EXEC_ADD_X_BYTE:
+            emit_alu_ri(e, EXT_ADD, x, instruction->nn);
+            emit_alu_ri(e, EXT_AND, x, 0xFF);
+            break;
+        case EXEC_LOAD_X_Y:
+            emit_alu_rr(e, ALU_MOV, x, y);
+            break;
+        case EXEC_OR_X_Y:
+        case EXEC_AND_X_Y:
+        case EXEC_XOR_X_Y:
+        {
+            uint8_t opcode = (instruction->op == EXEC_OR_X_Y) ? ALU_OR : (instruction->op == EXEC_AND_X_Y) ? ALU_AND : ALU_XOR;
+            emit_alu_rr(e, opcode, x, y);
+            if (flags & CHIP8_QUIRK_VF_RESET) { emit_mov_ri(e, vf, 0); }
+            break;
+        }
+        case EXEC_ADD_X_Y:
+            // Vx = (Vx + Vy) & 0xFF, then VF = carry
+            emit_alu_rr(e, ALU_MOV, RAX, x);
+            emit_alu_rr(e, ALU_ADD, RAX, y);
+            emit_alu_rr(e, ALU_MOV, x, RAX);
+            emit_alu_ri(e, EXT_AND, x, 0xFF);
+            emit_shift(e, EXT_SHR, RAX, 8);
+            emit_alu_rr(e, ALU_MOV, vf, RAX);
+            break;
+        case EXEC_SUB_X_Y:
+            // not borrow is taken before Vx changes, VF is written last
+            emit_alu_rr(e, ALU_XOR, RCX, RCX);
+            emit_alu_rr(e, ALU_MOV, RAX, x);
+            emit_alu_rr(e, ALU_CMP, RAX, y);
+            emit_setcc_cl(e, CC_AE);
+            emit_alu_rr(e, ALU_SUB, RAX, y);
+            emit_alu_ri(e, EXT_AND, RAX, 0xFF);
+            emit_alu_rr(e, ALU_MOV, x, RAX);
+            emit_alu_rr(e, ALU_MOV, vf, RCX);
+            break;
+        case EXEC_SHR_X:
+            if (flags & CHIP8_QUIRK_SHIFT_VY)
+            {
+                // Vx = Vy >> 1 and VF = Vy & 1, VF is written last like the interpreter
+                emit_alu_rr(e, ALU_MOV, RAX, y);
+                emit_alu_rr(e, ALU_MOV, RCX, RAX);
+                emit_alu_ri(e, EXT_AND, RCX, 1);
+                emit_shift(e, EXT_SHR, RAX, 1);
+                emit_alu_rr(e, ALU_MOV, x, RAX);
+                emit_alu_rr(e, ALU_MOV, vf, RCX);
+                break;
+            }
+            // VF is written first, like the interpreter, so x == F shifts the flag
+            emit_alu_rr(e, ALU_MOV, RAX, x);
+            emit_alu_ri(e, EXT_AND, RAX, 1);
+            emit_alu_rr(e, ALU_MOV, vf, RAX);
+            emit_shift(e, EXT_SHR, x, 1);
+            break;
+        case EXEC_SUBN_X_Y:
+            emit_alu_rr(e, ALU_XOR, RCX, RCX);
+            emit_alu_rr(e, ALU_MOV, RAX, y);
+            emit_alu_rr(e, ALU_CMP, RAX, x);
+            emit_setcc_cl(e, CC_AE);
+            emit_alu_rr(e, ALU_MOV, vf, RCX);
+            emit_alu_rr(e, ALU_MOV, RAX, y);
+            emit_alu_rr(e, ALU_SUB, RAX, x);
+            emit_alu_ri(e, EXT_AND, RAX, 0xFF);
+            emit_alu_rr(e, ALU_MOV, x, RAX);
+            break;
+        case EXEC_SHL_X:
+            if (flags & CHIP8_QUIRK_SHIFT_VY)
+            {
+                emit_alu_rr(e, ALU_MOV, RAX, y);
+                emit_alu_rr(e, ALU_MOV, RCX, RAX);
+                emit_shift(e, EXT_SHR, RCX, 7);
+                emit_shift(e, EXT_SHL, RAX, 1);
+                emit_alu_ri(e, EXT_AND, RAX, 0xFF);
+                emit_alu_rr(e, ALU_MOV, x, RAX);
+                emit_alu_rr(e, ALU_MOV, vf, RCX);
+                break;
+            }
+            emit_alu_rr(e, ALU_MOV, RAX, x);
+            emit_shift(e, EXT_SHR, RAX, 7);
+            emit_alu_rr(e, ALU_MOV, vf, RAX);
+            emit_shift(e, EXT_SHL, x, 1);
+            emit_alu_ri(e, EXT_AND, x, 0xFF);
+            break;
+        case EXEC_LOAD_I_ADDR:
+            emit_mov_ri(e, index, instruction->nnn);
+            break;
+        case EXEC_ADD_I_X:
+            emit_alu_rr(e, ALU_ADD, index, x);
+            emit_alu_ri(e, EXT_AND, index, 0xFFFF);
+            break;
+        case EXEC_LOAD_F_X:
+            // I = FONTSET_STARTPOINT + Vx * 5
+            emit_alu_rr(e, ALU_MOV, RAX, x);
+            emit8(e, 0x8D); emit8(e, 0x04); emit8(e, 0x80); // lea eax, [rax + rax * 4]
+            emit_alu_ri(e, EXT_ADD, RAX, FONTSET_STARTPOINT);
+            emit_alu_rr(e, ALU_MOV, index, RAX);
+            break;
+        case EXEC_LOAD_X_DT:
+            emit_movzx_byte(e, x, OFFSET_DELAY);
+            break;
+        case EXEC_SET_DT_X:
+            emit_store_byte(e, OFFSET_DELAY, x);
+            break;
+        case EXEC_SET_ST_X:
+            emit_store_byte(e, OFFSET_SOUND, x);
+            break;
+    }
+}
+
+// writes pc = address + 2 or address + 4 depending on a flag set by a compare
+static void translate_skip(Emitter* e, int cc, uint16_t address)
+{
+    emit_mov_ri(e, RCX, (uint16_t) (address + 2));
+    emit_mov_ri(e, RAX, (uint16_t) (address + 4));
+    emit_cmov(e, cc, RCX, RAX);
+    emit_store_word(e, OFFSET_PC, RCX);
+}
+
+// the block's last instruction, guest registers are already stored back
+static void translate_terminator(Emitter* e, const Instruction* instruction, const int8_t* host, uint16_t address, uint8_t flags)
+{
+    switch (instruction->op)
+    {
+        case EXEC_JUMP:
+            emit_store_word_imm(e, OFFSET_PC, instruction->nnn);
+            break;
+        case EXEC_JUMP_V0_ADDR:
+            emit_alu_rr(e, ALU_MOV, RAX, host[(flags & CHIP8_QUIRK_JUMP_VX) ? instruction->x : 0]);
+            emit_alu_ri(e, EXT_ADD, RAX, instruction->nnn);
+            emit_store_word(e, OFFSET_PC, RAX);
+            break;
+        case EXEC_CALL:
+        {
+            // stack overflow: stay on this instruction, like the interpreter
+            emit8(e, 0x80); emit_cpu_operand(e, 7, OFFSET_SP); emit8(e, 15); // cmp byte [sp], 15
+            emit8(e, 0x70 | CC_A);
+            uint8_t* overflow = e->at;
+            emit8(e, 0);
+            emit_movzx_byte(e, RAX, OFFSET_SP);
+            // mov word [rdi + rax * 2 + stack], address + 2
+            emit8(e, 0x66); emit8(e, 0xC7); emit8(e, 0x84); emit8(e, 0x47);
+            emit32(e, (uint32_t) OFFSET_STACK);
+            emit16(e, (uint16_t) (address + 2));
+            emit8(e, 0xFE); emit_cpu_operand(e, 0, OFFSET_SP); // inc byte [sp]
+            emit_store_word_imm(e, OFFSET_PC, instruction->nnn);
+            emit8(e, 0xEB);
+            uint8_t* done = e->at;
+            emit8(e, 0);
+            *overflow = (uint8_t) (e->at - overflow - 1);
+            emit_store_word_imm(e, OFFSET_PC, address);
+            *done = (uint8_t) (e->at - done - 1);
+            break;
+        }
+        case EXEC_RET:
+            emit8(e, 0xFE); emit_cpu_operand(e, 1, OFFSET_SP); // dec byte [sp]
+            emit_movzx_byte(e, RAX, OFFSET_SP);
+            emit_alu_ri(e, EXT_AND, RAX, STACK_SIZE - 1);
+            // movzx eax, word [rdi + rax * 2 + stack]
+            emit8(e, 0x0F); emit8(e, 0xB7); emit8(e, 0x84); emit8(e, 0x47);
+            emit32(e, (uint32_t) OFFSET_STACK);
+            emit_store_word(e, OFFSET_PC, RAX);
+            break;
+        case EXEC_SKIP_X_EQ_BYTE:
+            emit_alu_ri(e, EXT_CMP, host[instruction->x], instruction->nn);
+            translate_skip(e, CC_E, address);
+            break;
+        case EXEC_SKIP_X_NE_BYTE:
+            emit_alu_ri(e, EXT_CMP, host[instruction->x], instruction->nn);
+            translate_skip(e, CC_NE, address);
+            break;
+        case EXEC_SKIP_X_EQ_Y:
+            emit_alu_rr(e, ALU_CMP, host[instruction->x], host[instruction->y]);
+            translate_skip(e, CC_E, address);
+            break;
+        case EXEC_SKIP_X_NE_Y:
+            emit_alu_rr(e, ALU_CMP, host[instruction->x], host[instruction->y]);
+            translate_skip(e, CC_NE, address);
+            break;
+    }
+}
+
+static void flush_all(Chip8Jit* jit)
+{
+    memset(jit->blocks, 0, sizeof(jit->blocks));
+    jit->code_used = 0;
+    jit->code_pages = 0;
+}
+
+static void translate(Chip8Jit* jit, const CHIP8* cpu, uint16_t start)
+{
+    if (jit->code_used + MAX_BLOCK_BYTES > CODE_BUFFER_SIZE)
+    {
+        flush_all(jit);
+    }
+
+    JitBlock* block = &jit->blocks[start];
+    block->translated = true;
+    block->code = NULL;
+    block->length = 0;
+    block->pages = instruction_pages(start);
+    uint8_t flags = chip8_quirk_flags(cpu->quirks);
+
+    // find the extent of the block and the guest registers it needs
+    uint32_t used = 0;
+    uint32_t written = 0;
+    uint16_t address = start;
+    const Instruction* terminator = NULL;
+    int length = 0;
+    uint64_t pages = 0;
+    while (length < MAX_BLOCK_INSTRUCTIONS && address < SIZE_4KB)
+    {
+        const Instruction* instruction = &cpu->decoded[address];
+        bool straight = is_straight_line(instruction->op);
+        if (!straight && !is_terminator(instruction->op)) { break; }
+        uint32_t needed = used | guest_registers(instruction, flags);
+        if (popcount(needed) > ALLOCATABLE_COUNT) { break; }
+
+        used = needed;
+        written |= guest_writes(instruction, flags);
+        pages |= instruction_pages(address);
+        length++;
+        if (!straight)
+        {
+            terminator = instruction;
+            break;
+        }
+        address += 2;
+    }
+    jit->code_pages |= block->pages;
+    if (length == 0) { return; }
+
+    // pin every guest register the block touches to its own host register
+    int8_t host[GUEST_COUNT];
+    uint8_t saved[ALLOCATABLE_COUNT];
+    int saved_count = 0;
+    int next_host = 0;
+    for (int guest = 0; guest < GUEST_COUNT; ++guest)
+    {
+        host[guest] = -1;
+        if ((used & GUEST_BIT(guest)) == 0) { continue; }
+        host[guest] = (int8_t) allocatable[next_host++];
+        if (is_callee_saved(host[guest])) { saved[saved_count++] = (uint8_t) host[guest]; }
+    }
+
+    Emitter emitter = { jit->code_buffer + jit->code_used };
+    Emitter* e = &emitter;
+    uint8_t* entry = e->at;
+
+    for (int k = 0; k < saved_count; ++k) { emit_push(e, saved[k]); }
+    for (int guest = 0; guest < GUEST_COUNT; ++guest)
+    {
+        if (host[guest] < 0) { continue; }
+        if (guest == GUEST_I) { emit_movzx_word(e, host[guest], OFFSET_I); }
+        else { emit_movzx_byte(e, host[guest], OFFSET_V + guest); }
+    }
+
+    // ESI counts the budget down before each instruction after the first (the
+    // caller never passes 0); when it runs out the block leaves through a stub
+    // that sets pc to the next instruction
+    int straight_count = (terminator != NULL) ? length - 1 : length;
+    uint8_t* exits[MAX_BLOCK_INSTRUCTIONS];
+    for (int k = 0; k < length; ++k)
+    {
+        if (k > 0)
+        {
+            emit_dec(e, RSI);
+            exits[k] = emit_jcc(e, CC_E);
+        }
+        if (k < straight_count) { translate_instruction(e, &cpu->decoded[start + k * 2], host, flags); }
+    }
+    emit_dec(e, RSI);
+
+    // the terminator picks the next pc from the host registers
+    if (terminator != NULL)
+    {
+        translate_terminator(e, terminator, host, start + straight_count * 2, flags);
+    }
+    else
+    {
+        emit_store_word_imm(e, OFFSET_PC, start + length * 2);
+    }
+
+    // every guest register was loaded on entry, so storing back the whole
+    // written set is right wherever the block stops
+    uint8_t* leave = e->at;
+    for (int guest = 0; guest < GUEST_COUNT; ++guest)
+    {
+        if ((written & GUEST_BIT(guest)) == 0) { continue; }
+        if (guest == GUEST_I) { emit_store_word(e, OFFSET_I, host[guest]); }
+        else { emit_store_byte(e, OFFSET_V + guest, host[guest]); }
+    }
+    for (int k = saved_count - 1; k >= 0; --k) { emit_pop(e, saved[k]); }
+    emit_alu_rr(e, ALU_MOV, RAX, RSI);
+    emit8(e, 0xC3); // ret
+
+    for (int k = 1; k < length; ++k)
+    {
+        patch_rel32(exits[k], e->at);
+        emit_store_word_imm(e, OFFSET_PC, start + k * 2);
+        emit_jmp(e, leave);
+    }
+
+    jit->code_used += (size_t) (e->at - entry);
+    block->code = (BlockFunction) (void*) entry;
+    block->length = (uint16_t) length;
+    block->pages = pages;
+    jit->code_pages |= pages;
+}
+
+// drops every block built from bytes in the given pages
+static void invalidate(Chip8Jit* jit, uint64_t written_pages)
+{
+    uint64_t live_pages = 0;
+    for (int address = 0; address < SIZE_4KB; ++address)
+    {
+        JitBlock* block = &jit->blocks[address];
+        if (!block->translated) { continue; }
+        if (block->pages & written_pages)
+        {
+            block->translated = false;
+            block->code = NULL;
+            continue;
+        }
+        live_pages |= block->pages;
+    }
+    jit->code_pages = live_pages;
+}
+
+Chip8Jit* chip8_jit_create(void)
+{
+    Chip8Jit* jit = calloc(1, sizeof(Chip8Jit));
+    if (jit == NULL) { return NULL; }
+
+    void* buffer = mmap(NULL, CODE_BUFFER_SIZE, PROT_READ | PROT_WRITE | PROT_EXEC, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (buffer == MAP_FAILED)
+    {
+        free(jit);
+        return NULL;
+    }
+    jit->code_buffer = buffer;
+    return jit;
+}
+
+void chip8_jit_destroy(Chip8Jit* jit)
+{
+    if (jit == NULL) { return; }
+    munmap(jit->code_buffer, CODE_BUFFER_SIZE);
+    free(jit);
+}
+
+// cycles that end at or before the next timer tick
+static void run_translated(Chip8Jit* jit, CHIP8* cpu, uint32_t cycles)
+{
+    while (cycles > 0)
+    {
+        // Fx33/Fx55 (or a reload) wrote memory since we last looked
+        if (cpu->written_pages != 0)
+        {
+            if (cpu->written_pages & jit->code_pages) { invalidate(jit, cpu->written_pages); }
+            cpu->written_pages = 0;
+        }
+
+        if (cpu->pc < SIZE_4KB)
+        {
+            JitBlock* block = &jit->blocks[cpu->pc];
+            if (!block->translated) { translate(jit, cpu, cpu->pc); }
+            if (block->code != NULL)
+            {
+                cycles = block->code(cpu, cycles);
+                continue;
+            }
+        }
+        chip8_cycle(cpu);
+        cycles--;
+    }
+}
+
+void chip8_jit_run_cycles(Chip8Jit* jit, CHIP8* cpu, uint32_t cycles)
+{
+    // VIP timing charges every instruction on its own
+    if (jit == NULL || cpu->timing == CHIP8_TIMING_VIP)
+    {
+        chip8_run_cycles(cpu, cycles);
+        return;
+    }
+#if CHIP8_PROFILE
+    // translated blocks have no counters, interpret so the profile sees every instruction
+    if (cpu->profile != NULL)
+    {
+        chip8_run_cycles(cpu, cycles);
+        return;
+    }
+#endif
+#if CHIP8_TRACE
+    // nor do they record, interpret so the trace has every instruction
+    if (cpu->trace != NULL)
+    {
+        chip8_run_cycles(cpu, cycles);
+        return;
+    }
+#endif
+
+    // blocks bake in the quirks they were translated with
+    if (cpu->quirks != jit->quirks)
+    {
+        flush_all(jit);
+        jit->quirks = cpu->quirks;
+    }
+
+    // the timers tick between batches, as in chip8_run_cycles
+    while (cycles > 0)
+    {
+        uint32_t batch = chip8_cycles_to_tick(cpu);
+        if (batch > cycles) { batch = cycles; }
+        run_translated(jit, cpu, batch);
+        chip8_advance_clock(cpu, batch);
+        cycles -= batch;
+    }
+}
+
+#else
+
+Chip8Jit* chip8_jit_create(void)
+{
+    return NULL;
+}
+
+void chip8_jit_destroy(Chip8Jit* jit)
+{
+    (void) jit;
+}
+
+void chip8_jit_run_cycles(Chip8Jit* jit, CHIP8* cpu, uint32_t cycles)
+{
+    (void) jit;
+    chip8_run_cycles(cpu, cycles);
+}
+
+#endif
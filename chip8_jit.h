@@ -0,0 +1,32 @@
+#ifndef CHIP8_JIT_H
+#define CHIP8_JIT_H
+
+#include "chip8.h"
+
+/*
+ *  Basic-block dynamic recompiler for x86-64.
+ *
+ *  Straight-line register instructions are translated to native code, a block
+ *  ends at jumps, calls, returns, skips, DXYN and Fx0A. Instructions that touch
+ *  the display, keypad, memory or rand() run on the interpreter between blocks.
+ *  Blocks are dropped when Fx33/Fx55 write into their bytes (cpu->written_pages).
+ *
+ *  A Chip8Jit belongs to a single CHIP8 instance. On other architectures
+ *  chip8_jit_create returns NULL and chip8_jit_run_cycles falls back to
+ *  chip8_run_cycles, so callers never need two code paths.
+ */
+
+#if defined(__x86_64__) && defined(__linux__)
+#define CHIP8_HAS_JIT 1
+#else
+#define CHIP8_HAS_JIT 0
+#endif
+
+typedef struct Chip8Jit Chip8Jit;
+
+// returns NULL when the host cannot run translated code
+Chip8Jit* chip8_jit_create(void);
+void chip8_jit_destroy(Chip8Jit* jit);
+// same result as chip8_run_cycles(cpu, cycles), a NULL jit simply interprets
+void chip8_jit_run_cycles(Chip8Jit* jit, CHIP8* cpu, uint32_t cycles);
+#endif
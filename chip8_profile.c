@@ -0,0 +1,192 @@
+#include "chip8_profile.h"
+
+#include <stdio.h>
+#include <string.h>
+
+#define TOP_ADDRESSES 16
+
+#define HANDLER_NAME(index, function) [index] = #index,
+static const char* const handler_names[EXEC_COUNT] = { CHIP8_HANDLERS(HANDLER_NAME) };
+#undef HANDLER_NAME
+
+// one name per OP_* class, same order as the first nibble
+static const char* const type_names[16] =
+{
+    "SYSTEM", "JUMP", "CALL", "SKIP_X_EQ_BYTE", "SKIP_X_NE_BYTE", "SKIP_X_EQ_Y", "LOAD_X_BYTE", "ADD_X_BYTE",
+    "ARITHMETIC", "SKIP_X_NE_Y", "LOAD_I_ADDR", "JUMP_V0_ADDR", "RANDOM_X_BYTE", "DRAW_SPRITE", "KEY_INPUT", "MISCELLANEOUS"
+};
+
+void chip8_profile_reset(Chip8Profile* profile)
+{
+    memset(profile, 0, sizeof(Chip8Profile));
+    profile->frame_ns_min = UINT64_MAX;
+}
+
+bool chip8_profile_attach(CHIP8* cpu, Chip8Profile* profile)
+{
+#if CHIP8_PROFILE
+    cpu->profile = profile;
+    return true;
+#else
+    (void) cpu;
+    (void) profile;
+    return false;
+#endif
+}
+
+void chip8_profile_frame(Chip8Profile* profile, uint64_t host_ns)
+{
+    profile->frames++;
+    profile->frame_ns_total += host_ns;
+    if (host_ns < profile->frame_ns_min) { profile->frame_ns_min = host_ns; }
+    if (host_ns > profile->frame_ns_max) { profile->frame_ns_max = host_ns; }
+    if (host_ns > CHIP8_FRAME_BUDGET_NS) { profile->frames_over_budget++; }
+}
+
+// indices of the hottest addresses, in descending order, returns how many were hit at all
+static int hottest_addresses(const Chip8Profile* profile, uint16_t top[TOP_ADDRESSES])
+{
+    int found = 0;
+    int kept = 0;
+    for (uint16_t address = 0; address < SIZE_4KB; ++address)
+    {
+        uint64_t hits = profile->pc_hits[address];
+        if (hits == 0) { continue; }
+        found++;
+        if (kept == TOP_ADDRESSES && hits <= profile->pc_hits[top[TOP_ADDRESSES - 1]]) { continue; }
+
+        // insertion into the short sorted list, the last entry falls off when it is full
+        int slot = (kept < TOP_ADDRESSES) ? kept++ : TOP_ADDRESSES - 1;
+        while (slot > 0 && profile->pc_hits[top[slot - 1]] < hits)
+        {
+            top[slot] = top[slot - 1];
+            slot--;
+        }
+        top[slot] = address;
+    }
+    return found;
+}
+
+static double percent(uint64_t part, uint64_t total)
+{
+    return (total == 0) ? 0.0 : 100.0 * (double) part / (double) total;
+}
+
+static void report_text(const Chip8Profile* profile, FILE* out)
+{
+    uint64_t total = profile->instructions;
+    fprintf(out, "instructions:       %llu\n", (unsigned long long) total);
+    fprintf(out, "idle cycles skipped: %llu\n", (unsigned long long) profile->idle_skipped);
+
+    fprintf(out, "\nby opcode class:\n");
+    for (int type = 0; type < 16; ++type)
+    {
+        if (profile->type_counts[type] == 0) { continue; }
+        fprintf(out, "  %Xnnn %-16s %12llu  %6.2f%%\n", type, type_names[type],
+                (unsigned long long) profile->type_counts[type], percent(profile->type_counts[type], total));
+    }
+
+    fprintf(out, "\nby operation:\n");
+    for (int op = 0; op < EXEC_COUNT; ++op)
+    {
+        if (profile->handler_counts[op] == 0) { continue; }
+        // skip the EXEC_ prefix
+        fprintf(out, "  %-18s %12llu  %6.2f%%\n", handler_names[op] + 5,
+                (unsigned long long) profile->handler_counts[op], percent(profile->handler_counts[op], total));
+    }
+
+    uint16_t top[TOP_ADDRESSES];
+    int found = hottest_addresses(profile, top);
+    fprintf(out, "\nhottest addresses (%d executed):\n", found);
+    for (int k = 0; k < found && k < TOP_ADDRESSES; ++k)
+    {
+        fprintf(out, "  0x%03X %12llu  %6.2f%%\n", top[k],
+                (unsigned long long) profile->pc_hits[top[k]], percent(profile->pc_hits[top[k]], total));
+    }
+
+    fprintf(out, "\nsprites: %llu drawn, %llu rows, %llu pixels, %llu collisions\n",
+            (unsigned long long) profile->sprites_drawn, (unsigned long long) profile->sprite_rows,
+            (unsigned long long) profile->sprite_pixels, (unsigned long long) profile->sprite_collisions);
+
+    if (profile->frames > 0)
+    {
+        fprintf(out, "frames:  %llu, host time avg %.1f us, min %.1f us, max %.1f us, %llu over the %.2f ms budget\n",
+                (unsigned long long) profile->frames,
+                (double) profile->frame_ns_total / (double) profile->frames / 1000.0,
+                (double) profile->frame_ns_min / 1000.0, (double) profile->frame_ns_max / 1000.0,
+                (unsigned long long) profile->frames_over_budget, (double) CHIP8_FRAME_BUDGET_NS / 1e6);
+    }
+}
+
+static void report_json(const Chip8Profile* profile, FILE* out)
+{
+    fprintf(out, "{\n  \"instructions\": %llu,\n", (unsigned long long) profile->instructions);
+    fprintf(out, "  \"idle_skipped\": %llu,\n", (unsigned long long) profile->idle_skipped);
+
+    fprintf(out, "  \"opcode_classes\": {");
+    bool first = true;
+    for (int type = 0; type < 16; ++type)
+    {
+        if (profile->type_counts[type] == 0) { continue; }
+        fprintf(out, "%s\n    \"%s\": %llu", first ? "" : ",", type_names[type], (unsigned long long) profile->type_counts[type]);
+        first = false;
+    }
+    fprintf(out, "\n  },\n  \"operations\": {");
+    first = true;
+    for (int op = 0; op < EXEC_COUNT; ++op)
+    {
+        if (profile->handler_counts[op] == 0) { continue; }
+        fprintf(out, "%s\n    \"%s\": %llu", first ? "" : ",", handler_names[op] + 5, (unsigned long long) profile->handler_counts[op]);
+        first = false;
+    }
+
+    // the full histogram, sparse: only addresses that ran
+    fprintf(out, "\n  },\n  \"pc_histogram\": {");
+    first = true;
+    for (int address = 0; address < SIZE_4KB; ++address)
+    {
+        if (profile->pc_hits[address] == 0) { continue; }
+        fprintf(out, "%s\n    \"0x%03X\": %llu", first ? "" : ",", address, (unsigned long long) profile->pc_hits[address]);
+        first = false;
+    }
+    fprintf(out, "\n  },\n");
+
+    fprintf(out, "  \"sprites\": { \"drawn\": %llu, \"rows\": %llu, \"pixels\": %llu, \"collisions\": %llu },\n",
+            (unsigned long long) profile->sprites_drawn, (unsigned long long) profile->sprite_rows,
+            (unsigned long long) profile->sprite_pixels, (unsigned long long) profile->sprite_collisions);
+    fprintf(out, "  \"frames\": { \"count\": %llu, \"host_ns_total\": %llu, \"host_ns_min\": %llu, \"host_ns_max\": %llu, \"over_budget\": %llu }\n}\n",
+            (unsigned long long) profile->frames, (unsigned long long) profile->frame_ns_total,
+            (unsigned long long) (profile->frames > 0 ? profile->frame_ns_min : 0),
+            (unsigned long long) profile->frame_ns_max, (unsigned long long) profile->frames_over_budget);
+}
+
+void chip8_profile_report(const Chip8Profile* profile, FILE* out, bool json)
+{
+    if (json)
+    {
+        report_json(profile, out);
+        return;
+    }
+    report_text(profile, out);
+}
+
+bool chip8_profile_write(const Chip8Profile* profile, const char* path)
+{
+    size_t length = strlen(path);
+    bool json = length >= 5 && strcmp(path + length - 5, ".json") == 0;
+    if (strcmp(path, "-") == 0)
+    {
+        chip8_profile_report(profile, stdout, false);
+        return true;
+    }
+
+    FILE* file_pointer = fopen(path, "w");
+    if (file_pointer == NULL)
+    {
+        perror("CHIP8: Error while writing the profile: ");
+        return false;
+    }
+    chip8_profile_report(profile, file_pointer, json);
+    fclose(file_pointer);
+    return true;
+}
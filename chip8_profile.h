@@ -0,0 +1,62 @@
+#ifndef CHIP8_PROFILE_H
+#define CHIP8_PROFILE_H
+
+#include "chip8.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+
+/*
+ *  Profiler: counters filled by the interpreter while a profile is attached.
+ *  The hooks only exist when the core is built with CHIP8_PROFILE=1
+ *  (cmake -DCHIP8_PROFILE=ON), otherwise chip8_profile_attach returns false
+ *  and the dispatch loops are exactly the uninstrumented ones.
+ *
+ *  Instructions run by JIT blocks are not counted, so chip8_jit_run_cycles
+ *  interprets while a profile is attached.
+ */
+
+#define CHIP8_FRAME_BUDGET_NS (1000000000ull / TIMER_HERTZ)
+
+typedef struct Chip8Profile
+{
+    uint64_t instructions;
+    uint64_t type_counts[16];          // by opcode class, the OP_* first nibble
+    uint64_t handler_counts[EXEC_COUNT]; // by resolved sub-op, EXEC_*
+    uint64_t pc_hits[SIZE_4KB];        // executions per address
+    uint64_t idle_skipped;             // cycles fast-forwarded by chip8_skip_idle
+
+    uint64_t sprites_drawn;            // DXYN executions
+    uint64_t sprite_rows;
+    uint64_t sprite_pixels;            // set bits drawn (XORed into the display)
+    uint64_t sprite_collisions;        // DXYN that set VF
+
+    uint64_t frames;                   // reported by the frontend through chip8_profile_frame
+    uint64_t frame_ns_total;
+    uint64_t frame_ns_min;
+    uint64_t frame_ns_max;
+    uint64_t frames_over_budget;       // slower than 1/60 s
+} Chip8Profile;
+
+void chip8_profile_reset(Chip8Profile* profile);
+// starts (or with NULL stops) recording into profile, false if the core was built without CHIP8_PROFILE
+bool chip8_profile_attach(CHIP8* cpu, Chip8Profile* profile);
+// host time spent on one emulated frame
+void chip8_profile_frame(Chip8Profile* profile, uint64_t host_ns);
+
+// report with the hottest handlers and addresses, json = false gives a text table
+void chip8_profile_report(const Chip8Profile* profile, FILE* out, bool json);
+// "-" is stdout, a path ending in .json gets JSON, anything else text
+bool chip8_profile_write(const Chip8Profile* profile, const char* path);
+
+#if CHIP8_PROFILE
+static inline void chip8_profile_instruction(Chip8Profile* profile, uint16_t pc, const Instruction* instruction)
+{
+    profile->instructions++;
+    profile->type_counts[instruction->type]++;
+    profile->handler_counts[instruction->op]++;
+    profile->pc_hits[pc & (SIZE_4KB - 1)]++;
+}
+#endif
+#endif
@@ -0,0 +1,216 @@
+#include "chip8_rom.h"
+
+#include <fcntl.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#define PAGE_BYTES (1u << PAGE_SHIFT)
+#define STATE_START offsetof(CHIP8, display)
+
+struct Chip8Rom
+{
+    CHIP8 machine;  // booted and never run, its memory and decoded cache are the shared pages
+    size_t size;
+};
+
+Chip8Rom* chip8_rom_open(const char* path)
+{
+    int fd = open(path, O_RDONLY);
+    struct stat info;
+    if (fd < 0 || fstat(fd, &info) != 0)
+    {
+        perror("CHIP8: Error while opening file: ");
+        if (fd >= 0) { close(fd); }
+        return NULL;
+    }
+    if (info.st_size >= SIZE_4KB - INTERPRETER_RESERVED_MEMORY)
+    {
+        printf("CHIP8: Your file is too big for a chip 8 engine! terminating.\n");
+        close(fd);
+        return NULL;
+    }
+
+    size_t size = (size_t) info.st_size;
+    const uint8_t* bytes = NULL;
+    if (size > 0)
+    {
+        bytes = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (bytes == MAP_FAILED)
+        {
+            perror("CHIP8: Error while mapping file: ");
+            close(fd);
+            return NULL;
+        }
+    }
+    close(fd);
+
+    Chip8Rom* rom = malloc(sizeof(Chip8Rom));
+    if (rom != NULL)
+    {
+        chip8_init(&rom->machine);
+        memcpy(rom->machine.memory + INTERPRETER_RESERVED_MEMORY, bytes, size);
+        chip8_lookup_quirks(bytes, size, &rom->machine.quirks);
+        chip8_decode_memory(&rom->machine);
+        rom->size = size;
+    }
+    if (bytes != NULL) { munmap((void*) bytes, size); }
+    return rom;
+}
+
+void chip8_rom_close(Chip8Rom* rom)
+{
+    free(rom);
+}
+
+size_t chip8_rom_size(const Chip8Rom* rom)
+{
+    return rom->size;
+}
+
+const CHIP8* chip8_rom_machine(const Chip8Rom* rom)
+{
+    return &rom->machine;
+}
+
+void chip8_rom_instantiate(const Chip8Rom* rom, CHIP8* cpu)
+{
+    *cpu = rom->machine;
+}
+
+/*
+ *  Compact instances
+ */
+
+// index of page's contents in pages[], the private pages below it come first
+static uint32_t page_slot(uint64_t private_pages, uint32_t page)
+{
+    return (uint32_t) __builtin_popcountll(private_pages & ((1ull << page) - 1));
+}
+
+// the count opcodes from first on, wrapping around the 4KB like decode_at
+static void decode_span(CHIP8* cpu, uint32_t first, uint32_t count)
+{
+    for (uint32_t k = 0; k < count; ++k)
+    {
+        uint32_t at = (first + k) & (SIZE_4KB - 1);
+        cpu->decoded[at] = chip8_decode((uint16_t) ((cpu->memory[at] << 8) | cpu->memory[(at + 1) & (SIZE_4KB - 1)]));
+    }
+}
+
+// brings the page at start to source's bytes; instances of one ROM mostly differ in a few bytes
+// (a score, a counter), so only the bytes that changed are copied and their opcodes decoded again
+static void restore_page(CHIP8* cpu, uint32_t start, const uint8_t* source)
+{
+    for (uint32_t offset = 0; offset < PAGE_BYTES; offset += sizeof(uint64_t))
+    {
+        if (memcmp(cpu->memory + start + offset, source + offset, sizeof(uint64_t)) == 0) { continue; }
+        for (uint32_t address = start + offset; address < start + offset + sizeof(uint64_t); ++address)
+        {
+            if (cpu->memory[address] == source[address - start]) { continue; }
+            cpu->memory[address] = source[address - start];
+            // the opcode starting one byte earlier also reads this byte
+            decode_span(cpu, address - 1, 2);
+        }
+    }
+}
+
+void chip8_compact_init(Chip8Compact* compact, const Chip8Rom* rom)
+{
+    memcpy(compact->state, (const uint8_t*) &rom->machine + STATE_START, CHIP8_COMPACT_STATE_SIZE);
+    compact->private_pages = 0;
+    compact->pages = NULL;
+}
+
+void chip8_compact_free(Chip8Compact* compact)
+{
+    free(compact->pages);
+    compact->pages = NULL;
+    compact->private_pages = 0;
+}
+
+void chip8_compact_seed(Chip8Compact* compact, uint32_t seed)
+{
+    uint32_t state = chip8_seed_state(seed);
+    memcpy(compact->state + offsetof(CHIP8, rng_state) - STATE_START, &state, sizeof(state));
+}
+
+size_t chip8_compact_size(const Chip8Compact* compact)
+{
+    return sizeof(Chip8Compact) + (size_t) __builtin_popcountll(compact->private_pages) * PAGE_BYTES;
+}
+
+void chip8_workspace_init(Chip8Workspace* workspace, const Chip8Rom* rom)
+{
+    workspace->cpu = rom->machine;
+    workspace->rom = rom;
+    workspace->diverged = 0;
+}
+
+void chip8_compact_load(Chip8Workspace* workspace, const Chip8Compact* compact)
+{
+    CHIP8* cpu = &workspace->cpu;
+    const CHIP8* shared = &workspace->rom->machine;
+
+    // pages the last instance left behind go back to the ROM's, this instance's own come in;
+    // in page order, so an opcode reading into the next page is decoded again if that page changes too
+    uint64_t restore = workspace->diverged | compact->private_pages;
+    for (uint64_t pages = restore; pages != 0; pages &= pages - 1)
+    {
+        uint32_t page = (uint32_t) __builtin_ctzll(pages);
+        uint32_t start = page << PAGE_SHIFT;
+        const uint8_t* source = (compact->private_pages & (1ull << page)) ?
+            compact->pages[page_slot(compact->private_pages, page)] : shared->memory + start;
+        restore_page(cpu, start, source);
+    }
+    workspace->diverged = compact->private_pages;
+
+    memcpy((uint8_t*) cpu + STATE_START, compact->state, CHIP8_COMPACT_STATE_SIZE);
+    cpu->written_pages = 0;
+}
+
+bool chip8_compact_store(Chip8Workspace* workspace, Chip8Compact* compact)
+{
+    CHIP8* cpu = &workspace->cpu;
+
+    // copy on write: a page gets its private copy the first time the instance writes it
+    uint64_t fresh = cpu->written_pages & ~compact->private_pages;
+    if (fresh != 0)
+    {
+        uint64_t private_pages = compact->private_pages | fresh;
+        uint8_t (*pages)[PAGE_BYTES] = malloc((size_t) __builtin_popcountll(private_pages) * PAGE_BYTES);
+        if (pages != NULL)
+        {
+            for (uint64_t old = compact->private_pages; old != 0; old &= old - 1)
+            {
+                uint32_t page = (uint32_t) __builtin_ctzll(old);
+                memcpy(pages[page_slot(private_pages, page)], compact->pages[page_slot(compact->private_pages, page)], PAGE_BYTES);
+            }
+            free(compact->pages);
+            compact->pages = pages;
+            compact->private_pages = private_pages;
+        }
+        else
+        {
+            // keep the instance as it was stored last time, memory and registers together
+            printf("CHIP8: out of memory for an instance's written pages, it keeps its last stored state\n");
+            workspace->diverged |= cpu->written_pages;
+            cpu->written_pages = 0;
+            return false;
+        }
+    }
+    for (uint64_t written = cpu->written_pages & compact->private_pages; written != 0; written &= written - 1)
+    {
+        uint32_t page = (uint32_t) __builtin_ctzll(written);
+        memcpy(compact->pages[page_slot(compact->private_pages, page)], cpu->memory + (page << PAGE_SHIFT), PAGE_BYTES);
+    }
+    workspace->diverged |= cpu->written_pages;
+    cpu->written_pages = 0;
+
+    memcpy(compact->state, (const uint8_t*) cpu + STATE_START, CHIP8_COMPACT_STATE_SIZE);
+    return true;
+}
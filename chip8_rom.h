@@ -0,0 +1,75 @@
+#ifndef CHIP8_ROM_H
+#define CHIP8_ROM_H
+
+#include "chip8.h"
+
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ *  Loaded ROMs and compact instances, for pools of many machines running
+ *  one game.
+ *
+ *  A Chip8Rom maps the file once and keeps the machine it boots into: font,
+ *  program, decoded opcodes and the quirk profile from the known ROM table.
+ *  chip8_rom_instantiate copies that machine instead of going back to disk.
+ *
+ *  A Chip8Compact is one machine without its memory: the display and the
+ *  registers, plus private copies of only the 64-byte pages it has written
+ *  (Fx33/Fx55). Every other page is the ROM's, shared by all instances. It
+ *  is 376 bytes on x86-64 instead of the 45 KB of a CHIP8, most of which is
+ *  the decoded opcode cache, so thousands of them fit in L2.
+ *
+ *  A compact instance runs on a Chip8Workspace, a full CHIP8 per thread:
+ *  chip8_compact_load swaps it in, restoring only the pages where the
+ *  previous instance and this one differ from the ROM, and chip8_compact_store
+ *  copies the pages written since the load back into the instance. Between
+ *  the two the workspace's cpu is an ordinary machine for the interpreter
+ *  engines; the JIT and recompiled code keep their own caches of memory and
+ *  must not run on it.
+ */
+
+// the part of CHIP8 a compact instance keeps, display up to written_pages
+#define CHIP8_COMPACT_STATE_SIZE (offsetof(CHIP8, written_pages) - offsetof(CHIP8, display))
+
+typedef struct Chip8Rom Chip8Rom;
+
+typedef struct
+{
+    _Alignas(8) uint8_t state[CHIP8_COMPACT_STATE_SIZE];  // the CHIP8 fields from display on, as CHIP8 lays them out
+    uint64_t private_pages;                               // pages this instance wrote, one bit each
+    uint8_t (*pages)[1u << PAGE_SHIFT];                   // their contents, in page order
+} Chip8Compact;
+
+typedef struct
+{
+    CHIP8 cpu;
+    const Chip8Rom* rom;
+    uint64_t diverged;  // pages of cpu.memory that differ from the ROM's, the last instance's private ones
+} Chip8Workspace;
+
+// NULL if the file is missing or too big, prints why like load_rom
+Chip8Rom* chip8_rom_open(const char* path);
+void chip8_rom_close(Chip8Rom* rom);
+// bytes of program
+size_t chip8_rom_size(const Chip8Rom* rom);
+// the machine after chip8_init and load_rom, with its random state from chip8_init
+const CHIP8* chip8_rom_machine(const Chip8Rom* rom);
+// what chip8_init and load_rom would leave in cpu, without reading the file again
+void chip8_rom_instantiate(const Chip8Rom* rom, CHIP8* cpu);
+
+// a freshly booted instance sharing all of rom's pages
+void chip8_compact_init(Chip8Compact* compact, const Chip8Rom* rom);
+// frees the private pages
+void chip8_compact_free(Chip8Compact* compact);
+void chip8_compact_seed(Chip8Compact* compact, uint32_t seed);
+// bytes the instance takes, its private pages included
+size_t chip8_compact_size(const Chip8Compact* compact);
+
+void chip8_workspace_init(Chip8Workspace* workspace, const Chip8Rom* rom);
+// makes workspace->cpu the instance's machine
+void chip8_compact_load(Chip8Workspace* workspace, const Chip8Compact* compact);
+// saves workspace->cpu back into the instance; false if a private page could not be allocated,
+// the instance then keeps what the previous store saved
+bool chip8_compact_store(Chip8Workspace* workspace, Chip8Compact* compact);
+#endif
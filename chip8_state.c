@@ -0,0 +1,391 @@
+#include "chip8_state.h"
+
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/*
+ *  Serialization
+ */
+
+static uint8_t* put_u16(uint8_t* out, uint16_t value)
+{
+    out[0] = (uint8_t) value;
+    out[1] = (uint8_t) (value >> 8);
+    return out + 2;
+}
+
+static uint8_t* put_u32(uint8_t* out, uint32_t value)
+{
+    for (int k = 0; k < 4; ++k) { out[k] = (uint8_t) (value >> (k * 8)); }
+    return out + 4;
+}
+
+static uint8_t* put_u64(uint8_t* out, uint64_t value)
+{
+    for (int k = 0; k < 8; ++k) { out[k] = (uint8_t) (value >> (k * 8)); }
+    return out + 8;
+}
+
+static const uint8_t* get_u16(const uint8_t* in, uint16_t* value)
+{
+    *value = (uint16_t) (in[0] | (in[1] << 8));
+    return in + 2;
+}
+
+static const uint8_t* get_u32(const uint8_t* in, uint32_t* value)
+{
+    *value = 0;
+    for (int k = 0; k < 4; ++k) { *value |= (uint32_t) in[k] << (k * 8); }
+    return in + 4;
+}
+
+static const uint8_t* get_u64(const uint8_t* in, uint64_t* value)
+{
+    *value = 0;
+    for (int k = 0; k < 8; ++k) { *value |= (uint64_t) in[k] << (k * 8); }
+    return in + 8;
+}
+
+size_t chip8_serialize(const CHIP8* cpu, uint8_t* buffer, size_t capacity)
+{
+    if (capacity < CHIP8_STATE_SIZE) { return 0; }
+
+    uint8_t* out = buffer;
+    memcpy(out, CHIP8_STATE_MAGIC, 4);
+    out = put_u16(out + 4, CHIP8_STATE_VERSION);
+    out = put_u16(out, 0);
+
+    memcpy(out, cpu->memory, SIZE_4KB);
+    out += SIZE_4KB;
+    for (int row = 0; row < DISPLAY_HEIGHT; ++row) { out = put_u64(out, cpu->display[row]); }
+    memcpy(out, cpu->v, REGISTER_COUNT);
+    out += REGISTER_COUNT;
+    out = put_u16(out, cpu->i);
+    out = put_u16(out, cpu->pc);
+    for (int level = 0; level < STACK_SIZE; ++level) { out = put_u16(out, cpu->stack[level]); }
+    *out++ = cpu->stack_pointer;
+    *out++ = cpu->delay;
+    *out++ = cpu->sound_timer;
+    memcpy(out, cpu->keypad, 16);
+    out += 16;
+    out = put_u32(out, cpu->rng_state);
+    out = put_u64(out, cpu->clock);
+    out = put_u32(out, cpu->timer_phase);
+    out = put_u32(out, cpu->busy_cycles);
+
+    return (size_t) (out - buffer);
+}
+
+bool chip8_deserialize(CHIP8* cpu, const uint8_t* buffer, size_t size)
+{
+    if (size < CHIP8_STATE_HEADER_SIZE || memcmp(buffer, CHIP8_STATE_MAGIC, 4) != 0) { return false; }
+    uint16_t version;
+    get_u16(buffer + 4, &version);
+    if (version != CHIP8_STATE_VERSION || size < CHIP8_STATE_SIZE) { return false; }
+
+    const uint8_t* in = buffer + CHIP8_STATE_HEADER_SIZE;
+    memcpy(cpu->memory, in, SIZE_4KB);
+    in += SIZE_4KB;
+    for (int row = 0; row < DISPLAY_HEIGHT; ++row) { in = get_u64(in, &cpu->display[row]); }
+    memcpy(cpu->v, in, REGISTER_COUNT);
+    in += REGISTER_COUNT;
+    in = get_u16(in, &cpu->i);
+    in = get_u16(in, &cpu->pc);
+    for (int level = 0; level < STACK_SIZE; ++level) { in = get_u16(in, &cpu->stack[level]); }
+    cpu->stack_pointer = *in++;
+    cpu->delay = *in++;
+    cpu->sound_timer = *in++;
+    memcpy(cpu->keypad, in, 16);
+    in += 16;
+    uint32_t rng_state;
+    in = get_u32(in, &rng_state);
+    // a zero state would make Cxkk return 0 forever
+    if (rng_state != 0) { cpu->rng_state = rng_state; }
+    in = get_u64(in, &cpu->clock);
+    in = get_u32(in, &cpu->timer_phase);
+    get_u32(in, &cpu->busy_cycles);
+
+    // memory changed behind the decoder's back
+    chip8_decode_memory(cpu);
+    cpu->display_dirty = 1;
+    return true;
+}
+
+bool chip8_save_state(const CHIP8* cpu, const char* path)
+{
+    uint8_t buffer[CHIP8_STATE_SIZE];
+    size_t size = chip8_serialize(cpu, buffer, sizeof(buffer));
+
+    FILE* file_pointer = fopen(path, "wb");
+    if (file_pointer == NULL)
+    {
+        perror("CHIP8: Error while saving state: ");
+        return false;
+    }
+    bool written = fwrite(buffer, 1, size, file_pointer) == size;
+    fclose(file_pointer);
+    return written;
+}
+
+bool chip8_load_state(CHIP8* cpu, const char* path)
+{
+    uint8_t buffer[CHIP8_STATE_SIZE];
+
+    FILE* file_pointer = fopen(path, "rb");
+    if (file_pointer == NULL)
+    {
+        perror("CHIP8: Error while loading state: ");
+        return false;
+    }
+    size_t size = fread(buffer, 1, sizeof(buffer), file_pointer);
+    fclose(file_pointer);
+
+    if (!chip8_deserialize(cpu, buffer, size))
+    {
+        printf("CHIP8: %s is not a compatible save state\n", path);
+        return false;
+    }
+    return true;
+}
+
+/*
+ *  Clone
+ */
+
+_Static_assert(offsetof(CHIP8, memory) == 0 && offsetof(CHIP8, decoded) + sizeof(((CHIP8*) NULL)->decoded) == sizeof(CHIP8),
+               "chip8_copy_state expects memory first and decoded last");
+
+void chip8_copy_state(CHIP8* dst, const CHIP8* src)
+{
+    // memory and its decoded cache are almost all of the struct and barely change between frames
+    for (uint32_t start = 0; start < SIZE_4KB; start += 1u << PAGE_SHIFT)
+    {
+        if (memcmp(dst->memory + start, src->memory + start, 1u << PAGE_SHIFT) == 0) { continue; }
+        memcpy(dst->memory + start, src->memory + start, 1u << PAGE_SHIFT);
+        memcpy(&dst->decoded[start], &src->decoded[start], sizeof(Instruction) << PAGE_SHIFT);
+        // the opcode at the byte before the page also reads its first byte
+        uint32_t previous = (start - 1) & (SIZE_4KB - 1);
+        dst->decoded[previous] = src->decoded[previous];
+    }
+
+#if CHIP8_PROFILE
+    struct Chip8Profile* profile = dst->profile;
+#endif
+#if CHIP8_TRACE
+    struct Chip8Trace* trace = dst->trace;
+#endif
+    size_t registers = offsetof(CHIP8, display);
+    memcpy((uint8_t*) dst + registers, (const uint8_t*) src + registers, offsetof(CHIP8, decoded) - registers);
+#if CHIP8_PROFILE
+    dst->profile = profile;
+#endif
+#if CHIP8_TRACE
+    dst->trace = trace;
+#endif
+}
+
+/*
+ *  Rewind
+ *
+ *  Delta encoding of a XOR b, repeated until the changes run out:
+ *      varint unchanged_bytes, varint changed_bytes, changed_bytes XOR values
+ */
+
+struct Chip8Rewind
+{
+    uint8_t newest[CHIP8_STATE_SIZE];
+    bool has_newest;
+
+    uint8_t* data;          // circular byte arena holding the deltas
+    size_t capacity;
+    size_t write_offset;
+
+    // circular list of deltas, oldest first
+    uint32_t* entry_offset;
+    uint32_t* entry_length;
+    uint32_t max_entries;
+    uint32_t first_entry;
+    uint32_t entry_count;
+    size_t bytes_used;
+};
+
+static uint8_t* put_varint(uint8_t* out, size_t value)
+{
+    while (value >= 0x80)
+    {
+        *out++ = (uint8_t) (value | 0x80);
+        value >>= 7;
+    }
+    *out++ = (uint8_t) value;
+    return out;
+}
+
+static const uint8_t* get_varint(const uint8_t* in, const uint8_t* end, size_t* value)
+{
+    *value = 0;
+    for (int shift = 0; in < end && shift < 35; shift += 7)
+    {
+        uint8_t byte = *in++;
+        *value |= (size_t) (byte & 0x7F) << shift;
+        if ((byte & 0x80) == 0) { break; }
+    }
+    return in;
+}
+
+static bool same_word(const uint8_t* a, const uint8_t* b)
+{
+    uint64_t left, right;
+    memcpy(&left, a, 8);
+    memcpy(&right, b, 8);
+    return left == right;
+}
+
+// out must hold CHIP8_STATE_SIZE + a few varints, returns the encoded size
+static size_t encode_delta(const uint8_t* older, const uint8_t* newer, uint8_t* out)
+{
+    uint8_t* start = out;
+    size_t position = 0;
+    while (position < CHIP8_STATE_SIZE)
+    {
+        // unchanged run, a word at a time while possible
+        size_t run_start = position;
+        while (position + 8 <= CHIP8_STATE_SIZE && same_word(older + position, newer + position)) { position += 8; }
+        while (position < CHIP8_STATE_SIZE && older[position] == newer[position]) { position++; }
+        if (position == CHIP8_STATE_SIZE) { break; }
+        size_t unchanged = position - run_start;
+
+        // changed run, short equal gaps are cheaper inside the literal than as a new token
+        size_t literal_start = position;
+        while (position < CHIP8_STATE_SIZE)
+        {
+            if (older[position] != newer[position]) { position++; continue; }
+            size_t equal_end = position;
+            while (equal_end < CHIP8_STATE_SIZE && older[equal_end] == newer[equal_end] && equal_end - position < 4) { equal_end++; }
+            if (equal_end - position >= 4 || equal_end == CHIP8_STATE_SIZE) { break; }
+            position = equal_end;
+        }
+
+        out = put_varint(out, unchanged);
+        out = put_varint(out, position - literal_start);
+        for (size_t k = literal_start; k < position; ++k) { *out++ = older[k] ^ newer[k]; }
+    }
+    return (size_t) (out - start);
+}
+
+static void apply_delta(uint8_t* state, const uint8_t* delta, size_t size)
+{
+    const uint8_t* end = delta + size;
+    size_t position = 0;
+    while (delta < end)
+    {
+        size_t unchanged, changed;
+        delta = get_varint(delta, end, &unchanged);
+        delta = get_varint(delta, end, &changed);
+        position += unchanged;
+        if (position + changed > CHIP8_STATE_SIZE || delta + changed > end) { return; }
+        for (size_t k = 0; k < changed; ++k) { state[position + k] ^= delta[k]; }
+        position += changed;
+        delta += changed;
+    }
+}
+
+Chip8Rewind* chip8_rewind_create(size_t capacity_bytes)
+{
+    Chip8Rewind* rewind = calloc(1, sizeof(Chip8Rewind));
+    if (rewind == NULL) { return NULL; }
+
+    // even an empty delta costs an entry, so cap history at ten minutes of frames
+    rewind->max_entries = 60 * 60 * 10;
+    rewind->capacity = capacity_bytes;
+    rewind->data = malloc(capacity_bytes);
+    rewind->entry_offset = malloc(sizeof(uint32_t) * rewind->max_entries);
+    rewind->entry_length = malloc(sizeof(uint32_t) * rewind->max_entries);
+    if (rewind->data == NULL || rewind->entry_offset == NULL || rewind->entry_length == NULL)
+    {
+        chip8_rewind_destroy(rewind);
+        return NULL;
+    }
+    return rewind;
+}
+
+void chip8_rewind_destroy(Chip8Rewind* rewind)
+{
+    if (rewind == NULL) { return; }
+    free(rewind->data);
+    free(rewind->entry_offset);
+    free(rewind->entry_length);
+    free(rewind);
+}
+
+static void drop_oldest(Chip8Rewind* rewind)
+{
+    rewind->bytes_used -= rewind->entry_length[rewind->first_entry];
+    rewind->first_entry = (rewind->first_entry + 1) % rewind->max_entries;
+    rewind->entry_count--;
+}
+
+static bool overlaps_oldest(const Chip8Rewind* rewind, size_t offset, size_t length)
+{
+    size_t oldest_offset = rewind->entry_offset[rewind->first_entry];
+    size_t oldest_end = oldest_offset + rewind->entry_length[rewind->first_entry];
+    return oldest_offset < offset + length && offset < oldest_end;
+}
+
+void chip8_rewind_capture(Chip8Rewind* rewind, const CHIP8* cpu)
+{
+    uint8_t current[CHIP8_STATE_SIZE];
+    chip8_serialize(cpu, current, sizeof(current));
+    if (!rewind->has_newest)
+    {
+        memcpy(rewind->newest, current, sizeof(current));
+        rewind->has_newest = true;
+        return;
+    }
+
+    // worst case: every byte is a literal plus two varints per token
+    uint8_t delta[CHIP8_STATE_SIZE * 2];
+    size_t length = encode_delta(rewind->newest, current, delta);
+    memcpy(rewind->newest, current, sizeof(current));
+    if (length > rewind->capacity) { return; }
+
+    size_t offset = rewind->write_offset;
+    if (offset + length > rewind->capacity) { offset = 0; }
+    while (rewind->entry_count > 0 && (rewind->entry_count == rewind->max_entries || overlaps_oldest(rewind, offset, length)))
+    {
+        drop_oldest(rewind);
+    }
+
+    memcpy(rewind->data + offset, delta, length);
+    uint32_t slot = (rewind->first_entry + rewind->entry_count) % rewind->max_entries;
+    rewind->entry_offset[slot] = (uint32_t) offset;
+    rewind->entry_length[slot] = (uint32_t) length;
+    rewind->entry_count++;
+    rewind->bytes_used += length;
+    rewind->write_offset = offset + length;
+}
+
+bool chip8_rewind_step_back(Chip8Rewind* rewind, CHIP8* cpu)
+{
+    if (rewind->entry_count == 0) { return false; }
+
+    uint32_t slot = (rewind->first_entry + rewind->entry_count - 1) % rewind->max_entries;
+    apply_delta(rewind->newest, rewind->data + rewind->entry_offset[slot], rewind->entry_length[slot]);
+    rewind->entry_count--;
+    rewind->bytes_used -= rewind->entry_length[slot];
+    // the next delta goes where this one was
+    rewind->write_offset = rewind->entry_offset[slot];
+
+    return chip8_deserialize(cpu, rewind->newest, sizeof(rewind->newest));
+}
+
+uint32_t chip8_rewind_frames(const Chip8Rewind* rewind)
+{
+    return rewind->entry_count;
+}
+
+size_t chip8_rewind_bytes_used(const Chip8Rewind* rewind)
+{
+    return rewind->bytes_used;
+}
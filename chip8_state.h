@@ -0,0 +1,56 @@
+#ifndef CHIP8_STATE_H
+#define CHIP8_STATE_H
+
+#include "chip8.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ *  Save states: a versioned little-endian dump of the machine state
+ *  (memory, display, v, i, pc, stack, stack_pointer, timers, keypad, random state, clock).
+ *
+ *  Layout, version 1:
+ *      "C8ST" magic, uint16 version, uint16 reserved
+ *      memory[4096], display rows as 32 uint64, v[16], i, pc, stack[16],
+ *      stack_pointer, delay, sound_timer, keypad[16], uint32 rng_state,
+ *      uint64 clock, uint32 timer_phase, uint32 busy_cycles
+ *  The timing model and its rate are host settings and not saved.
+ */
+
+#define CHIP8_STATE_MAGIC "C8ST"
+#define CHIP8_STATE_VERSION 1
+#define CHIP8_STATE_HEADER_SIZE 8
+#define CHIP8_STATE_SIZE (CHIP8_STATE_HEADER_SIZE + SIZE_4KB + DISPLAY_HEIGHT * 8 + REGISTER_COUNT + 2 + 2 + STACK_SIZE * 2 + 3 + 16 + 4 + 16)
+
+// returns the bytes written, 0 if capacity is smaller than CHIP8_STATE_SIZE
+size_t chip8_serialize(const CHIP8* cpu, uint8_t* buffer, size_t capacity);
+// restores the machine state, host settings (engine, decoded cache) are kept or rebuilt
+bool chip8_deserialize(CHIP8* cpu, const uint8_t* buffer, size_t size);
+bool chip8_save_state(const CHIP8* cpu, const char* path);
+bool chip8_load_state(CHIP8* cpu, const char* path);
+
+// makes dst an exact copy of src, for running a throwaway copy ahead (the profile and trace pointers stay dst's);
+// dst must come from chip8_init or an earlier copy, only its memory pages that differ are copied
+void chip8_copy_state(CHIP8* dst, const CHIP8* src);
+
+/*
+ *  Rewind: keeps the newest snapshot in full and every older one as an
+ *  XOR delta against its successor, run-length encoded. Stepping back XORs
+ *  the newest delta into the snapshot. The oldest deltas are dropped when
+ *  the byte budget is full.
+ */
+
+typedef struct Chip8Rewind Chip8Rewind;
+
+Chip8Rewind* chip8_rewind_create(size_t capacity_bytes);
+void chip8_rewind_destroy(Chip8Rewind* rewind);
+// call once per frame
+void chip8_rewind_capture(Chip8Rewind* rewind, const CHIP8* cpu);
+// restores the frame captured before the newest one, false when history is empty
+bool chip8_rewind_step_back(Chip8Rewind* rewind, CHIP8* cpu);
+// frames that can still be stepped back
+uint32_t chip8_rewind_frames(const Chip8Rewind* rewind);
+size_t chip8_rewind_bytes_used(const Chip8Rewind* rewind);
+#endif
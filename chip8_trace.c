@@ -0,0 +1,271 @@
+#include "chip8_trace.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#define DUMP_CHUNK 4096  // bytes assembled on the stack per write
+
+// what the crash handler dumps, set by chip8_trace_dump_on_crash
+static const Chip8Trace* crash_trace;
+static const CHIP8* crash_cpu;
+static char crash_path[4096];
+
+static const int crash_signals[] = { SIGSEGV, SIGBUS, SIGILL, SIGFPE, SIGABRT };
+
+Chip8Trace* chip8_trace_create(uint32_t entries)
+{
+    if (entries == 0 || entries > (1u << 31)) { return NULL; }
+    uint32_t capacity = 1;
+    while (capacity < entries) { capacity <<= 1; }
+
+    Chip8Trace* trace = calloc(1, sizeof(Chip8Trace));
+    if (trace == NULL) { return NULL; }
+    // cache line aligned, eight words per line
+    trace->words = aligned_alloc(64, ((size_t) capacity * sizeof(uint64_t) + 63) & ~(size_t) 63);
+    if (trace->words == NULL)
+    {
+        free(trace);
+        return NULL;
+    }
+    // touched once now, so recording never stops on a page fault in the middle of a frame
+    memset(trace->words, 0, (size_t) capacity * sizeof(uint64_t));
+    trace->mask = capacity - 1;
+    return trace;
+}
+
+void chip8_trace_destroy(Chip8Trace* trace)
+{
+    if (trace == NULL) { return; }
+    if (crash_trace == trace) { chip8_trace_dump_on_crash(NULL, NULL, NULL); }
+    free(trace->words);
+    free(trace);
+}
+
+bool chip8_trace_attach(CHIP8* cpu, Chip8Trace* trace)
+{
+#if CHIP8_TRACE
+    cpu->trace = trace;
+    return true;
+#else
+    (void) cpu;
+    (void) trace;
+    return false;
+#endif
+}
+
+uint32_t chip8_trace_count(const Chip8Trace* trace)
+{
+    return (trace->recorded > trace->mask) ? trace->mask + 1 : (uint32_t) trace->recorded;
+}
+
+/*
+ *  Dump
+ */
+
+static uint8_t* put_u16(uint8_t* out, uint16_t value)
+{
+    out[0] = (uint8_t) value;
+    out[1] = (uint8_t) (value >> 8);
+    return out + 2;
+}
+
+static uint8_t* put_u32(uint8_t* out, uint32_t value)
+{
+    for (int k = 0; k < 4; ++k) { out[k] = (uint8_t) (value >> (k * 8)); }
+    return out + 4;
+}
+
+static uint8_t* put_u64(uint8_t* out, uint64_t value)
+{
+    for (int k = 0; k < 8; ++k) { out[k] = (uint8_t) (value >> (k * 8)); }
+    return out + 8;
+}
+
+static const uint8_t* get_u16(const uint8_t* in, uint16_t* value)
+{
+    *value = (uint16_t) (in[0] | (in[1] << 8));
+    return in + 2;
+}
+
+static const uint8_t* get_u32(const uint8_t* in, uint32_t* value)
+{
+    *value = 0;
+    for (int k = 0; k < 4; ++k) { *value |= (uint32_t) in[k] << (k * 8); }
+    return in + 4;
+}
+
+static const uint8_t* get_u64(const uint8_t* in, uint64_t* value)
+{
+    *value = 0;
+    for (int k = 0; k < 8; ++k) { *value |= (uint64_t) in[k] << (k * 8); }
+    return in + 8;
+}
+
+static bool write_all(int fd, const uint8_t* data, size_t size)
+{
+    while (size > 0)
+    {
+        ssize_t written = write(fd, data, size);
+        if (written < 0 && errno == EINTR) { continue; }
+        if (written <= 0) { return false; }
+        data += written;
+        size -= (size_t) written;
+    }
+    return true;
+}
+
+bool chip8_trace_dump(const Chip8Trace* trace, const CHIP8* cpu, const char* path)
+{
+    int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) { return false; }
+
+    uint32_t count = chip8_trace_count(trace);
+    uint8_t buffer[DUMP_CHUNK];
+    uint8_t* out = buffer;
+    memcpy(out, CHIP8_TRACE_MAGIC, 4);
+    out = put_u16(out + 4, CHIP8_TRACE_VERSION);
+    out = put_u16(out, CHIP8_TRACE_WORD_SIZE);
+    out = put_u64(out, trace->recorded - trace->register_words);
+    out = put_u32(out, count);
+    *out++ = cpu->quirks;
+    memset(out, 0, 3);
+    out += 3;
+    memcpy(out, cpu->v, REGISTER_COUNT);
+    out += REGISTER_COUNT;
+    out = put_u16(out, cpu->i);
+    out = put_u16(out, cpu->pc);
+
+    bool ok = true;
+    for (uint64_t index = trace->recorded - count; ok && index < trace->recorded; ++index)
+    {
+        if (out + CHIP8_TRACE_WORD_SIZE > buffer + sizeof(buffer))
+        {
+            ok = write_all(fd, buffer, (size_t) (out - buffer));
+            out = buffer;
+        }
+        // the packed word in little-endian order is the file layout
+        out = put_u64(out, trace->words[index & trace->mask]);
+    }
+    ok = ok && write_all(fd, buffer, (size_t) (out - buffer));
+    return (close(fd) == 0) && ok;
+}
+
+static void dump_and_die(int signal_number)
+{
+    // the handler ran once and is back to the default, so raising again ends the process as it would have
+    if (crash_trace != NULL && chip8_trace_dump(crash_trace, crash_cpu, crash_path))
+    {
+        static const char message[] = "CHIP8: crashed, the execution trace is in ";
+        write_all(STDERR_FILENO, (const uint8_t*) message, sizeof(message) - 1);
+        write_all(STDERR_FILENO, (const uint8_t*) crash_path, strlen(crash_path));
+        write_all(STDERR_FILENO, (const uint8_t*) "\n", 1);
+    }
+    raise(signal_number);
+}
+
+void chip8_trace_dump_on_crash(const Chip8Trace* trace, const CHIP8* cpu, const char* path)
+{
+    struct sigaction action;
+    memset(&action, 0, sizeof(action));
+    sigemptyset(&action.sa_mask);
+    if (trace == NULL || path == NULL || strlen(path) >= sizeof(crash_path))
+    {
+        crash_trace = NULL;
+        action.sa_handler = SIG_DFL;
+    }
+    else
+    {
+        strcpy(crash_path, path);
+        crash_cpu = cpu;
+        crash_trace = trace;
+        action.sa_handler = dump_and_die;
+        action.sa_flags = SA_RESETHAND;
+    }
+    for (size_t k = 0; k < sizeof(crash_signals) / sizeof(crash_signals[0]); ++k)
+    {
+        sigaction(crash_signals[k], &action, NULL);
+    }
+}
+
+bool chip8_trace_read(const char* path, Chip8TraceDump* dump)
+{
+    memset(dump, 0, sizeof(*dump));
+    FILE* file_pointer = fopen(path, "rb");
+    if (file_pointer == NULL)
+    {
+        perror("CHIP8: Error while reading a trace: ");
+        return false;
+    }
+
+    uint8_t header[CHIP8_TRACE_HEADER_SIZE];
+    uint16_t version = 0;
+    uint16_t word_size = 0;
+    uint32_t words = 0;
+    bool ok = fread(header, 1, sizeof(header), file_pointer) == sizeof(header) && memcmp(header, CHIP8_TRACE_MAGIC, 4) == 0;
+    if (ok)
+    {
+        const uint8_t* in = get_u16(header + 4, &version);
+        in = get_u16(in, &word_size);
+        in = get_u64(in, &dump->recorded);
+        in = get_u32(in, &words);
+        dump->quirks = *in;
+        in += 4;
+        memcpy(dump->v, in, REGISTER_COUNT);
+        in += REGISTER_COUNT;
+        in = get_u16(in, &dump->i);
+        get_u16(in, &dump->pc);
+        ok = version == CHIP8_TRACE_VERSION && word_size == CHIP8_TRACE_WORD_SIZE;
+    }
+
+    uint8_t* raw = ok ? malloc((size_t) words * CHIP8_TRACE_WORD_SIZE + 1) : NULL;
+    dump->entries = ok ? malloc((size_t) words * sizeof(Chip8TraceEntry) + 1) : NULL;
+    ok = ok && raw != NULL && dump->entries != NULL && fread(raw, CHIP8_TRACE_WORD_SIZE, words, file_pointer) == words;
+    fclose(file_pointer);
+
+    // register words belong to the Fx65 before them, the ones whose Fx65 already left the ring are skipped
+    uint8_t loaded = 0;
+    for (uint32_t index = 0; ok && index < words; ++index)
+    {
+        uint64_t word;
+        get_u64(raw + (size_t) index * CHIP8_TRACE_WORD_SIZE, &word);
+        if (word & CHIP8_TRACE_REGISTERS)
+        {
+            if (dump->count == 0) { continue; }
+            Chip8TraceEntry* owner = &dump->entries[dump->count - 1];
+            uint8_t x = (owner->opcode >> 8) & 0xF;
+            for (int k = 0; k < CHIP8_TRACE_REGISTERS_PER_WORD && loaded < x; ++k)
+            {
+                owner->loaded[loaded++] = (uint8_t) (word >> (k * 8));
+            }
+            continue;
+        }
+        Chip8TraceEntry* entry = &dump->entries[dump->count++];
+        memset(entry, 0, sizeof(*entry));
+        entry->pc = (uint16_t) (word & (SIZE_4KB - 1));
+        entry->opcode = (uint16_t) (word >> 12);
+        entry->vx = (uint8_t) (word >> 28);
+        entry->vf = (uint8_t) (word >> 36);
+        entry->i = (uint16_t) (word >> 44);
+        loaded = 0;
+    }
+    ok = ok && dump->count <= dump->recorded;
+    free(raw);
+    if (!ok)
+    {
+        printf("CHIP8: %s is not a trace dump\n", path);
+        chip8_trace_free_dump(dump);
+    }
+    return ok;
+}
+
+void chip8_trace_free_dump(Chip8TraceDump* dump)
+{
+    free(dump->entries);
+    dump->entries = NULL;
+    dump->count = 0;
+}
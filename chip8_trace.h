@@ -0,0 +1,159 @@
+#ifndef CHIP8_TRACE_H
+#define CHIP8_TRACE_H
+
+#include "chip8.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ *  Execution trace: a ring buffer of the last instructions the interpreter
+ *  ran, one 64-bit word each, for post-mortems of a ROM that misbehaved.
+ *  A word holds the instruction's address and opcode, plus Vx, VF and I as
+ *  it left them when it can change them (CHIP8_TRACE_VX_OPS, _VF_OPS and
+ *  _I_OPS). Fx65 is followed by register words with the V0..Vx-1 it
+ *  loaded. Eight words fit in a cache line, and the default ring of 32K
+ *  words (256 KB) stays in L2; chip8_trace_create takes any size.
+ *
+ *  The hooks exist unless the core is built with CHIP8_TRACE=0
+ *  (cmake -DCHIP8_TRACE=OFF). The engines check for a trace once per call
+ *  and run a recording copy of their loop while one is attached, so the
+ *  plain loops are the same code as without the hooks. JIT blocks and
+ *  recompiled code do not record, so chip8_jit_run_cycles and
+ *  chip8_aot_run_cycles interpret while a trace is attached.
+ *
+ *  Dump file, little-endian:
+ *      "C8TR" magic, uint16 version, uint16 word size (8)
+ *      uint64 instructions recorded, uint32 words kept, uint8 quirks, 3 reserved bytes
+ *      v[16], uint16 i, uint16 pc (the machine when dumped)
+ *      words oldest first, each either
+ *          pc | opcode << 12 | vx << 28 | vf << 36 | i << 44 (bits 60-63 clear), or
+ *          seven registers, one per byte from bit 0, with CHIP8_TRACE_REGISTERS set
+ */
+
+#define CHIP8_TRACE_MAGIC "C8TR"
+#define CHIP8_TRACE_VERSION 3
+#define CHIP8_TRACE_HEADER_SIZE 44
+#define CHIP8_TRACE_WORD_SIZE 8
+#define CHIP8_TRACE_DEFAULT_ENTRIES (1u << 15)  // 256 KB, the last 32768 instructions
+
+// an instruction word, fields that its handler cannot change are 0
+#define CHIP8_TRACE_PACK(pc, opcode, vx, vf, i) \
+    ((uint64_t) (pc) | ((uint64_t) (opcode) << 12) | ((uint64_t) (vx) << 28) | ((uint64_t) (vf) << 36) | ((uint64_t) (i) << 44))
+// marks a word after an Fx65 that holds the registers it loaded, seven per word from V0 on
+#define CHIP8_TRACE_REGISTERS (1ull << 60)
+#define CHIP8_TRACE_REGISTERS_PER_WORD 7
+
+// EXEC_* handlers whose words hold Vx, the ones that write it
+#define CHIP8_TRACE_VX_OPS                                                                                 \
+    ((1ull << EXEC_LOAD_X_BYTE) | (1ull << EXEC_ADD_X_BYTE) | (1ull << EXEC_LOAD_X_Y) | (1ull << EXEC_OR_X_Y) | \
+     (1ull << EXEC_AND_X_Y) | (1ull << EXEC_XOR_X_Y) | (1ull << EXEC_ADD_X_Y) | (1ull << EXEC_SUB_X_Y) |      \
+     (1ull << EXEC_SHR_X) | (1ull << EXEC_SUBN_X_Y) | (1ull << EXEC_SHL_X) | (1ull << EXEC_RANDOM_X_BYTE) |   \
+     (1ull << EXEC_LOAD_X_DT) | (1ull << EXEC_WAIT_FOR_KEY) | (1ull << EXEC_LOAD_REGS_I))
+// whose words hold VF, the ones that can set the flag
+#define CHIP8_TRACE_VF_OPS                                                                                 \
+    ((1ull << EXEC_OR_X_Y) | (1ull << EXEC_AND_X_Y) | (1ull << EXEC_XOR_X_Y) | (1ull << EXEC_ADD_X_Y) |      \
+     (1ull << EXEC_SUB_X_Y) | (1ull << EXEC_SHR_X) | (1ull << EXEC_SUBN_X_Y) | (1ull << EXEC_SHL_X) |         \
+     (1ull << EXEC_DRAW_SPRITE))
+// and whose words hold I, Fx55 and Fx65 move it in some quirk profiles
+#define CHIP8_TRACE_I_OPS                                                                                  \
+    ((1ull << EXEC_LOAD_I_ADDR) | (1ull << EXEC_ADD_I_X) | (1ull << EXEC_LOAD_F_X) | (1ull << EXEC_STORE_REGS_I) | \
+     (1ull << EXEC_LOAD_REGS_I))
+#define CHIP8_TRACE_HAS_VX(op) ((CHIP8_TRACE_VX_OPS >> (op)) & 1)
+#define CHIP8_TRACE_HAS_VF(op) ((CHIP8_TRACE_VF_OPS >> (op)) & 1)
+#define CHIP8_TRACE_HAS_I(op)  ((CHIP8_TRACE_I_OPS >> (op)) & 1)
+
+// an instruction word unpacked, with the register words that followed it
+typedef struct
+{
+    uint16_t pc;      // address of the instruction
+    uint16_t opcode;
+    uint8_t vx;       // V[x] of the opcode after it ran
+    uint8_t vf;       // VF after it ran
+    uint16_t i;       // I after it ran
+    uint8_t loaded[REGISTER_COUNT];  // Fx65: V0..Vx-1 as it loaded them
+} Chip8TraceEntry;
+
+typedef struct Chip8Trace
+{
+    uint64_t* words;          // CHIP8_TRACE_PACK words and register words
+    uint32_t mask;            // capacity - 1, the capacity is a power of two
+    uint64_t recorded;        // every word since the trace was created, the newest is at (recorded - 1) & mask
+    uint64_t register_words;  // the register words among them
+} Chip8Trace;
+
+// a dump read back by chip8_trace_read
+typedef struct
+{
+    uint64_t recorded;            // instructions
+    uint32_t count;               // entries, oldest first
+    uint8_t quirks;
+    uint8_t v[REGISTER_COUNT];
+    uint16_t i;
+    uint16_t pc;
+    Chip8TraceEntry* entries;
+} Chip8TraceDump;
+
+// room for at least entries words (rounded up to a power of two), NULL if out of memory
+Chip8Trace* chip8_trace_create(uint32_t entries);
+void chip8_trace_destroy(Chip8Trace* trace);
+// starts (or with NULL stops) recording into trace, false if the core was built without CHIP8_TRACE
+bool chip8_trace_attach(CHIP8* cpu, Chip8Trace* trace);
+// words currently held, at most the capacity
+uint32_t chip8_trace_count(const Chip8Trace* trace);
+
+// writes the trace and cpu's registers to path; only uses open and write, so it is safe in a signal handler
+bool chip8_trace_dump(const Chip8Trace* trace, const CHIP8* cpu, const char* path);
+// on SIGSEGV, SIGBUS, SIGILL, SIGFPE and SIGABRT, dumps to path before the process dies; NULL trace disarms it
+void chip8_trace_dump_on_crash(const Chip8Trace* trace, const CHIP8* cpu, const char* path);
+
+// false if path is missing or not a trace dump; free the entries with chip8_trace_free_dump
+bool chip8_trace_read(const char* path, Chip8TraceDump* dump);
+void chip8_trace_free_dump(Chip8TraceDump* dump);
+
+#if CHIP8_TRACE
+// an interpreter loop's copy of the ring's position, kept in registers for the whole loop since
+// the handlers' byte stores could otherwise alias it and force a reload after every instruction
+typedef struct
+{
+    Chip8Trace* trace;
+    uint64_t* words;
+    uint32_t mask;
+    uint64_t recorded;
+} Chip8TraceCursor;
+
+static inline Chip8TraceCursor chip8_trace_cursor(Chip8Trace* trace)
+{
+    Chip8TraceCursor cursor = { trace, trace->words, trace->mask, trace->recorded };
+    return cursor;
+}
+
+// the instruction that started at pc has run with handler op; op is a constant in the interpreters,
+// so only the registers its handler can change are read. Always inlined, a call would take the
+// cursor out of registers. The count goes back to the trace every time so a dump from the crash
+// handler has the newest word
+__attribute__((always_inline)) static inline void chip8_trace_record(Chip8TraceCursor* cursor, const CHIP8* cpu, uint16_t pc, uint8_t op, Instruction instruction)
+{
+    uint64_t word = CHIP8_TRACE_PACK(pc & (SIZE_4KB - 1), ((uint32_t) instruction.type << 12) | instruction.nnn, 0, 0, 0);
+    if (CHIP8_TRACE_HAS_VX(op)) { word |= CHIP8_TRACE_PACK(0, 0, cpu->v[instruction.x], 0, 0); }
+    if (CHIP8_TRACE_HAS_VF(op)) { word |= CHIP8_TRACE_PACK(0, 0, 0, cpu->v[0xF], 0); }
+    if (CHIP8_TRACE_HAS_I(op)) { word |= CHIP8_TRACE_PACK(0, 0, 0, 0, cpu->i); }
+    cursor->words[cursor->recorded++ & cursor->mask] = word;
+    if (op == EXEC_LOAD_REGS_I)
+    {
+        for (uint8_t first = 0; first < instruction.x; first += CHIP8_TRACE_REGISTERS_PER_WORD)
+        {
+            uint64_t registers = CHIP8_TRACE_REGISTERS;
+            for (uint8_t k = 0; k < CHIP8_TRACE_REGISTERS_PER_WORD && first + k < instruction.x; ++k)
+            {
+                registers |= (uint64_t) cpu->v[first + k] << (k * 8);
+            }
+            cursor->words[cursor->recorded++ & cursor->mask] = registers;
+            cursor->trace->register_words++;
+        }
+    }
+    cursor->trace->recorded = cursor->recorded;
+}
+#endif
+#endif
@@ -0,0 +1,294 @@
+#include "chip8_video.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#if CHIP8_VIDEO_HAS_SSE2
+#include <emmintrin.h>
+#endif
+#if CHIP8_VIDEO_HAS_AVX2
+#include <immintrin.h>
+#endif
+
+#define ALPHA 0xFF000000u
+
+typedef struct
+{
+    const char* name;
+    uint32_t off;
+    uint32_t on;
+} Palette;
+
+#define CHIP8_PALETTE_ENTRY(name, off, on) { name, off, on },
+static const Palette palettes[] = { CHIP8_PALETTES(CHIP8_PALETTE_ENTRY) };
+#undef CHIP8_PALETTE_ENTRY
+
+bool chip8_parse_palette(const char* name, uint32_t* off, uint32_t* on)
+{
+    for (size_t k = 0; k < sizeof(palettes) / sizeof(palettes[0]); ++k)
+    {
+        if (strcmp(name, palettes[k].name) != 0) { continue; }
+        *off = palettes[k].off;
+        *on = palettes[k].on;
+        return true;
+    }
+
+    // custom colors, off:on as hex RGB
+    char* end;
+    unsigned long parsed_off = strtoul(name, &end, 16);
+    if (end != name + 6 || *end != ':') { return false; }
+    const char* second = end + 1;
+    unsigned long parsed_on = strtoul(second, &end, 16);
+    if (end != second + 6 || *end != '\0') { return false; }
+    *off = ALPHA | (uint32_t) parsed_off;
+    *on = ALPHA | (uint32_t) parsed_on;
+    return true;
+}
+
+// the color `level` of the way from off to on, per channel and rounded
+static uint32_t mix(uint32_t off, uint32_t on, uint32_t level)
+{
+    uint32_t color = ALPHA;
+    for (int shift = 0; shift < 24; shift += 8)
+    {
+        uint32_t from = (off >> shift) & 0xFF;
+        uint32_t to = (on >> shift) & 0xFF;
+        color |= ((from * (255 - level) + to * level + 127) / 255) << shift;
+    }
+    return color;
+}
+
+static uint8_t best_simd(void)
+{
+#if CHIP8_VIDEO_HAS_AVX2
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) { return CHIP8_VIDEO_AVX2; }
+#endif
+#if CHIP8_VIDEO_HAS_SSE2
+    return CHIP8_VIDEO_SSE2;
+#else
+    return CHIP8_VIDEO_SCALAR;
+#endif
+}
+
+bool chip8_video_init(Chip8Video* video, uint32_t scale, uint32_t off, uint32_t on, uint8_t decay)
+{
+    if (scale == 0 || scale > CHIP8_VIDEO_MAX_SCALE) { return false; }
+    for (uint32_t level = 0; level < 256; ++level)
+    {
+        video->ramp[level] = mix(off, on, level);
+    }
+    memset(video->intensity, 0, sizeof(video->intensity));
+    video->scale = scale;
+    video->decay = decay;
+    video->simd = best_simd();
+    return true;
+}
+
+/*
+ *  Phosphor
+ */
+
+static bool update_scalar(Chip8Video* video, const uint64_t display[DISPLAY_HEIGHT])
+{
+    uint32_t fading = 0;
+    uint8_t* intensity = video->intensity;
+    for (int y = 0; y < DISPLAY_HEIGHT; ++y)
+    {
+        uint64_t row = display[y];
+        for (int x = 0; x < DISPLAY_WIDTH; ++x, ++intensity)
+        {
+            if ((row >> (DISPLAY_WIDTH - 1 - x)) & 1)
+            {
+                *intensity = 255;
+                continue;
+            }
+            *intensity = (uint8_t) ((*intensity * video->decay) >> 8);
+            fading |= *intensity;
+        }
+    }
+    return fading != 0;
+}
+
+#if CHIP8_VIDEO_HAS_SSE2
+// 0xFF for every lit pixel of 16, x = 0 is bit 15
+static inline __m128i lit_mask_sse2(uint32_t bits)
+{
+    // the first byte to the low 8 lanes, the second to the high 8, then one bit per lane
+    __m128i lanes = _mm_cvtsi32_si128((int) ((bits >> 8) | ((bits & 0xFF) << 8)));
+    lanes = _mm_unpacklo_epi8(lanes, lanes);
+    lanes = _mm_unpacklo_epi16(lanes, lanes);
+    lanes = _mm_unpacklo_epi32(lanes, lanes);
+    const __m128i select = _mm_setr_epi8((char) 0x80, 0x40, 0x20, 0x10, 0x08, 0x04, 0x02, 0x01,
+                                         (char) 0x80, 0x40, 0x20, 0x10, 0x08, 0x04, 0x02, 0x01);
+    return _mm_cmpeq_epi8(_mm_and_si128(lanes, select), select);
+}
+
+static bool update_sse2(Chip8Video* video, const uint64_t display[DISPLAY_HEIGHT])
+{
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i decay = _mm_set1_epi16(video->decay);
+    __m128i fading = zero;
+    uint8_t* intensity = video->intensity;
+    for (int y = 0; y < DISPLAY_HEIGHT; ++y)
+    {
+        for (int chunk = 0; chunk < DISPLAY_WIDTH / 16; ++chunk, intensity += 16)
+        {
+            __m128i lit = lit_mask_sse2((uint32_t) (display[y] >> (48 - chunk * 16)) & 0xFFFF);
+            __m128i old = _mm_loadu_si128((const __m128i*) intensity);
+            __m128i low = _mm_srli_epi16(_mm_mullo_epi16(_mm_unpacklo_epi8(old, zero), decay), 8);
+            __m128i high = _mm_srli_epi16(_mm_mullo_epi16(_mm_unpackhi_epi8(old, zero), decay), 8);
+            __m128i faded = _mm_andnot_si128(lit, _mm_packus_epi16(low, high));
+            fading = _mm_or_si128(fading, faded);
+            _mm_storeu_si128((__m128i*) intensity, _mm_or_si128(faded, lit));
+        }
+    }
+    return _mm_movemask_epi8(_mm_cmpeq_epi8(fading, zero)) != 0xFFFF;
+}
+#endif
+
+#if CHIP8_VIDEO_HAS_AVX2
+__attribute__((target("avx2")))
+static bool update_avx2(Chip8Video* video, const uint64_t display[DISPLAY_HEIGHT])
+{
+    const __m256i zero = _mm256_setzero_si256();
+    const __m256i decay = _mm256_set1_epi16(video->decay);
+    // byte k of the 32 pixels (big-endian, x = 0 first) to lanes 8k..8k+7, within each 128-bit half
+    const __m256i spread = _mm256_setr_epi8(3, 3, 3, 3, 3, 3, 3, 3, 2, 2, 2, 2, 2, 2, 2, 2,
+                                            1, 1, 1, 1, 1, 1, 1, 1, 0, 0, 0, 0, 0, 0, 0, 0);
+    const __m256i select = _mm256_set1_epi64x((long long) 0x0102040810204080ull);
+    __m256i fading = zero;
+    uint8_t* intensity = video->intensity;
+    for (int y = 0; y < DISPLAY_HEIGHT; ++y)
+    {
+        for (int chunk = 0; chunk < DISPLAY_WIDTH / 32; ++chunk, intensity += 32)
+        {
+            __m256i bits = _mm256_set1_epi32((int) (uint32_t) (display[y] >> (32 - chunk * 32)));
+            __m256i lit = _mm256_cmpeq_epi8(_mm256_and_si256(_mm256_shuffle_epi8(bits, spread), select), select);
+            __m256i old = _mm256_loadu_si256((const __m256i*) intensity);
+            // unpack and pack both work per 128-bit half, so the pixel order survives the round trip
+            __m256i low = _mm256_srli_epi16(_mm256_mullo_epi16(_mm256_unpacklo_epi8(old, zero), decay), 8);
+            __m256i high = _mm256_srli_epi16(_mm256_mullo_epi16(_mm256_unpackhi_epi8(old, zero), decay), 8);
+            __m256i faded = _mm256_andnot_si256(lit, _mm256_packus_epi16(low, high));
+            fading = _mm256_or_si256(fading, faded);
+            _mm256_storeu_si256((__m256i*) intensity, _mm256_or_si256(faded, lit));
+        }
+    }
+    return !_mm256_testz_si256(fading, fading);
+}
+#endif
+
+bool chip8_video_update(Chip8Video* video, const uint64_t display[DISPLAY_HEIGHT])
+{
+    switch (video->simd)
+    {
+#if CHIP8_VIDEO_HAS_AVX2
+        case CHIP8_VIDEO_AVX2: return update_avx2(video, display);
+#endif
+#if CHIP8_VIDEO_HAS_SSE2
+        case CHIP8_VIDEO_SSE2: return update_sse2(video, display);
+#endif
+        default: return update_scalar(video, display);
+    }
+}
+
+/*
+ *  Expansion: the first output row of every source row is written pixel
+ *  span by pixel span, the other scale - 1 rows are copies of it.
+ */
+
+static inline uint32_t* output_row(void* pixels, size_t pitch, uint32_t row)
+{
+    return (uint32_t*) ((uint8_t*) pixels + row * pitch);
+}
+
+static void repeat_row(void* pixels, size_t pitch, uint32_t row, uint32_t scale)
+{
+    size_t bytes = (size_t) DISPLAY_WIDTH * scale * sizeof(uint32_t);
+    for (uint32_t copy = 1; copy < scale; ++copy)
+    {
+        memcpy(output_row(pixels, pitch, row + copy), output_row(pixels, pitch, row), bytes);
+    }
+}
+
+static void expand_scalar(const Chip8Video* video, void* pixels, size_t pitch)
+{
+    uint32_t scale = video->scale;
+    const uint8_t* intensity = video->intensity;
+    for (uint32_t y = 0; y < DISPLAY_HEIGHT; ++y)
+    {
+        uint32_t* out = output_row(pixels, pitch, y * scale);
+        for (int x = 0; x < DISPLAY_WIDTH; ++x)
+        {
+            uint32_t color = video->ramp[*intensity++];
+            for (uint32_t k = 0; k < scale; ++k) { *out++ = color; }
+        }
+        repeat_row(pixels, pitch, y * scale, scale);
+    }
+}
+
+#if CHIP8_VIDEO_HAS_SSE2
+static void expand_sse2(const Chip8Video* video, void* pixels, size_t pitch)
+{
+    uint32_t scale = video->scale;
+    if (scale < 4)
+    {
+        expand_scalar(video, pixels, pitch);
+        return;
+    }
+    const uint8_t* intensity = video->intensity;
+    for (uint32_t y = 0; y < DISPLAY_HEIGHT; ++y)
+    {
+        uint32_t* out = output_row(pixels, pitch, y * scale);
+        for (int x = 0; x < DISPLAY_WIDTH; ++x, out += scale)
+        {
+            __m128i color = _mm_set1_epi32((int) video->ramp[*intensity++]);
+            uint32_t k = 0;
+            for (; k + 4 <= scale; k += 4) { _mm_storeu_si128((__m128i*) (out + k), color); }
+            // the last store overlaps the one before, both write the same color
+            if (k < scale) { _mm_storeu_si128((__m128i*) (out + scale - 4), color); }
+        }
+        repeat_row(pixels, pitch, y * scale, scale);
+    }
+}
+#endif
+
+#if CHIP8_VIDEO_HAS_AVX2
+__attribute__((target("avx2")))
+static void expand_avx2(const Chip8Video* video, void* pixels, size_t pitch)
+{
+    uint32_t scale = video->scale;
+    if (scale < 8)
+    {
+        expand_sse2(video, pixels, pitch);
+        return;
+    }
+    const uint8_t* intensity = video->intensity;
+    for (uint32_t y = 0; y < DISPLAY_HEIGHT; ++y)
+    {
+        uint32_t* out = output_row(pixels, pitch, y * scale);
+        for (int x = 0; x < DISPLAY_WIDTH; ++x, out += scale)
+        {
+            __m256i color = _mm256_set1_epi32((int) video->ramp[*intensity++]);
+            uint32_t k = 0;
+            for (; k + 8 <= scale; k += 8) { _mm256_storeu_si256((__m256i*) (out + k), color); }
+            if (k < scale) { _mm256_storeu_si256((__m256i*) (out + scale - 8), color); }
+        }
+        repeat_row(pixels, pitch, y * scale, scale);
+    }
+}
+#endif
+
+void chip8_video_expand(const Chip8Video* video, void* pixels, size_t pitch)
+{
+    switch (video->simd)
+    {
+#if CHIP8_VIDEO_HAS_AVX2
+        case CHIP8_VIDEO_AVX2: expand_avx2(video, pixels, pitch); return;
+#endif
+#if CHIP8_VIDEO_HAS_SSE2
+        case CHIP8_VIDEO_SSE2: expand_sse2(video, pixels, pitch); return;
+#endif
+        default: expand_scalar(video, pixels, pitch); return;
+    }
+}
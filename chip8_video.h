@@ -0,0 +1,72 @@
+#ifndef CHIP8_VIDEO_H
+#define CHIP8_VIDEO_H
+
+#include "chip8.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ *  Display upscaler: expands the packed 64x32 display to ARGB8888 pixels at
+ *  any integer scale, for a streaming texture or a captured frame.
+ *
+ *  Every pixel has a phosphor intensity, 255 while it is lit. Once it goes
+ *  dark it keeps decay/256 of its intensity per frame, so a sprite that is
+ *  erased and redrawn with XOR glows on instead of flickering. A decay of 0
+ *  shows every frame as it is. The color of each intensity is precomputed
+ *  along the palette, so expanding is a table lookup per source pixel
+ *  followed by wide stores.
+ *
+ *  SSE2 and AVX2 versions are picked at runtime on x86-64, other hosts use
+ *  the scalar one; all of them give identical pixels.
+ */
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__SSE2__)
+#define CHIP8_VIDEO_HAS_SSE2 1
+#else
+#define CHIP8_VIDEO_HAS_SSE2 0
+#endif
+
+// AVX2 is compiled per function with a target attribute, so the build itself needs no -mavx2
+#if CHIP8_VIDEO_HAS_SSE2 && (defined(__GNUC__) || defined(__clang__))
+#define CHIP8_VIDEO_HAS_AVX2 1
+#else
+#define CHIP8_VIDEO_HAS_AVX2 0
+#endif
+
+// Chip8Video.simd
+#define CHIP8_VIDEO_SCALAR 0
+#define CHIP8_VIDEO_SSE2   1
+#define CHIP8_VIDEO_AVX2   2
+
+#define CHIP8_VIDEO_MAX_SCALE 64
+
+// name, off color, on color (ARGB8888)
+#define CHIP8_PALETTES(PALETTE)                          \
+    PALETTE("mono",   0xFF000000, 0xFFFFFFFF)             \
+    PALETTE("amber",  0xFF140A00, 0xFFFFB000)             \
+    PALETTE("green",  0xFF001405, 0xFF33FF66)             \
+    PALETTE("lcd",    0xFF9BBC0F, 0xFF0F380F)             \
+    PALETTE("blue",   0xFF0A1030, 0xFF8CC8FF)             \
+    PALETTE("paper",  0xFFF4F0E6, 0xFF202020)
+
+typedef struct
+{
+    uint32_t ramp[256];               // ARGB for every intensity, 0 is the off color and 255 the on color
+    uint8_t intensity[DISPLAY_SIZE];  // phosphor per source pixel, row major
+    uint32_t scale;                   // output pixels per source pixel in each direction
+    uint8_t decay;                    // intensity kept per frame out of 256, 0 for no phosphor
+    uint8_t simd;                     // CHIP8_VIDEO_*, the best the host has after init, lower it to compare
+} Chip8Video;
+
+// false if scale is 0 or above CHIP8_VIDEO_MAX_SCALE
+bool chip8_video_init(Chip8Video* video, uint32_t scale, uint32_t off, uint32_t on, uint8_t decay);
+// off and on for a palette name from CHIP8_PALETTES, or for "RRGGBB:RRGGBB"; false for anything else
+bool chip8_parse_palette(const char* name, uint32_t* off, uint32_t* on);
+
+// advances the phosphor by one frame that shows display, true while some dark pixel is still fading
+bool chip8_video_update(Chip8Video* video, const uint64_t display[DISPLAY_HEIGHT]);
+// writes DISPLAY_WIDTH * scale by DISPLAY_HEIGHT * scale pixels, pitch is in bytes
+void chip8_video_expand(const Chip8Video* video, void* pixels, size_t pitch);
+#endif
@@ -1,14 +1,124 @@
 #include "chip8.h"
+#include "chip8_trace.h"
+#include "chip8_video.h"
+#include "sdl_frontend.h"
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
 
 int main(int argc, const char* argv[])
 {
-    if (argc != 2)
+    Chip8FrontendOptions options = { NULL, CPU_HERTZ, false, TURBO_PRESENT_EVERY, NULL, NULL, CHIP8_TRACE_DEFAULT_ENTRIES, false, NULL, 0, SCALE, PIXEL_OFF, PIXEL_ON, 0 };
+    bool seeded = false;
+    uint32_t seed = 0;
+    const char* quirks_name = NULL;
+    const char* timing_name = NULL;
+    bool hertz_set = false;
+    uint32_t phosphor = 0;
+
+    for (int arg = 1; arg < argc; ++arg)
+    {
+        if (strcmp(argv[arg], "--seed") == 0 && arg + 1 < argc)
+        {
+            seed = (uint32_t) strtoul(argv[++arg], NULL, 0);
+            seeded = true;
+        }
+        else if (strcmp(argv[arg], "--hz") == 0 && arg + 1 < argc)
+        {
+            options.cpu_hertz = (uint32_t) strtoul(argv[++arg], NULL, 10);
+            hertz_set = true;
+        }
+        else if (strcmp(argv[arg], "--turbo") == 0)
+        {
+            options.turbo = true;
+        }
+        else if (strcmp(argv[arg], "--frame-skip") == 0 && arg + 1 < argc)
+        {
+            options.turbo_present_every = (uint32_t) strtoul(argv[++arg], NULL, 10);
+        }
+        else if (strcmp(argv[arg], "--profile") == 0 && arg + 1 < argc)
+        {
+            options.profile_path = argv[++arg];
+        }
+        else if (strcmp(argv[arg], "--trace") == 0 && arg + 1 < argc)
+        {
+            options.trace_path = argv[++arg];
+        }
+        else if (strcmp(argv[arg], "--trace-entries") == 0 && arg + 1 < argc)
+        {
+            options.trace_entries = (uint32_t) strtoul(argv[++arg], NULL, 10);
+        }
+        else if (strcmp(argv[arg], "--quirks") == 0 && arg + 1 < argc)
+        {
+            quirks_name = argv[++arg];
+        }
+        else if (strcmp(argv[arg], "--timing") == 0 && arg + 1 < argc)
+        {
+            timing_name = argv[++arg];
+        }
+        else if (strcmp(argv[arg], "--debug") == 0 && arg + 1 < argc)
+        {
+            options.debug_socket = argv[++arg];
+        }
+        else if (strcmp(argv[arg], "--run-ahead") == 0 && arg + 1 < argc)
+        {
+            options.run_ahead = (uint32_t) strtoul(argv[++arg], NULL, 10);
+        }
+        else if (strcmp(argv[arg], "--scale") == 0 && arg + 1 < argc)
+        {
+            options.scale = (uint32_t) strtoul(argv[++arg], NULL, 10);
+        }
+        else if (strcmp(argv[arg], "--palette") == 0 && arg + 1 < argc)
+        {
+            if (!chip8_parse_palette(argv[++arg], &options.palette_off, &options.palette_on))
+            {
+                printf("CHIP8: unknown palette %s, use mono, amber, green, lcd, blue, paper or RRGGBB:RRGGBB\n", argv[arg]);
+                return 1;
+            }
+        }
+        else if (strcmp(argv[arg], "--phosphor") == 0 && arg + 1 < argc)
+        {
+            phosphor = (uint32_t) strtoul(argv[++arg], NULL, 10);
+        }
+        else if (strcmp(argv[arg], "--stats") == 0)
+        {
+            options.show_stats = true;
+        }
+        else if (argv[arg][0] != '-' && options.rom_path == NULL)
+        {
+            options.rom_path = argv[arg];
+        }
+        else
+        {
+            options.rom_path = NULL;
+            break;
+        }
+    }
+    if (options.rom_path == NULL || options.cpu_hertz == 0 || options.run_ahead > MAX_RUN_AHEAD || phosphor > 255 ||
+        options.scale == 0 || options.scale > CHIP8_VIDEO_MAX_SCALE || options.trace_entries == 0)
     {
-        printf("Usage: %s <path-to-game-rom>\n make sure its a .ch8", argv[0]);
+        printf("Usage: %s <path-to-game-rom> [--seed N] [--quirks legacy|vip|chip48|schip] [--timing cycles|vip|host] [--hz N] [--turbo] [--frame-skip N] [--profile FILE] [--trace FILE] [--trace-entries N] [--stats] [--debug SOCKET] [--run-ahead 0-4] [--scale N] [--palette NAME] [--phosphor 0-255]\n make sure its a .ch8", argv[0]);
+        return 1;
     }
+    options.phosphor = (uint8_t) phosphor;
+
     CHIP8 cpu;
     chip8_init(&cpu);
-    load_rom(&cpu, argv[1]);
-    chip8_run(&cpu);
+    // without --seed every run is different, as before
+    if (seeded) { chip8_seed(&cpu, seed); }
+    if (!load_rom(&cpu, options.rom_path)) { return 1; }
+    // an explicit profile wins over the one load_rom picked from its table
+    if (quirks_name != NULL && !chip8_parse_quirks(quirks_name, &cpu.quirks))
+    {
+        printf("CHIP8: unknown quirk profile %s, use legacy, vip, chip48 or schip\n", quirks_name);
+        return 1;
+    }
+    if (timing_name != NULL && !chip8_parse_timing(timing_name, &cpu))
+    {
+        printf("CHIP8: unknown timing %s, use cycles, vip or host\n", timing_name);
+        return 1;
+    }
+    // --hz sets the clock of whichever model runs, without it the model picks its own
+    if (!hertz_set) { options.cpu_hertz = cpu.hertz; }
+    chip8_run(&cpu, &options);
 }
@@ -0,0 +1,70 @@
+#include "sdl_beeper.h"
+
+#include <SDL2/SDL.h>
+#include <stdio.h>
+
+static void beeper_callback(void* user_data, Uint8* stream, int length)
+{
+    Beeper* beeper = user_data;
+    int16_t* samples = (int16_t*) stream;
+    int count = length / (int) sizeof(int16_t);
+
+    for (int k = 0; k < count; ++k)
+    {
+        // checked per sample, the tone switches on the first sample after the timer changes
+        if (!atomic_load_explicit(&beeper->on, memory_order_relaxed))
+        {
+            // every beep starts at the same point of the wave, no clicks from a random phase
+            beeper->phase = 0;
+            samples[k] = 0;
+            continue;
+        }
+        samples[k] = (beeper->phase & 0x80000000u) ? -BEEPER_AMPLITUDE : BEEPER_AMPLITUDE;
+        beeper->phase += beeper->phase_step;
+    }
+}
+
+bool beeper_open(Beeper* beeper)
+{
+    beeper->device = 0;
+    beeper->phase = 0;
+    beeper->phase_step = (uint32_t) (((uint64_t) BEEPER_TONE_HERTZ << 32) / BEEPER_SAMPLE_RATE);
+    atomic_init(&beeper->on, false);
+
+    if (SDL_InitSubSystem(SDL_INIT_AUDIO) != 0)
+    {
+        printf("CHIP8: no audio, %s\n", SDL_GetError());
+        return false;
+    }
+
+    SDL_AudioSpec wanted;
+    SDL_zero(wanted);
+    wanted.freq = BEEPER_SAMPLE_RATE;
+    wanted.format = AUDIO_S16SYS;
+    wanted.channels = 1;
+    wanted.samples = BEEPER_BUFFER_SAMPLES;
+    wanted.callback = beeper_callback;
+    wanted.userdata = beeper;
+
+    // the device converts rate and channels for us, the callback always writes mono S16 at 44.1 kHz
+    beeper->device = SDL_OpenAudioDevice(NULL, 0, &wanted, NULL, 0);
+    if (beeper->device == 0)
+    {
+        printf("CHIP8: could not open the audio device, %s\n", SDL_GetError());
+        return false;
+    }
+    SDL_PauseAudioDevice(beeper->device, 0);
+    return true;
+}
+
+void beeper_set(Beeper* beeper, bool on)
+{
+    atomic_store_explicit(&beeper->on, on, memory_order_relaxed);
+}
+
+void beeper_close(Beeper* beeper)
+{
+    if (beeper->device == 0) { return; }
+    SDL_CloseAudioDevice(beeper->device);
+    beeper->device = 0;
+}
@@ -0,0 +1,34 @@
+#ifndef SDL_BEEPER_H
+#define SDL_BEEPER_H
+
+#include <SDL2/SDL_audio.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+/*
+ *  Beeper: a square wave synthesized in the SDL audio callback. The
+ *  emulation loop only flips `on`, the callback reads it for every sample,
+ *  so there is no lock and no WAV file, and the tone starts and stops
+ *  within one small device buffer.
+ */
+
+#define BEEPER_SAMPLE_RATE 44100
+#define BEEPER_BUFFER_SAMPLES 256   // about 6 ms of latency
+#define BEEPER_TONE_HERTZ 440
+#define BEEPER_AMPLITUDE 3000       // of 32767, a beep should not be loud
+
+typedef struct
+{
+    SDL_AudioDeviceID device;   // 0 when no audio device could be opened
+    atomic_bool on;             // written by the emulation loop, read by the audio thread
+    uint32_t phase;             // audio thread only
+    uint32_t phase_step;        // phase increment per sample, 2^32 is one period
+} Beeper;
+
+// opens the default audio device and starts it silent, false (and a silent beeper) if there is none
+bool beeper_open(Beeper* beeper);
+// lock-free, call once per frame with sound_timer > 0
+void beeper_set(Beeper* beeper, bool on);
+void beeper_close(Beeper* beeper);
+#endif
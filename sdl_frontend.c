@@ -0,0 +1,620 @@
+#include "sdl_frontend.h"
+#include "chip8_debug.h"
+#include "chip8_handoff.h"
+#include "chip8_profile.h"
+#include "chip8_state.h"
+#include "chip8_trace.h"
+#include "chip8_video.h"
+#include "sdl_beeper.h"
+
+#include <SDL2/SDL_error.h>
+#include <SDL2/SDL_events.h>
+#include <SDL2/SDL_log.h>
+#include <SDL2/SDL_mutex.h>
+#include <SDL2/SDL_render.h>
+#include <SDL2/SDL_thread.h>
+#include <SDL2/SDL_timer.h>
+#include <SDL2/SDL_video.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <SDL2/SDL.h>
+
+#define REWIND_BYTES (4 * 1024 * 1024) // minutes of history for typical ROMs
+
+#define CPU_HERTZ_STEP 100        // - and = change the clock by this much
+#define MIN_CPU_HERTZ 100
+#define MAX_CPU_HERTZ 100000
+#define MAX_CATCH_UP_FRAMES 4
+
+SDL_Texture* create_display_texture(SDL_Renderer* renderer, uint32_t scale)
+{
+    return SDL_CreateTexture(renderer, SDL_PIXELFORMAT_ARGB8888, SDL_TEXTUREACCESS_STREAMING, DISPLAY_WIDTH * scale, DISPLAY_HEIGHT * scale);
+}
+
+void render(const Chip8Video* video, SDL_Renderer* renderer, SDL_Texture* texture)
+{
+    void* pixels;
+    int pitch;
+    if (SDL_LockTexture(texture, NULL, &pixels, &pitch) != 0) { return; }
+
+    // the upscaled, colored frame goes straight into the texture
+    chip8_video_expand(video, pixels, (size_t) pitch);
+    SDL_UnlockTexture(texture);
+
+    // the texture already has the window's size, so this copy does no filtering
+    SDL_RenderCopy(renderer, texture, NULL, NULL);
+    SDL_RenderPresent(renderer);
+}
+
+// the window only sends key changes, so a restored machine keeps the keys held now: one held in the
+// saved frame but released since would otherwise stay down until it is pressed again
+static void restore_keypad(CHIP8* cpu, const uint8_t held[16])
+{
+    memcpy(cpu->keypad, held, sizeof(cpu->keypad));
+}
+
+// one 60 Hz frame, the core ticks the timers at its end; returns the cycles run
+static uint32_t run_frame(CHIP8* cpu, Chip8Rewind* rewind, bool rewinding, Beeper* beeper, Chip8Debugger* debugger)
+{
+    if (rewinding && rewind)
+    {
+        uint8_t held[16];
+        memcpy(held, cpu->keypad, sizeof(held));
+        chip8_rewind_step_back(rewind, cpu);
+        restore_keypad(cpu, held);
+        beeper_set(beeper, false);
+        return 0;
+    }
+
+    uint32_t cycles;
+    // breakpoints and watchpoints need the instrumented loop, and no idle skipping past them
+    if (debugger && chip8_debug_active(debugger))
+    {
+        cycles = chip8_debug_run_cycles(debugger, cpu, chip8_cycles_to_tick(cpu));
+        if (chip8_debug_paused(debugger))
+        {
+            beeper_set(beeper, false);
+            return cycles;
+        }
+    }
+    else
+    {
+        cycles = chip8_run_frame(cpu);
+    }
+
+    if (rewind) { chip8_rewind_capture(rewind, cpu); }
+    // the tone lasts exactly as long as the timer runs
+    beeper_set(beeper, cpu->sound_timer > 0);
+    return cycles;
+}
+
+// live numbers for the window title (--stats), collected over one second at a time
+typedef struct
+{
+    uint64_t window_start;  // performance counter
+    uint64_t cycles;
+    uint32_t frames;
+    uint64_t ns_total;
+    uint64_t ns_max;
+    char text[96];          // the last full second, empty until there is one
+} FrameStats;
+
+// host time the emulation thread spent on a batch of frames, split evenly over them
+static void record_frames(FrameStats* stats, Chip8Profile* profile, uint32_t frames, uint64_t cycles, uint64_t ns)
+{
+    if (frames == 0) { return; }
+    uint64_t frame_ns = ns / frames;
+    for (uint32_t frame = 0; profile && frame < frames; ++frame)
+    {
+        chip8_profile_frame(profile, frame_ns);
+    }
+    stats->frames += frames;
+    stats->cycles += cycles;
+    stats->ns_total += ns;
+    if (frame_ns > stats->ns_max) { stats->ns_max = frame_ns; }
+}
+
+// closes the current one-second window, true when there is new text for the title
+static bool roll_stats(FrameStats* stats, uint64_t now, uint64_t frequency)
+{
+    uint64_t elapsed = now - stats->window_start;
+    if (elapsed < frequency) { return false; }
+
+    double seconds = (double) elapsed / (double) frequency;
+    double average_ms = (stats->frames > 0) ? (double) stats->ns_total / stats->frames / 1e6 : 0.0;
+    snprintf(stats->text, sizeof(stats->text), " | %.0f ips, %.0f fps, frame %.2f ms avg %.2f ms max",
+             (double) stats->cycles / seconds, stats->frames / seconds, average_ms, (double) stats->ns_max / 1e6);
+
+    uint64_t window_start = now;
+    memset(stats, 0, offsetof(FrameStats, text));
+    stats->window_start = window_start;
+    return true;
+}
+
+static void update_title(SDL_Window* window, uint32_t hertz, bool turbo, const char* stats)
+{
+    char title[160];
+    snprintf(title, sizeof(title), "CHIP8 - %u Hz%s%s", hertz, turbo ? " (turbo)" : "", stats);
+    SDL_SetWindowTitle(window, title);
+}
+
+// what the emulation thread hands to the window, one of the three triple buffer slots
+typedef struct
+{
+    uint64_t display[DISPLAY_HEIGHT];
+    char stats[96];  // FrameStats text when the frame was published
+} FrontendFrame;
+
+// window -> emulation commands, they share the queue with the keypad changes
+enum
+{
+    INPUT_REWIND = CHIP8_INPUT_USER,  // value 1 while backspace is held
+    INPUT_SAVE_STATE,
+    INPUT_LOAD_STATE,
+    INPUT_TURBO,                      // value 1 for unthrottled
+    INPUT_HERTZ,                      // value is the new clock
+    INPUT_DUMP_TRACE,
+};
+
+// shared by the two threads, everything else belongs to one of them
+typedef struct
+{
+    CHIP8* cpu;                        // emulation thread only once it runs
+    const Chip8FrontendOptions* options;
+    const char* state_path;
+    Beeper* beeper;
+    Chip8Rewind* rewind;
+    Chip8Profile* profile;
+    Chip8Trace* trace;                 // NULL without --trace
+    Chip8Debugger* debugger;           // NULL without --debug
+    Chip8DebugServer* debug_server;
+
+    atomic_bool running;
+    Chip8InputQueue input;             // window -> emulation
+    SDL_sem* wake;                     // posted after every input, the emulation thread sleeps on it
+    Chip8TripleBuffer frames;          // emulation -> window
+    FrontendFrame frame_slots[3];
+    uint64_t published[DISPLAY_HEIGHT];  // emulation thread: the display last handed to the window
+    CHIP8* ahead;                      // --run-ahead: the throwaway copy that runs ahead, NULL otherwise
+    uint32_t frame_event;              // pushed when a frame is published to a window that is waiting for one
+} Frontend;
+
+static void send_input(Frontend* frontend, uint32_t type, uint32_t value)
+{
+    // full only if the emulation thread stopped draining, then the input is dropped
+    if (chip8_input_push(&frontend->input, type, value)) { SDL_SemPost(frontend->wake); }
+}
+
+// hands the display to the window if it changed, or if there are new stats for the title
+static void publish_display(Frontend* frontend, const uint64_t display[DISPLAY_HEIGHT], bool changed, const FrameStats* stats, bool stats_changed)
+{
+    if (!changed && !stats_changed) { return; }
+
+    FrontendFrame* frame = &frontend->frame_slots[chip8_triple_back(&frontend->frames)];
+    memcpy(frame->display, display, sizeof(frame->display));
+    memcpy(frame->stats, stats->text, sizeof(frame->stats));
+    if (changed) { memcpy(frontend->published, display, sizeof(frontend->published)); }
+
+    // a window that took every frame so far is asleep in SDL_WaitEvent
+    if (chip8_triple_publish(&frontend->frames))
+    {
+        SDL_Event event;
+        SDL_zero(event);
+        event.type = frontend->frame_event;
+        SDL_PushEvent(&event);
+    }
+}
+
+static void publish_frame(Frontend* frontend, const FrameStats* stats, bool stats_changed)
+{
+    CHIP8* cpu = frontend->cpu;
+    publish_display(frontend, cpu->display, cpu->display_dirty, stats, stats_changed);
+    if (cpu->display_dirty || stats_changed) { cpu->display_dirty = 0; }
+}
+
+// --run-ahead: a copy of the machine runs `frames` more frames with the keys held now and the window shows
+// where it ends up, so a key press reaches the screen that many frames sooner. The real machine never runs
+// the speculative frames, its next frame starts from where it was with whatever keys are held by then.
+static void publish_ahead(Frontend* frontend, uint32_t frames, const FrameStats* stats, bool stats_changed)
+{
+    CHIP8* ahead = frontend->ahead;
+    // the clock is a copy too, the real machine's cycle pattern does not move
+    chip8_copy_state(ahead, frontend->cpu);
+    for (uint32_t frame = 0; frame < frames; ++frame) { chip8_run_frame(ahead); }
+    // the copy's dirty flag says nothing about what the window shows, so compare with that
+    bool changed = memcmp(ahead->display, frontend->published, sizeof(frontend->published)) != 0;
+    publish_display(frontend, ahead->display, changed, stats, stats_changed);
+}
+
+// the machine, its clock and its audio; never waits for the window
+static int emulation_thread(void* data)
+{
+    Frontend* frontend = data;
+    CHIP8* cpu = frontend->cpu;
+    const Chip8FrontendOptions* options = frontend->options;
+    bool rewinding = false;
+    bool turbo = options->turbo;
+    uint32_t present_every = (options->turbo_present_every > 0) ? options->turbo_present_every : 1;
+
+    FrameStats stats;
+    memset(&stats, 0, sizeof(stats));
+
+    // a frame is due every `frequency` units of lag, lag counts counter ticks times TIMER_HERTZ so 60 Hz stays exact
+    uint64_t frequency = SDL_GetPerformanceFrequency();
+    uint64_t previous = SDL_GetPerformanceCounter();
+    uint64_t lag = 0;
+    stats.window_start = previous;
+
+    while (atomic_load(&frontend->running))
+    {
+        // everything the window sent since the last frame, so input is at most one frame late
+        Chip8Input input;
+        while (chip8_input_pop(&frontend->input, &input))
+        {
+            if (chip8_input_apply(cpu, &input)) { continue; }
+            switch (input.type)
+            {
+                case INPUT_REWIND: rewinding = input.value; break;
+                case INPUT_SAVE_STATE:
+                    if (chip8_save_state(cpu, frontend->state_path)) { printf("saved state to %s\n", frontend->state_path); }
+                    break;
+                case INPUT_LOAD_STATE:
+                {
+                    uint8_t held[16];
+                    memcpy(held, cpu->keypad, sizeof(held));
+                    if (chip8_load_state(cpu, frontend->state_path)) { printf("loaded state from %s\n", frontend->state_path); }
+                    restore_keypad(cpu, held);
+                    break;
+                }
+                case INPUT_TURBO: turbo = input.value; break;
+                case INPUT_HERTZ: cpu->hertz = input.value; break;
+                case INPUT_DUMP_TRACE:
+                    if (frontend->trace && chip8_trace_dump(frontend->trace, cpu, options->trace_path))
+                    {
+                        printf("dumped the execution trace to %s\n", options->trace_path);
+                    }
+                    break;
+            }
+        }
+
+        // debugger commands run here between frames, so they never race the machine
+        if (frontend->debug_server)
+        {
+            bool paused = chip8_debug_paused(frontend->debugger);
+            if (!chip8_debug_server_poll(frontend->debug_server, frontend->debugger, cpu, paused ? 1000 / TIMER_HERTZ : 0))
+            {
+                // the debugger asked the emulator to exit
+                SDL_Event quit;
+                SDL_zero(quit);
+                quit.type = SDL_QUIT;
+                SDL_PushEvent(&quit);
+                break;
+            }
+            if (chip8_debug_paused(frontend->debugger))
+            {
+                // stopped: no frames and no timers, but steps and pokes still show up in the window
+                beeper_set(frontend->beeper, false);
+                publish_frame(frontend, &stats, false);
+                previous = SDL_GetPerformanceCounter();
+                lag = 0;
+                continue;
+            }
+        }
+
+        uint64_t now = SDL_GetPerformanceCounter();
+        lag += (now - previous) * TIMER_HERTZ;
+        previous = now;
+
+        bool stats_changed = options->show_stats && roll_stats(&stats, now, frequency);
+
+        if (turbo)
+        {
+            // unthrottled, only the last of every present_every frames is published
+            uint64_t cycles = 0;
+            for (uint32_t frame = 0; frame < present_every; ++frame)
+            {
+                cycles += run_frame(cpu, frontend->rewind, rewinding, frontend->beeper, frontend->debugger);
+            }
+            record_frames(&stats, frontend->profile, present_every, cycles, (SDL_GetPerformanceCounter() - now) * 1000000000ull / frequency);
+            publish_frame(frontend, &stats, stats_changed);
+            lag = 0;
+            continue;
+        }
+
+        // after a stall (breakpoint, suspended process) catch up a few frames, not all of them
+        if (lag > MAX_CATCH_UP_FRAMES * frequency) { lag = MAX_CATCH_UP_FRAMES * frequency; }
+        uint32_t ran = 0;
+        uint64_t cycles = 0;
+        while (lag >= frequency)
+        {
+            cycles += run_frame(cpu, frontend->rewind, rewinding, frontend->beeper, frontend->debugger);
+            lag -= frequency;
+            ran++;
+        }
+        // a rewound machine is shown as it is, predicting its future would undo the rewind on screen
+        if (frontend->ahead && !rewinding)
+        {
+            // between frames the window keeps the prediction it has, only the stats can be new
+            if (ran > 0) { publish_ahead(frontend, options->run_ahead, &stats, stats_changed); }
+            else { publish_display(frontend, frontend->published, false, &stats, stats_changed); }
+        }
+        else
+        {
+            publish_frame(frontend, &stats, stats_changed);
+        }
+        record_frames(&stats, frontend->profile, ran, cycles, (SDL_GetPerformanceCounter() - now) * 1000000000ull / frequency);
+
+        // sleep until input arrives or the next frame is due, instead of waking up every millisecond
+        uint8_t idle = chip8_idle_state(cpu);
+        if (!rewinding && !frontend->debug_server && (idle == CHIP8_IDLE_KEY || idle == CHIP8_IDLE_HALT) && cpu->delay == 0 && cpu->sound_timer == 0)
+        {
+            // no frame can change anything, only input wakes the machine up
+            SDL_SemWait(frontend->wake);
+            previous = SDL_GetPerformanceCounter();
+            lag = frequency;
+        }
+        else
+        {
+            // rounded up, waking early would only spin
+            uint64_t wait_ms = ((frequency - lag) * 1000 + frequency * TIMER_HERTZ - 1) / (frequency * TIMER_HERTZ);
+            SDL_SemWaitTimeout(frontend->wake, (uint32_t) wait_ms);
+        }
+    }
+    return 0;
+}
+
+// the chip8 key for a host key, -1 if it is not on the keypad
+static int keypad_key(SDL_Keycode sym)
+{
+    switch (sym)
+    {
+        case SDLK_x: return 0;
+        case SDLK_1: return 1;
+        case SDLK_2: return 2;
+        case SDLK_3: return 3;
+        case SDLK_q: return 4;
+        case SDLK_w: return 5;
+        case SDLK_e: return 6;
+        case SDLK_a: return 7;
+        case SDLK_s: return 8;
+        case SDLK_d: return 9;
+        case SDLK_z: return 10;
+        case SDLK_c: return 11;
+        case SDLK_4: return 12;
+        case SDLK_r: return 13;
+        case SDLK_f: return 14;
+        case SDLK_v: return 15;
+        default: return -1;
+    }
+}
+
+void chip8_run(CHIP8* cpu, const Chip8FrontendOptions* options)
+{
+    bool game_running = true;
+    bool fading = false;  // the phosphor still has dark pixels that glow
+    bool turbo = options->turbo;
+    uint32_t hertz = options->cpu_hertz;
+    // the VIP model counts machine cycles, far more per second than the hotkeys' usual range
+    uint32_t max_hertz = (hertz > MAX_CPU_HERTZ) ? hertz : MAX_CPU_HERTZ;
+    char shown_stats[sizeof(((FrontendFrame*) NULL)->stats)] = "";
+
+    // F5 saves next to the ROM, F7 loads it back
+    char state_path[4096];
+    snprintf(state_path, sizeof(state_path), "%s.state", options->rom_path);
+
+    // palette, phosphor and scaling happen on the CPU, on the window's thread
+    static Chip8Video video;
+    if (!chip8_video_init(&video, options->scale, options->palette_off, options->palette_on, options->phosphor))
+    {
+        printf("CHIP8: the scale must be between 1 and %d\n", CHIP8_VIDEO_MAX_SCALE);
+        return;
+    }
+
+    SDL_Window* pwindow = SDL_CreateWindow("CHIP8", SDL_WINDOWPOS_CENTERED, SDL_WINDOWPOS_CENTERED, (int) (DISPLAY_WIDTH * options->scale),
+                                           (int) (DISPLAY_HEIGHT * options->scale), 0);
+    if (!pwindow) { printf("Error while creating SDL window\n%s", SDL_GetError()); return; }
+    
+    SDL_Renderer* prenderer = SDL_CreateRenderer(pwindow, -1, 0);
+    if (!prenderer) { printf("Error while generating renderer\n%s", SDL_GetError()); return; }
+
+    SDL_Texture* ptexture = create_display_texture(prenderer, options->scale);
+    if (!ptexture) { printf("Error while creating display texture\n%s", SDL_GetError()); return; }
+    update_title(pwindow, hertz, turbo, shown_stats);
+
+    Frontend frontend;
+    memset(&frontend, 0, sizeof(frontend));
+    cpu->hertz = options->cpu_hertz;
+    frontend.cpu = cpu;
+    frontend.options = options;
+    frontend.state_path = state_path;
+    atomic_init(&frontend.running, true);
+    chip8_input_init(&frontend.input);
+    chip8_triple_init(&frontend.frames);
+    frontend.frame_event = SDL_RegisterEvents(1);
+    frontend.wake = SDL_CreateSemaphore(0);
+    if (frontend.frame_event == (uint32_t) -1 || !frontend.wake) { printf("Error while setting up the emulation thread\n%s", SDL_GetError()); return; }
+
+    // the core is audio-agnostic, so the frontend owns the beeper, without audio the game still runs silent
+    Beeper beeper;
+    beeper_open(&beeper);
+    frontend.beeper = &beeper;
+
+    // one snapshot per frame, hold backspace to run time backwards
+    frontend.rewind = chip8_rewind_create(REWIND_BYTES);
+    if (!frontend.rewind) { printf("CHIP8: could not allocate the rewind buffer, rewind is disabled\n"); }
+
+    // --profile: counters from the core plus the host time of every frame, written at exit
+    Chip8Profile* profile = NULL;
+    if (options->profile_path)
+    {
+        profile = malloc(sizeof(Chip8Profile));
+        if (profile) { chip8_profile_reset(profile); }
+        if (profile && !chip8_profile_attach(cpu, profile))
+        {
+            printf("CHIP8: built without CHIP8_PROFILE, rebuild with -DCHIP8_PROFILE=ON to use --profile\n");
+            free(profile);
+            profile = NULL;
+        }
+    }
+    frontend.profile = profile;
+
+    // --trace: the last instructions stay in memory and are written on F9, on a crash and at exit
+    if (options->trace_path)
+    {
+        frontend.trace = chip8_trace_create(options->trace_entries);
+        if (frontend.trace && !chip8_trace_attach(cpu, frontend.trace))
+        {
+            printf("CHIP8: built without CHIP8_TRACE, rebuild with -DCHIP8_TRACE=ON to use --trace\n");
+            chip8_trace_destroy(frontend.trace);
+            frontend.trace = NULL;
+        }
+        else if (!frontend.trace) { printf("CHIP8: could not allocate the execution trace, tracing is disabled\n"); }
+        else { chip8_trace_dump_on_crash(frontend.trace, cpu, options->trace_path); }
+    }
+
+    // --run-ahead: the copy starts out whole, later copies only touch what changed
+    if (options->run_ahead > 0)
+    {
+        frontend.ahead = malloc(sizeof(CHIP8));
+        if (frontend.ahead)
+        {
+            *frontend.ahead = *cpu;
+            chip8_profile_attach(frontend.ahead, NULL);
+            chip8_trace_attach(frontend.ahead, NULL);
+        }
+        else { printf("CHIP8: could not allocate the run-ahead machine, run-ahead is disabled\n"); }
+    }
+
+    // --debug: a debugger can attach on a Unix socket, the machine runs at full speed until one sets something
+    if (options->debug_socket)
+    {
+        frontend.debugger = chip8_debug_create();
+        frontend.debug_server = frontend.debugger ? chip8_debug_server_open(options->debug_socket) : NULL;
+        if (!frontend.debug_server) { printf("CHIP8: could not open the debug socket %s, debugging is disabled\n", options->debug_socket); }
+        else { printf("debug server on %s\n", options->debug_socket); }
+    }
+
+    // from here on the machine belongs to the emulation thread, this one only draws and reads input
+    SDL_Thread* emulation = SDL_CreateThread(emulation_thread, "chip8-emulation", &frontend);
+    if (!emulation)
+    {
+        printf("Error while starting the emulation thread\n%s", SDL_GetError());
+        game_running = false;
+    }
+
+    while (game_running)
+    {
+        // sleeps until there is input or the emulation thread publishes a frame,
+        // or for one frame at most while the phosphor still fades on a picture that stays the same
+        SDL_Event event;
+        bool woken = fading ? SDL_WaitEventTimeout(&event, 1000 / TIMER_HERTZ) : SDL_WaitEvent(&event);
+        if (!woken && !fading) { continue; }
+        bool tick = !woken;
+        if (tick) { event.type = SDL_FIRSTEVENT; }  // nothing happened, the loop below ignores it
+        bool redraw = false;
+        do
+        {
+            if (event.type == SDL_QUIT)
+            {
+                printf("exiting chip8!\n");
+                game_running = false;
+            }
+            // exposed or resized windows lose their contents, draw the last frame again
+            if (event.type == SDL_WINDOWEVENT)
+            {
+                redraw = true;
+            }
+            if (event.type == SDL_KEYDOWN || event.type == SDL_KEYUP) 
+            {
+                uint8_t state = (event.type == SDL_KEYDOWN) ? 1 : 0;
+                int key = keypad_key(event.key.keysym.sym);
+                if (key >= 0)
+                {
+                    // held keys repeat, but the keypad has not changed
+                    if (!event.key.repeat) { send_input(&frontend, state ? CHIP8_INPUT_KEY_DOWN : CHIP8_INPUT_KEY_UP, (uint32_t) key); }
+                    continue;
+                }
+                
+                switch (event.key.keysym.sym) 
+                {
+                    case SDLK_BACKSPACE:
+                        if (!event.key.repeat) { send_input(&frontend, INPUT_REWIND, state); }
+                        break;
+                    case SDLK_F5:
+                        if (state) { send_input(&frontend, INPUT_SAVE_STATE, 0); }
+                        break;
+                    case SDLK_F7:
+                        if (state) { send_input(&frontend, INPUT_LOAD_STATE, 0); }
+                        break;
+                    case SDLK_F9:
+                        if (state) { send_input(&frontend, INPUT_DUMP_TRACE, 0); }
+                        break;
+                    case SDLK_TAB:
+                        if (!state) { break; }
+                        turbo = !turbo;
+                        send_input(&frontend, INPUT_TURBO, turbo);
+                        update_title(pwindow, hertz, turbo, shown_stats);
+                        break;
+                    case SDLK_MINUS:
+                        if (!state) { break; }
+                        hertz = (hertz > MIN_CPU_HERTZ + CPU_HERTZ_STEP) ? hertz - CPU_HERTZ_STEP : MIN_CPU_HERTZ;
+                        send_input(&frontend, INPUT_HERTZ, hertz);
+                        update_title(pwindow, hertz, turbo, shown_stats);
+                        break;
+                    case SDLK_EQUALS:
+                        if (!state) { break; }
+                        hertz = (hertz + CPU_HERTZ_STEP < max_hertz) ? hertz + CPU_HERTZ_STEP : max_hertz;
+                        send_input(&frontend, INPUT_HERTZ, hertz);
+                        update_title(pwindow, hertz, turbo, shown_stats);
+                        break;
+                }
+            } 
+        } while (SDL_PollEvent(&event));
+
+        // the newest published frame, older ones the window was too slow for are skipped
+        bool fresh;
+        const FrontendFrame* frame = &frontend.frame_slots[chip8_triple_acquire(&frontend.frames, &fresh)];
+        if (fresh || tick) { fading = chip8_video_update(&video, frame->display); }
+        if (fresh || tick || redraw) { render(&video, prenderer, ptexture); }
+        if (fresh && strcmp(frame->stats, shown_stats) != 0)
+        {
+            memcpy(shown_stats, frame->stats, sizeof(shown_stats));
+            update_title(pwindow, hertz, turbo, shown_stats);
+        }
+    }
+
+    if (emulation)
+    {
+        atomic_store(&frontend.running, false);
+        SDL_SemPost(frontend.wake);
+        SDL_WaitThread(emulation, NULL);
+    }
+    if (profile)
+    {
+        chip8_profile_attach(cpu, NULL);
+        chip8_profile_write(profile, options->profile_path);
+        free(profile);
+    }
+    if (frontend.trace)
+    {
+        chip8_trace_attach(cpu, NULL);
+        if (chip8_trace_dump(frontend.trace, cpu, options->trace_path)) { printf("wrote the execution trace to %s\n", options->trace_path); }
+        else { perror("CHIP8: Error while writing the execution trace: "); }
+        chip8_trace_destroy(frontend.trace);
+    }
+    chip8_debug_server_close(frontend.debug_server);
+    chip8_debug_destroy(frontend.debugger);
+    chip8_rewind_destroy(frontend.rewind);
+    free(frontend.ahead);
+    SDL_DestroySemaphore(frontend.wake);
+    beeper_close(&beeper);
+    SDL_DestroyTexture(ptexture);
+    SDL_DestroyRenderer(prenderer);
+    SDL_DestroyWindow(pwindow);
+}
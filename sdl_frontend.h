@@ -0,0 +1,40 @@
+#ifndef SDL_FRONTEND_H
+#define SDL_FRONTEND_H
+
+#include "chip8.h"
+#include "chip8_video.h"
+
+#include <SDL2/SDL_render.h>
+#include <stdbool.h>
+
+// streaming texture of the display upscaled scale times, render() expands into it
+SDL_Texture* create_display_texture(SDL_Renderer* renderer, uint32_t scale);
+// expands the video's current frame (see chip8_video_update) into the texture and presents it
+void render(const Chip8Video* video, SDL_Renderer* renderer, SDL_Texture* texture);
+#define PIXEL_ON  0xFFFFFFFF  // white, ARGB8888, the default palette
+#define PIXEL_OFF 0xFF000000  // black
+#define TURBO_PRESENT_EVERY 8 // default frame skip in turbo mode
+#define MAX_RUN_AHEAD 4       // frames, more would show mispredictions longer than the latency saved
+
+typedef struct
+{
+    const char* rom_path;          // the loaded game, also names the save state file (<rom>.state)
+    uint32_t cpu_hertz;            // cycles per second of the machine's timing model, CPU_HERTZ by default
+    bool turbo;                    // start unthrottled
+    uint32_t turbo_present_every;  // in turbo, present one frame out of this many
+    const char* profile_path;      // NULL, or where to write the profile at exit (needs CHIP8_PROFILE)
+    const char* trace_path;        // NULL, or where F9, a crash and exiting dump the execution trace (see chip8_trace.h)
+    uint32_t trace_entries;        // instructions the trace keeps, CHIP8_TRACE_DEFAULT_ENTRIES by default
+    bool show_stats;               // instructions/sec and frame times in the window title
+    const char* debug_socket;      // NULL, or the Unix socket a debugger attaches to (see chip8_debug.h)
+    uint32_t run_ahead;            // frames shown ahead of the machine with the keys held now, 0 to show it as is
+    uint32_t scale;                // window pixels per CHIP-8 pixel, SCALE by default
+    uint32_t palette_off;          // ARGB8888 of dark pixels
+    uint32_t palette_on;           // ARGB8888 of lit pixels
+    uint8_t phosphor;              // brightness a dark pixel keeps per frame out of 256, 0 for none (see chip8_video.h)
+} Chip8FrontendOptions;
+
+// opens the window and audio, then runs the emulator on its own thread until the window is closed;
+// the calling thread only renders published frames and forwards input, so a slow present never stalls the CPU
+void chip8_run(CHIP8* cpu, const Chip8FrontendOptions* options);
+#endif 
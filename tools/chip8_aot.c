@@ -0,0 +1,475 @@
+/*
+ *  chip8-aot: static recompiler, turns a ROM into C for the chip8_aot.h runtime.
+ *
+ *  Usage: chip8-aot <rom> [-o FILE] [--quirks P]
+ *
+ *  Control flow is recovered from INTERPRETER_RESERVED_MEMORY by following
+ *  1nnn, 2nnn (and the return site after it), skips and Fx0A. Every target is
+ *  a block leader and gets a label; blocks chain with goto. 00EE and Bnnn
+ *  jump through a switch over the leaders, and anything that is not a leader
+ *  (a computed target, code copied to RAM, a block that was overwritten)
+ *  returns to the runtime, which interprets it.
+ *
+ *  The generated run() keeps pc only in the C control flow and writes it back
+ *  when it returns, which it can do before any instruction once the cycles
+ *  run out; the switch has a case for every compiled instruction to resume
+ *  there. DXYN and Cxkk run on chip8_cycle in the middle of a block, Fx33 and
+ *  Fx55 too but they end the block, since they may rewrite code.
+ */
+
+#include "chip8.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// what an instruction does to control flow
+#define FLOW_NEXT      0  // falls through to the next instruction of the block
+#define FLOW_JUMP      1  // 1nnn
+#define FLOW_CALL      2  // 2nnn, then the return site
+#define FLOW_RETURN    3  // 00EE, target known at run time only
+#define FLOW_INDIRECT  4  // Bnnn, same
+#define FLOW_SKIP      5  // address + 2 or + 4
+#define FLOW_WAIT      6  // Fx0A, itself until a key is down, then address + 2
+#define FLOW_WRITE     7  // Fx33/Fx55, ends the block so the runtime sees the write
+
+typedef struct
+{
+    uint16_t start;
+    uint16_t end;     // one past the last byte
+    uint16_t length;  // instructions
+} Block;
+
+static CHIP8 cpu;
+static uint16_t rom_end;
+static bool reachable[SIZE_4KB];
+static bool leader[SIZE_4KB];
+static int block_of[SIZE_4KB];  // block index of a leader, -1 elsewhere
+static Block blocks[SIZE_4KB];
+static int block_count;
+
+static const char* const quirks_macros[CHIP8_QUIRKS_COUNT] =
+{
+    "CHIP8_QUIRKS_LEGACY", "CHIP8_QUIRKS_VIP", "CHIP8_QUIRKS_CHIP48", "CHIP8_QUIRKS_SCHIP"
+};
+
+static void usage(const char* program)
+{
+    printf("Usage: %s <path-to-game-rom> [-o FILE] [--quirks P]\n", program);
+    printf("  -o FILE      write the C program to FILE (default stdout)\n");
+    printf("  --quirks P   quirk profile to compile for, legacy, vip, chip48 or schip (default: from the ROM table, else legacy)\n");
+}
+
+static bool in_rom(uint32_t address)
+{
+    return address >= INTERPRETER_RESERVED_MEMORY && address + 1 < rom_end;
+}
+
+static int flow_of(const Instruction* instruction)
+{
+    switch (instruction->op)
+    {
+        case EXEC_JUMP:           return FLOW_JUMP;
+        case EXEC_CALL:           return FLOW_CALL;
+        case EXEC_RET:            return FLOW_RETURN;
+        case EXEC_JUMP_V0_ADDR:   return FLOW_INDIRECT;
+        case EXEC_SKIP_X_EQ_BYTE:
+        case EXEC_SKIP_X_NE_BYTE:
+        case EXEC_SKIP_X_EQ_Y:
+        case EXEC_SKIP_X_NE_Y:
+        case EXEC_SKIP_IF_KEY:
+        case EXEC_SKIP_IF_NO_KEY: return FLOW_SKIP;
+        case EXEC_WAIT_FOR_KEY:   return FLOW_WAIT;
+        case EXEC_STORE_BCD_X:
+        case EXEC_STORE_REGS_I:   return FLOW_WRITE;
+    }
+    return FLOW_NEXT;
+}
+
+/*
+ *  Control-flow recovery
+ */
+
+static void discover(void)
+{
+    static uint16_t worklist[SIZE_4KB * 4];
+    int pending = 0;
+    if (in_rom(INTERPRETER_RESERVED_MEMORY))
+    {
+        leader[INTERPRETER_RESERVED_MEMORY] = true;
+        worklist[pending++] = INTERPRETER_RESERVED_MEMORY;
+    }
+
+    while (pending > 0)
+    {
+        uint16_t address = worklist[--pending];
+        if (!in_rom(address) || reachable[address]) { continue; }
+        reachable[address] = true;
+
+        const Instruction* instruction = &cpu.decoded[address];
+        uint32_t targets[2];
+        int target_count = 0;
+        bool leaders = true;
+        switch (flow_of(instruction))
+        {
+            case FLOW_NEXT:
+                targets[target_count++] = address + 2;
+                leaders = false;
+                break;
+            case FLOW_JUMP:
+                targets[target_count++] = instruction->nnn;
+                break;
+            case FLOW_CALL:
+                targets[target_count++] = instruction->nnn;
+                targets[target_count++] = address + 2;
+                break;
+            case FLOW_SKIP:
+                targets[target_count++] = address + 2;
+                targets[target_count++] = address + 4;
+                break;
+            case FLOW_WAIT:
+                targets[target_count++] = address;
+                targets[target_count++] = address + 2;
+                break;
+            case FLOW_WRITE:
+                targets[target_count++] = address + 2;
+                break;
+        }
+        for (int k = 0; k < target_count; ++k)
+        {
+            if (!in_rom(targets[k])) { continue; }
+            if (leaders) { leader[targets[k]] = true; }
+            worklist[pending++] = (uint16_t) targets[k];
+        }
+    }
+}
+
+// a block runs from its leader to the first control-flow instruction, the next leader or the end of the ROM
+static void build_blocks(void)
+{
+    for (int address = 0; address < SIZE_4KB; ++address)
+    {
+        block_of[address] = -1;
+        if (!leader[address] || !reachable[address]) { continue; }
+
+        Block* block = &blocks[block_count];
+        block->start = (uint16_t) address;
+        uint32_t at = (uint32_t) address;
+        for (;;)
+        {
+            block->length++;
+            bool ends = flow_of(&cpu.decoded[at]) != FLOW_NEXT;
+            at += 2;
+            if (ends || !in_rom(at) || leader[at]) { break; }
+        }
+        block->end = (uint16_t) at;
+        block_of[address] = block_count++;
+    }
+}
+
+/*
+ *  Code generation
+ */
+
+// continue at a known address: the block there, or back to the runtime
+static void emit_goto(FILE* out, const char* indent, uint32_t target)
+{
+    target &= 0xFFFF;
+    if (target < SIZE_4KB && block_of[target] >= 0)
+    {
+        fprintf(out, "%sgoto block_%03X;\n", indent, target);
+        return;
+    }
+    fprintf(out, "%s{ cpu->pc = 0x%03X; return cycles; }\n", indent, target);
+}
+
+static void emit_skip(FILE* out, const char* condition, uint16_t address)
+{
+    fprintf(out, "    if (%s)\n", condition);
+    emit_goto(out, "        ", address + 4);
+    emit_goto(out, "    ", address + 2);
+}
+
+// the instruction at address, the profile's quirks are resolved here instead of at run time
+static void emit_instruction(FILE* out, uint16_t address, uint8_t flags)
+{
+    const Instruction* in = &cpu.decoded[address];
+    int x = in->x;
+    int y = in->y;
+    char condition[96];
+    fprintf(out, "    /* 0x%03X: %02X%02X */\n", address, cpu.memory[address], cpu.memory[address + 1]);
+
+    switch (in->op)
+    {
+        case EXEC_NOP:
+            break;
+        case EXEC_CLS:
+            fprintf(out, "    memset(cpu->display, 0, sizeof(cpu->display));\n    cpu->display_dirty = 1;\n");
+            break;
+        case EXEC_RET:
+            fprintf(out, "    cpu->stack_pointer--;\n    cpu->pc = cpu->stack[cpu->stack_pointer & (STACK_SIZE - 1)];\n    goto dispatch;\n");
+            break;
+        case EXEC_JUMP:
+            emit_goto(out, "    ", in->nnn);
+            break;
+        case EXEC_CALL:
+            fprintf(out, "    if (cpu->stack_pointer > 15) { cpu->pc = 0x%03X; return cycles; }\n", address);
+            fprintf(out, "    cpu->stack[cpu->stack_pointer++] = 0x%03X;\n", address + 2);
+            emit_goto(out, "    ", in->nnn);
+            break;
+        case EXEC_SKIP_X_EQ_BYTE:
+            snprintf(condition, sizeof(condition), "cpu->v[%d] == 0x%02X", x, in->nn);
+            emit_skip(out, condition, address);
+            break;
+        case EXEC_SKIP_X_NE_BYTE:
+            snprintf(condition, sizeof(condition), "cpu->v[%d] != 0x%02X", x, in->nn);
+            emit_skip(out, condition, address);
+            break;
+        case EXEC_SKIP_X_EQ_Y:
+            snprintf(condition, sizeof(condition), "cpu->v[%d] == cpu->v[%d]", x, y);
+            emit_skip(out, condition, address);
+            break;
+        case EXEC_SKIP_X_NE_Y:
+            snprintf(condition, sizeof(condition), "cpu->v[%d] != cpu->v[%d]", x, y);
+            emit_skip(out, condition, address);
+            break;
+        case EXEC_SKIP_IF_KEY:
+            snprintf(condition, sizeof(condition), "cpu->keypad[cpu->v[%d] & 0xF] != 0", x);
+            emit_skip(out, condition, address);
+            break;
+        case EXEC_SKIP_IF_NO_KEY:
+            snprintf(condition, sizeof(condition), "cpu->keypad[cpu->v[%d] & 0xF] == 0", x);
+            emit_skip(out, condition, address);
+            break;
+        case EXEC_LOAD_X_BYTE:
+            fprintf(out, "    cpu->v[%d] = 0x%02X;\n", x, in->nn);
+            break;
+        case EXEC_ADD_X_BYTE:
+            fprintf(out, "    cpu->v[%d] += 0x%02X;\n", x, in->nn);
+            break;
+        case EXEC_LOAD_X_Y:
+            fprintf(out, "    cpu->v[%d] = cpu->v[%d];\n", x, y);
+            break;
+        case EXEC_OR_X_Y:
+        case EXEC_AND_X_Y:
+        case EXEC_XOR_X_Y:
+        {
+            char operation = (in->op == EXEC_OR_X_Y) ? '|' : (in->op == EXEC_AND_X_Y) ? '&' : '^';
+            fprintf(out, "    cpu->v[%d] %c= cpu->v[%d];\n", x, operation, y);
+            if (flags & CHIP8_QUIRK_VF_RESET) { fprintf(out, "    cpu->v[15] = 0;\n"); }
+            break;
+        }
+        case EXEC_ADD_X_Y:
+            fprintf(out, "    { unsigned sum = cpu->v[%d] + cpu->v[%d]; cpu->v[%d] = (uint8_t) sum; cpu->v[15] = sum > 255; }\n", x, y, x);
+            break;
+        case EXEC_SUB_X_Y:
+            fprintf(out, "    { uint8_t vx = cpu->v[%d], vy = cpu->v[%d]; cpu->v[%d] = vx - vy; cpu->v[15] = vx >= vy; }\n", x, y, x);
+            break;
+        case EXEC_SUBN_X_Y:
+            // same order as the interpreter: VF first, so x or y = F sees the new flag
+            fprintf(out, "    cpu->v[15] = cpu->v[%d] >= cpu->v[%d];\n    cpu->v[%d] = cpu->v[%d] - cpu->v[%d];\n", y, x, x, y, x);
+            break;
+        case EXEC_SHR_X:
+            if (flags & CHIP8_QUIRK_SHIFT_VY)
+            {
+                fprintf(out, "    { uint8_t value = cpu->v[%d]; cpu->v[%d] = value >> 1; cpu->v[15] = value & 1; }\n", y, x);
+                break;
+            }
+            fprintf(out, "    cpu->v[15] = cpu->v[%d] & 1;\n    cpu->v[%d] >>= 1;\n", x, x);
+            break;
+        case EXEC_SHL_X:
+            if (flags & CHIP8_QUIRK_SHIFT_VY)
+            {
+                fprintf(out, "    { uint8_t value = cpu->v[%d]; cpu->v[%d] = value << 1; cpu->v[15] = value >> 7; }\n", y, x);
+                break;
+            }
+            fprintf(out, "    cpu->v[15] = cpu->v[%d] >> 7;\n    cpu->v[%d] <<= 1;\n", x, x);
+            break;
+        case EXEC_LOAD_I_ADDR:
+            fprintf(out, "    cpu->i = 0x%03X;\n", in->nnn);
+            break;
+        case EXEC_JUMP_V0_ADDR:
+            fprintf(out, "    cpu->pc = 0x%03X + cpu->v[%d];\n    goto dispatch;\n", in->nnn, (flags & CHIP8_QUIRK_JUMP_VX) ? x : 0);
+            break;
+        case EXEC_RANDOM_X_BYTE:
+        case EXEC_DRAW_SPRITE:
+            // the interpreter's own handler, it neither jumps nor writes memory
+            fprintf(out, "    cpu->pc = 0x%03X;\n    chip8_cycle(cpu);\n", address);
+            break;
+        case EXEC_LOAD_X_DT:
+            fprintf(out, "    cpu->v[%d] = cpu->delay;\n", x);
+            break;
+        case EXEC_WAIT_FOR_KEY:
+            fprintf(out, "    for (int key = 0; key < 16; ++key)\n    {\n");
+            fprintf(out, "        if (cpu->keypad[key] == 0) { continue; }\n        cpu->v[%d] = (uint8_t) key;\n", x);
+            emit_goto(out, "        ", address + 2);
+            fprintf(out, "    }\n");
+            emit_goto(out, "    ", address);
+            break;
+        case EXEC_SET_DT_X:
+            fprintf(out, "    cpu->delay = cpu->v[%d];\n", x);
+            break;
+        case EXEC_SET_ST_X:
+            fprintf(out, "    cpu->sound_timer = cpu->v[%d];\n", x);
+            break;
+        case EXEC_ADD_I_X:
+            fprintf(out, "    cpu->i += cpu->v[%d];\n", x);
+            break;
+        case EXEC_LOAD_F_X:
+            fprintf(out, "    cpu->i = FONTSET_STARTPOINT + cpu->v[%d] * 5;\n", x);
+            break;
+        case EXEC_STORE_BCD_X:
+        case EXEC_STORE_REGS_I:
+            // may overwrite code, so the runtime checks the blocks before anything else runs
+            fprintf(out, "    cpu->pc = 0x%03X;\n    chip8_cycle(cpu);\n    return cycles;\n", address);
+            break;
+        case EXEC_LOAD_REGS_I:
+            fprintf(out, "    for (int reg = 0; reg <= %d; ++reg) { cpu->v[reg] = cpu->memory[(cpu->i + reg) & (SIZE_4KB - 1)]; }\n", x);
+            if (flags & CHIP8_QUIRK_MEMORY_X) { fprintf(out, "    cpu->i += %d;\n", x); }
+            if (flags & CHIP8_QUIRK_MEMORY_X1) { fprintf(out, "    cpu->i += %d;\n", x + 1); }
+            break;
+    }
+}
+
+static void emit_program(FILE* out, const char* name, uint16_t size)
+{
+    uint8_t flags = chip8_quirk_flags(cpu.quirks);
+    fprintf(out, "/* generated by chip8-aot from %s, do not edit */\n\n", name);
+    fprintf(out, "#include \"chip8_aot.h\"\n\n#include <stdint.h>\n#include <string.h>\n\n");
+
+    fprintf(out, "static const uint8_t rom[%u] =\n{", size);
+    for (uint16_t k = 0; k < size; ++k)
+    {
+        fprintf(out, "%s0x%02X,", (k % 12 == 0) ? "\n    " : " ", cpu.memory[INTERPRETER_RESERVED_MEMORY + k]);
+    }
+    fprintf(out, "\n};\n\n");
+
+    fprintf(out, "static const Chip8AotBlock blocks[%d] =\n{\n", block_count > 0 ? block_count : 1);
+    for (int k = 0; k < block_count; ++k)
+    {
+        fprintf(out, "    { 0x%03X, 0x%03X },\n", blocks[k].start, blocks[k].end);
+    }
+    fprintf(out, "};\n\n");
+
+    // 00EE and Bnnn come back to the switch, without them the label would be unused
+    bool indirect = false;
+    for (int k = 0; k < block_count; ++k)
+    {
+        int flow = flow_of(&cpu.decoded[blocks[k].end - 2]);
+        indirect = indirect || flow == FLOW_RETURN || flow == FLOW_INDIRECT;
+    }
+    fprintf(out, "static uint32_t run(CHIP8* cpu, uint32_t cycles, const uint8_t* valid)\n{\n");
+    fprintf(out, "%s    switch (cpu->pc)\n    {\n", indirect ? "dispatch:\n" : "");
+    for (int k = 0; k < block_count; ++k)
+    {
+        // every instruction is a way in, so a run that ran out of cycles mid-block resumes compiled
+        fprintf(out, "        case 0x%03X: goto block_%03X;\n", blocks[k].start, blocks[k].start);
+        for (uint16_t address = blocks[k].start + 2; address < blocks[k].end; address += 2)
+        {
+            fprintf(out, "        case 0x%03X: if (valid[%d]) { goto at_%03X; } return cycles;\n", address, k, address);
+        }
+    }
+    fprintf(out, "    }\n    return cycles;\n");
+
+    for (int k = 0; k < block_count; ++k)
+    {
+        const Block* block = &blocks[k];
+        fprintf(out, "\nblock_%03X:\n", block->start);
+        fprintf(out, "    if (!valid[%d]) { cpu->pc = 0x%03X; return cycles; }\n", k, block->start);
+        for (uint16_t address = block->start; address < block->end; address += 2)
+        {
+            if (address != block->start) { fprintf(out, "at_%03X:\n", address); }
+            fprintf(out, "    if (cycles == 0) { cpu->pc = 0x%03X; return 0; }\n    cycles--;\n", address);
+            emit_instruction(out, address, flags);
+        }
+        // ended on the next leader or the end of the ROM rather than on a jump
+        if (flow_of(&cpu.decoded[block->end - 2]) == FLOW_NEXT)
+        {
+            emit_goto(out, "    ", block->end);
+        }
+    }
+    fprintf(out, "}\n\n");
+
+    fprintf(out, "const Chip8AotProgram chip8_aot_program =\n{\n");
+    fprintf(out, "    \"%s\", rom, %u, %s, blocks, %d, run\n};\n", name, size, quirks_macros[cpu.quirks], block_count);
+}
+
+int main(int argc, const char* argv[])
+{
+    const char* rom_path = NULL;
+    const char* output_path = NULL;
+    const char* quirks_name = NULL;
+
+    for (int arg = 1; arg < argc; ++arg)
+    {
+        if (strcmp(argv[arg], "-o") == 0 && arg + 1 < argc)
+        {
+            output_path = argv[++arg];
+        }
+        else if (strcmp(argv[arg], "--quirks") == 0 && arg + 1 < argc)
+        {
+            quirks_name = argv[++arg];
+        }
+        else if (argv[arg][0] != '-' && rom_path == NULL)
+        {
+            rom_path = argv[arg];
+        }
+        else
+        {
+            usage(argv[0]);
+            return 1;
+        }
+    }
+    if (rom_path == NULL)
+    {
+        usage(argv[0]);
+        return 1;
+    }
+
+    chip8_init(&cpu);
+    if (!load_rom(&cpu, rom_path)) { return 1; }
+    if (quirks_name != NULL && !chip8_parse_quirks(quirks_name, &cpu.quirks))
+    {
+        usage(argv[0]);
+        return 1;
+    }
+    // load_rom does not report the size, the file does
+    FILE* file_pointer = fopen(rom_path, "rb");
+    if (file_pointer == NULL) { return 1; }
+    fseek(file_pointer, 0, SEEK_END);
+    uint16_t size = (uint16_t) ftell(file_pointer);
+    fclose(file_pointer);
+    rom_end = INTERPRETER_RESERVED_MEMORY + size;
+
+    discover();
+    build_blocks();
+
+    const char* name = strrchr(rom_path, '/');
+    name = (name != NULL) ? name + 1 : rom_path;
+    FILE* out = stdout;
+    if (output_path != NULL)
+    {
+        out = fopen(output_path, "w");
+        if (out == NULL)
+        {
+            perror("CHIP8: Error while writing the program: ");
+            return 1;
+        }
+    }
+    emit_program(out, name, size);
+    if (out != stdout && fclose(out) != 0)
+    {
+        perror("CHIP8: Error while writing the program: ");
+        return 1;
+    }
+
+    int reached = 0;
+    int compiled = 0;
+    for (int k = 0; k < block_count; ++k) { compiled += blocks[k].length; }
+    for (int address = 0; address < SIZE_4KB; ++address) { reached += reachable[address]; }
+    fprintf(output_path != NULL ? stdout : stderr, "%s: %d blocks, %d instructions reached, %d compiled (%s)\n",
+            name, block_count, reached, compiled, chip8_quirks_name(cpu.quirks));
+    return 0;
+}
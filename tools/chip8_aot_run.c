@@ -0,0 +1,178 @@
+/*
+ *  chip8-aot-<rom>: the runner linked with one program generated by chip8-aot.
+ *  It benchmarks the compiled ROM headless, or checks it against the interpreter.
+ *
+ *  Usage: chip8-aot-<rom> [--frames N] [--seed N] [--verify]
+ *
+ *  --verify runs the compiled program and the interpreter side by side with the
+ *  same seed and the same random key presses, and compares the whole machine
+ *  after every frame.
+ */
+
+#include "chip8.h"
+#include "chip8_aot.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define DEFAULT_FRAMES 100000
+#define DEFAULT_VERIFY_FRAMES 20000
+#define DEFAULT_SEED 1
+
+extern const Chip8AotProgram chip8_aot_program;
+
+static uint64_t now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * 1000000000ull + (uint64_t) ts.tv_nsec;
+}
+
+static void usage(const char* program)
+{
+    printf("Usage: %s [--frames N] [--seed N] [--verify]\n", program);
+    printf("  runs %s, recompiled ahead of time\n", chip8_aot_program.name);
+    printf("  --frames N   %d Hz frames at %d cycles per second (default %d, %d with --verify)\n", TIMER_HERTZ, CPU_HERTZ, DEFAULT_FRAMES, DEFAULT_VERIFY_FRAMES);
+    printf("  --seed N     Cxkk random seed, also drives the --verify key presses (default %d)\n", DEFAULT_SEED);
+    printf("  --verify     compare every frame against the interpreter\n");
+}
+
+// everything the program can observe or change, the caches and host fields are left out
+static const char* first_difference(const CHIP8* a, const CHIP8* b)
+{
+    if (memcmp(a->memory, b->memory, sizeof(a->memory)) != 0) { return "memory"; }
+    if (memcmp(a->display, b->display, sizeof(a->display)) != 0) { return "display"; }
+    if (memcmp(a->v, b->v, sizeof(a->v)) != 0) { return "registers"; }
+    if (a->i != b->i) { return "I"; }
+    if (a->pc != b->pc) { return "pc"; }
+    if (memcmp(a->stack, b->stack, sizeof(a->stack)) != 0 || a->stack_pointer != b->stack_pointer) { return "stack"; }
+    if (a->delay != b->delay || a->sound_timer != b->sound_timer) { return "timers"; }
+    if (a->rng_state != b->rng_state) { return "random state"; }
+    return NULL;
+}
+
+static void set_keys(CHIP8* cpu, uint16_t keys)
+{
+    for (int key = 0; key < 16; ++key)
+    {
+        cpu->keypad[key] = (keys >> key) & 1;
+    }
+}
+
+static int verify(uint64_t frames, uint32_t seed)
+{
+    static CHIP8 compiled;
+    static CHIP8 interpreted;
+    chip8_init(&compiled);
+    chip8_seed(&compiled, seed);
+    chip8_aot_load(&chip8_aot_program, &compiled);
+    interpreted = compiled;
+
+    Chip8Aot* aot = chip8_aot_create(&chip8_aot_program);
+    if (aot == NULL) { return 1; }
+
+    // key presses held for a few frames at a time, from their own xorshift stream
+    uint32_t input = seed * 2654435761u + 1;
+    uint16_t keys = 0;
+    for (uint64_t frame = 0; frame < frames; ++frame)
+    {
+        if (frame % 8 == 0)
+        {
+            input ^= input << 13;
+            input ^= input >> 17;
+            input ^= input << 5;
+            keys = (input >> 8) & (input >> 24) & 0xFFFF;
+        }
+        set_keys(&compiled, keys);
+        set_keys(&interpreted, keys);
+
+        // both clocks are in step, so both frames end at the same tick
+        uint32_t cycles = chip8_cycles_to_tick(&compiled);
+        chip8_aot_run_cycles(aot, &compiled, cycles);
+        chip8_run_cycles(&interpreted, cycles);
+
+        const char* difference = first_difference(&compiled, &interpreted);
+        if (difference != NULL)
+        {
+            printf("%s: FAILED at frame %llu, %s differs (pc 0x%03X compiled, 0x%03X interpreted)\n", chip8_aot_program.name,
+                   (unsigned long long) frame, difference, compiled.pc, interpreted.pc);
+            chip8_aot_destroy(aot);
+            return 1;
+        }
+    }
+
+    uint64_t compiled_cycles;
+    uint64_t interpreted_cycles;
+    chip8_aot_stats(aot, &compiled_cycles, &interpreted_cycles);
+    printf("%s: %llu frames match the interpreter, %.1f%% of cycles ran compiled\n", chip8_aot_program.name,
+           (unsigned long long) frames, 100.0 * (double) compiled_cycles / (double) (compiled_cycles + interpreted_cycles));
+    chip8_aot_destroy(aot);
+    return 0;
+}
+
+static int bench(uint64_t frames, uint32_t seed)
+{
+    static CHIP8 cpu;
+    chip8_init(&cpu);
+    chip8_seed(&cpu, seed);
+    chip8_aot_load(&chip8_aot_program, &cpu);
+    Chip8Aot* aot = chip8_aot_create(&chip8_aot_program);
+    if (aot == NULL) { return 1; }
+
+    uint64_t start = now_ns();
+    for (uint64_t frame = 0; frame < frames; ++frame)
+    {
+        chip8_aot_run_cycles(aot, &cpu, chip8_cycles_to_tick(&cpu));
+    }
+    uint64_t elapsed = now_ns() - start;
+    if (elapsed == 0) { elapsed = 1; }
+
+    uint64_t compiled_cycles;
+    uint64_t interpreted_cycles;
+    chip8_aot_stats(aot, &compiled_cycles, &interpreted_cycles);
+    uint64_t cycles = cpu.clock;
+    double seconds = (double) elapsed / 1e9;
+    printf("rom:              %s (recompiled, %u blocks, %s)\n", chip8_aot_program.name, chip8_aot_program.block_count,
+           chip8_quirks_name(chip8_aot_program.quirks));
+    printf("instructions:     %llu\n", (unsigned long long) cycles);
+    printf("compiled:         %.1f%%\n", 100.0 * (double) compiled_cycles / (double) (compiled_cycles + interpreted_cycles));
+    printf("elapsed:          %.3f s\n", seconds);
+    printf("instructions/sec: %.0f\n", (double) cycles / seconds);
+    printf("ns/instruction:   %.3f\n", (double) elapsed / (double) cycles);
+    chip8_aot_destroy(aot);
+    return 0;
+}
+
+int main(int argc, const char* argv[])
+{
+    uint64_t frames = 0;
+    uint32_t seed = DEFAULT_SEED;
+    bool check = false;
+
+    for (int arg = 1; arg < argc; ++arg)
+    {
+        if (strcmp(argv[arg], "--frames") == 0 && arg + 1 < argc)
+        {
+            frames = strtoull(argv[++arg], NULL, 10);
+        }
+        else if (strcmp(argv[arg], "--seed") == 0 && arg + 1 < argc)
+        {
+            seed = (uint32_t) strtoul(argv[++arg], NULL, 0);
+        }
+        else if (strcmp(argv[arg], "--verify") == 0)
+        {
+            check = true;
+        }
+        else
+        {
+            usage(argv[0]);
+            return 1;
+        }
+    }
+    if (frames == 0) { frames = check ? DEFAULT_VERIFY_FRAMES : DEFAULT_FRAMES; }
+    return check ? verify(frames, seed) : bench(frames, seed);
+}
@@ -0,0 +1,179 @@
+/*
+ *  chip8-batch: runs many independent instances of one ROM across all cores
+ *  and reports the aggregate throughput, optionally one result line per instance.
+ *
+ *  Usage: chip8-batch <rom> [--instances N] [--frames N] [--threads N] [--seed N] [--random-input] [--results]
+ */
+
+#include "chip8.h"
+#include "chip8_batch.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define DEFAULT_INSTANCES 1024
+#define DEFAULT_FRAMES 3600   // one emulated minute
+#define RUN_CHUNK_FRAMES 600  // frames per chip8_batch_run_frames call
+
+static uint64_t now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * 1000000000ull + (uint64_t) ts.tv_nsec;
+}
+
+static void usage(const char* program)
+{
+    printf("Usage: %s <path-to-game-rom> [--instances N] [--frames N] [--threads N] [--seed N] [--random-input] [--results]\n", program);
+    printf("  --instances N   machines to run (default %d)\n", DEFAULT_INSTANCES);
+    printf("  --frames N      frames per machine (default %d)\n", DEFAULT_FRAMES);
+    printf("  --threads N     worker threads, 0 = one per core (default 0)\n");
+    printf("  --seed N        machine k runs with seed N + k (default 0)\n");
+    printf("  --random-input  give every machine its own random key presses\n");
+    printf("  --results       print pc, I and a display hash for every machine\n");
+}
+
+// FNV-1a over the packed display rows
+static uint64_t display_hash(const CHIP8* cpu)
+{
+    uint64_t hash = 0xcbf29ce484222325ull;
+    const uint8_t* bytes = (const uint8_t*) cpu->display;
+    for (size_t k = 0; k < sizeof(cpu->display); ++k)
+    {
+        hash = (hash ^ bytes[k]) * 0x100000001b3ull;
+    }
+    return hash;
+}
+
+int main(int argc, const char* argv[])
+{
+    const char* rom_path = NULL;
+    uint32_t instances = DEFAULT_INSTANCES;
+    uint32_t frames = DEFAULT_FRAMES;
+    uint32_t threads = 0;
+    uint32_t seed = 0;
+    bool random_input = false;
+    bool results = false;
+
+    for (int arg = 1; arg < argc; ++arg)
+    {
+        if (strcmp(argv[arg], "--instances") == 0 && arg + 1 < argc)
+        {
+            instances = (uint32_t) strtoul(argv[++arg], NULL, 10);
+        }
+        else if (strcmp(argv[arg], "--frames") == 0 && arg + 1 < argc)
+        {
+            frames = (uint32_t) strtoul(argv[++arg], NULL, 10);
+        }
+        else if (strcmp(argv[arg], "--threads") == 0 && arg + 1 < argc)
+        {
+            threads = (uint32_t) strtoul(argv[++arg], NULL, 10);
+        }
+        else if (strcmp(argv[arg], "--seed") == 0 && arg + 1 < argc)
+        {
+            seed = (uint32_t) strtoul(argv[++arg], NULL, 0);
+        }
+        else if (strcmp(argv[arg], "--random-input") == 0)
+        {
+            random_input = true;
+        }
+        else if (strcmp(argv[arg], "--results") == 0)
+        {
+            results = true;
+        }
+        else if (argv[arg][0] != '-' && rom_path == NULL)
+        {
+            rom_path = argv[arg];
+        }
+        else
+        {
+            usage(argv[0]);
+            return 1;
+        }
+    }
+    if (rom_path == NULL || instances == 0)
+    {
+        usage(argv[0]);
+        return 1;
+    }
+
+    Chip8Batch* batch = chip8_batch_create(rom_path, instances, threads);
+    if (batch == NULL) { return 1; }
+    chip8_batch_seed(batch, seed);
+
+    if (random_input && frames > 0)
+    {
+        uint16_t* keys = malloc(sizeof(uint16_t) * frames);
+        if (keys == NULL)
+        {
+            printf("CHIP8: could not allocate %u frames of random input\n", frames);
+            chip8_batch_destroy(batch);
+            return 1;
+        }
+        for (uint32_t index = 0; index < instances; ++index)
+        {
+            // xorshift per instance: a key goes down for about a quarter of the frames
+            uint32_t state = (seed + index + 1) * 0x9E3779B9u | 1;
+            for (uint32_t frame = 0; frame < frames; ++frame)
+            {
+                state ^= state << 13;
+                state ^= state >> 17;
+                state ^= state << 5;
+                keys[frame] = ((state >> 30) == 0) ? (uint16_t) (1u << ((state >> 4) & 0xF)) : 0;
+            }
+            chip8_batch_set_input(batch, index, keys, frames);
+        }
+        free(keys);
+    }
+
+    uint64_t start = now_ns();
+    bool ok = true;
+    for (uint32_t done = 0; done < frames && ok; )
+    {
+        uint32_t step = (frames - done < RUN_CHUNK_FRAMES) ? frames - done : RUN_CHUNK_FRAMES;
+        ok = chip8_batch_run_frames(batch, step);
+        done += step;
+    }
+    uint64_t elapsed = now_ns() - start;
+    if (!ok)
+    {
+        uint32_t failed = 0;
+        for (uint32_t index = 0; index < instances; ++index)
+        {
+            failed += chip8_batch_instance_failed(batch, index);
+        }
+        printf("CHIP8: %u of %u instances ran out of memory, the batch stopped at frame %llu\n",
+               failed, instances, (unsigned long long) chip8_batch_frame(batch));
+        chip8_batch_destroy(batch);
+        return 1;
+    }
+    if (elapsed == 0) { elapsed = 1; }
+
+    if (results)
+    {
+        for (uint32_t index = 0; index < instances; ++index)
+        {
+            const CHIP8* cpu = chip8_batch_instance(batch, index);
+            printf("%u pc=%03X i=%03X display=%016llx\n", index, cpu->pc, cpu->i, (unsigned long long) display_hash(cpu));
+        }
+    }
+
+    double seconds = (double) elapsed / 1e9;
+    double total_frames = (double) instances * frames;
+    printf("rom:              %s\n", rom_path);
+    printf("instances:        %u\n", instances);
+    printf("threads:          %u\n", chip8_batch_threads(batch));
+    printf("bytes/instance:   %.0f (pages shared with the ROM until written)\n", (double) chip8_batch_instance_bytes(batch) / instances);
+    printf("seed:             %u\n", seed);
+    printf("frames/instance:  %u\n", frames);
+    printf("elapsed:          %.6f s\n", seconds);
+    printf("frames/sec:       %.0f\n", total_frames / seconds);
+    printf("instructions/sec: %.0f\n", total_frames * CPU_HERTZ / TIMER_HERTZ / seconds);
+
+    chip8_batch_destroy(batch);
+    return 0;
+}
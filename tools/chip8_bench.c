@@ -0,0 +1,457 @@
+/*
+ *  chip8-bench: runs a ROM headless and unthrottled, then reports the
+ *  interpreter throughput. No SDL, no window, no audio device required.
+ *
+ *  Usage: chip8-bench <rom> [--cycles N | --frames N] [--engine switch|threaded|jit] [--seed N] [--quirks P] [--timing T] [--fast-forward] [--profile FILE] [--trace FILE] [--trace-entries N] [--verify] [--verify-state]
+ *
+ *  --verify runs the switch interpreter, the threaded interpreter and the JIT
+ *  side by side with the same seed and the same random key presses, and
+ *  compares the whole machine after every frame, for every quirk profile
+ *  unless --quirks picks one.
+ *
+ *  --verify-state records a run with random key presses, then replays it
+ *  while reloading the machine from a save state every so often and
+ *  rewinding a second of frames, and checks every frame against the record.
+ */
+
+#include "chip8.h"
+#include "chip8_jit.h"
+#include "chip8_profile.h"
+#include "chip8_state.h"
+#include "chip8_trace.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define DEFAULT_FRAMES 100000
+#define DEFAULT_VERIFY_FRAMES 20000
+#define DEFAULT_STATE_FRAMES 3000
+#define STATE_RELOAD_FRAMES 97   // frames between save state round trips
+#define STATE_REWIND_EVERY 500   // frames between rewinds
+#define STATE_REWIND_FRAMES 60   // frames stepped back by each rewind
+#define STATE_REWIND_BYTES (16 * 1024 * 1024)
+#define DEFAULT_SEED 1
+
+// bench-only engine id, the JIT lives outside cpu->engine
+#define ENGINE_JIT 0xFF
+
+static uint64_t now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * 1000000000ull + (uint64_t) ts.tv_nsec;
+}
+
+static const char* engine_name(int engine)
+{
+    if (engine == ENGINE_JIT) { return "jit"; }
+    return (engine == CHIP8_ENGINE_THREADED) ? "threaded" : "switch";
+}
+
+static void usage(const char* program)
+{
+    printf("Usage: %s <path-to-game-rom> [--cycles N | --frames N] [--engine switch|threaded|jit] [--seed N] [--quirks P] [--timing T] [--fast-forward] [--profile FILE] [--trace FILE] [--trace-entries N] [--verify] [--verify-state]\n", program);
+    printf("  --cycles N   execute N cycles (the timers tick every hertz / %d of them)\n", TIMER_HERTZ);
+    printf("  --frames N   execute N whole frames, up to N timer ticks (default %d)\n", DEFAULT_FRAMES);
+    printf("  --engine E   execution engine, switch, threaded or jit (default %s)\n", engine_name(CHIP8_DEFAULT_ENGINE));
+    printf("  --seed N     Cxkk random seed, fixed so runs are comparable (default %d)\n", DEFAULT_SEED);
+    printf("  --quirks P   quirk profile, legacy, vip, chip48 or schip (default: from the ROM table, else legacy)\n");
+    printf("  --timing T   timing model, cycles (%d Hz) or vip (%d machine cycles/s) (default cycles)\n", CPU_HERTZ, CHIP8_VIP_HERTZ);
+    printf("  --fast-forward  skip idle loops (Fx0A, delay timer polling) to the next timer tick\n");
+    printf("  --profile F  write opcode counts, PC histogram and frame times to F (.json for JSON, - for stdout),\n");
+    printf("               needs a build with -DCHIP8_PROFILE=ON\n");
+    printf("  --trace F    record the last instructions and dump them to F at the end (read it with chip8-trace)\n");
+    printf("  --trace-entries N  instructions the trace keeps, rounded up to a power of two (default %u)\n", CHIP8_TRACE_DEFAULT_ENTRIES);
+    printf("  --verify     compare the engines after every frame instead of timing one (default %d frames)\n", DEFAULT_VERIFY_FRAMES);
+    printf("  --verify-state  check save states and rewind against a recorded run (default %d frames)\n", DEFAULT_STATE_FRAMES);
+}
+
+// everything the program can observe or change, the caches and host fields are left out
+static const char* first_difference(const CHIP8* a, const CHIP8* b)
+{
+    if (memcmp(a->memory, b->memory, sizeof(a->memory)) != 0) { return "memory"; }
+    if (memcmp(a->display, b->display, sizeof(a->display)) != 0) { return "display"; }
+    if (memcmp(a->v, b->v, sizeof(a->v)) != 0) { return "registers"; }
+    if (a->i != b->i) { return "I"; }
+    if (a->pc != b->pc) { return "pc"; }
+    if (memcmp(a->stack, b->stack, sizeof(a->stack)) != 0 || a->stack_pointer != b->stack_pointer) { return "stack"; }
+    if (a->delay != b->delay || a->sound_timer != b->sound_timer) { return "timers"; }
+    if (a->rng_state != b->rng_state) { return "random state"; }
+    if (a->clock != b->clock) { return "clock"; }
+    return NULL;
+}
+
+static void set_keys(CHIP8* cpu, uint16_t keys)
+{
+    for (int key = 0; key < 16; ++key)
+    {
+        cpu->keypad[key] = (keys >> key) & 1;
+    }
+}
+
+// key presses held for a few frames at a time, from their own xorshift stream
+static uint16_t next_keys(uint32_t* input, uint64_t frame, uint16_t keys)
+{
+    if (frame % 8 != 0) { return keys; }
+    *input ^= *input << 13;
+    *input ^= *input >> 17;
+    *input ^= *input << 5;
+    return (*input >> 8) & (*input >> 24) & 0xFFFF;
+}
+
+// the switch engine is the reference, the threaded engine and the JIT must match it after every frame
+static bool verify(const char* rom_path, const CHIP8* loaded, uint64_t frames, uint32_t seed)
+{
+    static CHIP8 reference;
+    static CHIP8 threaded;
+    static CHIP8 translated;
+    reference = *loaded;
+    reference.engine = CHIP8_ENGINE_SWITCH;
+    threaded = *loaded;
+    threaded.engine = CHIP8_ENGINE_THREADED;
+    translated = *loaded;
+    translated.engine = CHIP8_ENGINE_SWITCH;
+
+    Chip8Jit* jit = chip8_jit_create();
+    if (jit == NULL) { printf("CHIP8: JIT not available on this host, only the interpreters are compared\n"); }
+
+    uint32_t input = seed * 2654435761u + 1;
+    uint16_t keys = 0;
+    for (uint64_t frame = 0; frame < frames; ++frame)
+    {
+        keys = next_keys(&input, frame, keys);
+        set_keys(&reference, keys);
+        set_keys(&threaded, keys);
+        set_keys(&translated, keys);
+
+        // the clocks are in step, so every frame ends at the same tick
+        uint32_t cycles = chip8_cycles_to_tick(&reference);
+        chip8_run_cycles(&reference, cycles);
+        chip8_run_cycles(&threaded, cycles);
+        chip8_jit_run_cycles(jit, &translated, cycles);
+
+        const char* difference = first_difference(&threaded, &reference);
+        const char* engine = "threaded";
+        if (difference == NULL)
+        {
+            difference = first_difference(&translated, &reference);
+            engine = "jit";
+        }
+        if (difference != NULL)
+        {
+            const CHIP8* failed = (engine[0] == 'j') ? &translated : &threaded;
+            printf("%s (%s): FAILED at frame %llu, %s differs (pc 0x%03X %s, 0x%03X switch)\n", rom_path,
+                   chip8_quirks_name(loaded->quirks), (unsigned long long) frame, difference, failed->pc, engine, reference.pc);
+            chip8_jit_destroy(jit);
+            return false;
+        }
+    }
+    printf("%s (%s, %s): %llu frames match across switch, threaded and %s\n", rom_path, chip8_quirks_name(loaded->quirks),
+           chip8_timing_name(loaded->timing), (unsigned long long) frames, (jit != NULL) ? "jit" : "no jit");
+    chip8_jit_destroy(jit);
+    return true;
+}
+
+static void run_frame(CHIP8* cpu, uint16_t keys)
+{
+    set_keys(cpu, keys);
+    chip8_run_cycles(cpu, chip8_cycles_to_tick(cpu));
+}
+
+static bool same_state(const CHIP8* cpu, const uint8_t* recorded, const char* rom_path, const char* check, uint64_t frame)
+{
+    uint8_t state[CHIP8_STATE_SIZE];
+    chip8_serialize(cpu, state, sizeof(state));
+    if (memcmp(state, recorded, CHIP8_STATE_SIZE) == 0) { return true; }
+
+    size_t offset = 0;
+    while (state[offset] == recorded[offset]) { offset++; }
+    printf("%s (%s): FAILED at frame %llu after %s, state byte %zu differs\n", rom_path, chip8_quirks_name(cpu->quirks),
+           (unsigned long long) frame, check, offset);
+    return false;
+}
+
+// records the state after every frame, then replays the same keys through save state round trips and rewinds
+static bool verify_state(const char* rom_path, const CHIP8* loaded, uint64_t frames, uint32_t seed)
+{
+    uint8_t* recorded = malloc((size_t) frames * CHIP8_STATE_SIZE);
+    uint16_t* keys = malloc((size_t) frames * sizeof(uint16_t));
+    Chip8Rewind* rewind = chip8_rewind_create(STATE_REWIND_BYTES);
+    if (recorded == NULL || keys == NULL || rewind == NULL)
+    {
+        printf("CHIP8: Error while allocating the recorded run\n");
+        free(recorded);
+        free(keys);
+        chip8_rewind_destroy(rewind);
+        return false;
+    }
+
+    static CHIP8 cpu;
+    cpu = *loaded;
+    uint32_t input = seed * 2654435761u + 1;
+    for (uint64_t frame = 0; frame < frames; ++frame)
+    {
+        keys[frame] = next_keys(&input, frame, (frame > 0) ? keys[frame - 1] : 0);
+        run_frame(&cpu, keys[frame]);
+        chip8_serialize(&cpu, recorded + frame * CHIP8_STATE_SIZE, CHIP8_STATE_SIZE);
+    }
+
+    bool ok = true;
+    cpu = *loaded;
+    uint64_t rewound_at = 0;
+    for (uint64_t frame = 0; ok && frame < frames; ++frame)
+    {
+        run_frame(&cpu, keys[frame]);
+        chip8_rewind_capture(rewind, &cpu);
+        ok = same_state(&cpu, recorded + frame * CHIP8_STATE_SIZE, rom_path, "running", frame);
+
+        // carry on from a fresh machine that only has the host settings and the save state
+        if (ok && frame % STATE_RELOAD_FRAMES == STATE_RELOAD_FRAMES - 1)
+        {
+            uint8_t state[CHIP8_STATE_SIZE];
+            size_t size = chip8_serialize(&cpu, state, sizeof(state));
+            chip8_init(&cpu);
+            cpu.engine = loaded->engine;
+            cpu.quirks = loaded->quirks;
+            cpu.timing = loaded->timing;
+            cpu.hertz = loaded->hertz;
+            ok = chip8_deserialize(&cpu, state, size) && same_state(&cpu, recorded + frame * CHIP8_STATE_SIZE, rom_path, "a reload", frame);
+        }
+
+        // step back, checking every frame on the way, then run the same frames again
+        if (ok && frame % STATE_REWIND_EVERY == STATE_REWIND_EVERY - 1 && frame != rewound_at)
+        {
+            rewound_at = frame;
+            for (uint32_t step = 1; ok && step <= STATE_REWIND_FRAMES && step <= frame; ++step)
+            {
+                ok = chip8_rewind_step_back(rewind, &cpu) &&
+                     same_state(&cpu, recorded + (frame - step) * CHIP8_STATE_SIZE, rom_path, "a rewind", frame - step);
+            }
+            frame -= (frame < STATE_REWIND_FRAMES) ? frame : STATE_REWIND_FRAMES;
+        }
+    }
+    if (ok)
+    {
+        printf("%s (%s, %s): %llu frames match through save states and rewinds\n", rom_path, chip8_quirks_name(loaded->quirks),
+               chip8_timing_name(loaded->timing), (unsigned long long) frames);
+    }
+    free(recorded);
+    free(keys);
+    chip8_rewind_destroy(rewind);
+    return ok;
+}
+
+int main(int argc, const char* argv[])
+{
+    if (argc < 2)
+    {
+        usage(argv[0]);
+        return 1;
+    }
+
+    const char* rom_path = NULL;
+    uint64_t cycles = 0;
+    uint64_t frame_count = DEFAULT_FRAMES;
+    int engine = CHIP8_DEFAULT_ENGINE;
+    uint32_t seed = DEFAULT_SEED;
+    bool fast_forward = false;
+    const char* profile_path = NULL;
+    const char* trace_path = NULL;
+    uint32_t trace_entries = CHIP8_TRACE_DEFAULT_ENTRIES;
+    const char* quirks_name = NULL;
+    const char* timing_name = NULL;
+    bool verify_engines = false;
+    bool verify_states = false;
+    bool frames_given = false;
+
+    for (int arg = 1; arg < argc; ++arg)
+    {
+        if (strcmp(argv[arg], "--cycles") == 0 && arg + 1 < argc)
+        {
+            cycles = strtoull(argv[++arg], NULL, 10);
+        }
+        else if (strcmp(argv[arg], "--frames") == 0 && arg + 1 < argc)
+        {
+            frame_count = strtoull(argv[++arg], NULL, 10);
+            frames_given = true;
+            cycles = 0;
+        }
+        else if (strcmp(argv[arg], "--engine") == 0 && arg + 1 < argc)
+        {
+            arg++;
+            if (strcmp(argv[arg], "switch") == 0) { engine = CHIP8_ENGINE_SWITCH; }
+            else if (strcmp(argv[arg], "threaded") == 0) { engine = CHIP8_ENGINE_THREADED; }
+            else if (strcmp(argv[arg], "jit") == 0) { engine = ENGINE_JIT; }
+            else
+            {
+                usage(argv[0]);
+                return 1;
+            }
+        }
+        else if (strcmp(argv[arg], "--seed") == 0 && arg + 1 < argc)
+        {
+            seed = (uint32_t) strtoul(argv[++arg], NULL, 0);
+        }
+        else if (strcmp(argv[arg], "--quirks") == 0 && arg + 1 < argc)
+        {
+            quirks_name = argv[++arg];
+        }
+        else if (strcmp(argv[arg], "--timing") == 0 && arg + 1 < argc)
+        {
+            timing_name = argv[++arg];
+        }
+        else if (strcmp(argv[arg], "--profile") == 0 && arg + 1 < argc)
+        {
+            profile_path = argv[++arg];
+        }
+        else if (strcmp(argv[arg], "--trace") == 0 && arg + 1 < argc)
+        {
+            trace_path = argv[++arg];
+        }
+        else if (strcmp(argv[arg], "--trace-entries") == 0 && arg + 1 < argc)
+        {
+            trace_entries = (uint32_t) strtoul(argv[++arg], NULL, 10);
+        }
+        else if (strcmp(argv[arg], "--verify") == 0)
+        {
+            verify_engines = true;
+        }
+        else if (strcmp(argv[arg], "--verify-state") == 0)
+        {
+            verify_states = true;
+        }
+        else if (strcmp(argv[arg], "--fast-forward") == 0)
+        {
+            fast_forward = true;
+        }
+        else if (argv[arg][0] != '-' && rom_path == NULL)
+        {
+            rom_path = argv[arg];
+        }
+        else
+        {
+            usage(argv[0]);
+            return 1;
+        }
+    }
+    if (rom_path == NULL || (cycles == 0 && frame_count == 0) || trace_entries == 0)
+    {
+        usage(argv[0]);
+        return 1;
+    }
+
+    CHIP8 cpu;
+    chip8_init(&cpu);
+    chip8_seed(&cpu, seed);
+    if (!load_rom(&cpu, rom_path)) { return 1; }
+    if ((quirks_name != NULL && !chip8_parse_quirks(quirks_name, &cpu.quirks)) ||
+        (timing_name != NULL && !chip8_parse_timing(timing_name, &cpu)))
+    {
+        usage(argv[0]);
+        return 1;
+    }
+
+    if (verify_engines || verify_states)
+    {
+        uint64_t verify_frames = frames_given ? frame_count : verify_states ? DEFAULT_STATE_FRAMES : DEFAULT_VERIFY_FRAMES;
+        bool ok = true;
+        for (uint8_t quirks = 0; quirks < CHIP8_QUIRKS_COUNT; ++quirks)
+        {
+            if (quirks_name != NULL && quirks != cpu.quirks) { continue; }
+            static CHIP8 loaded;
+            loaded = cpu;
+            loaded.quirks = quirks;
+            if (verify_engines) { ok = verify(rom_path, &loaded, verify_frames, seed) && ok; }
+            if (verify_states) { ok = verify_state(rom_path, &loaded, verify_frames, seed) && ok; }
+        }
+        return ok ? 0 : 1;
+    }
+
+    Chip8Jit* jit = NULL;
+    if (engine == ENGINE_JIT)
+    {
+        jit = chip8_jit_create();
+        if (jit == NULL)
+        {
+            printf("CHIP8: JIT not available on this host, using the interpreter\n");
+            engine = CHIP8_DEFAULT_ENGINE;
+        }
+    }
+    else
+    {
+        cpu.engine = engine;
+    }
+
+    // big enough that it should not live on the stack
+    static Chip8Profile profile;
+    chip8_profile_reset(&profile);
+    if (profile_path != NULL && !chip8_profile_attach(&cpu, &profile))
+    {
+        printf("CHIP8: built without CHIP8_PROFILE, rebuild with -DCHIP8_PROFILE=ON to use --profile\n");
+        profile_path = NULL;
+    }
+    Chip8Trace* trace = (trace_path != NULL) ? chip8_trace_create(trace_entries) : NULL;
+    if (trace_path != NULL && (trace == NULL || !chip8_trace_attach(&cpu, trace)))
+    {
+        printf("CHIP8: no trace, it needs a build with -DCHIP8_TRACE=ON and %llu KB\n",
+               (unsigned long long) ((uint64_t) trace_entries * sizeof(uint64_t) >> 10));
+        chip8_trace_destroy(trace);
+        trace = NULL;
+    }
+
+    // --cycles stops after that many cycles, --frames after that many timer ticks, as long as the timing model makes them;
+    // cycles skipped by --fast-forward pass the clock but are not counted as executed
+    uint64_t frames = 0;
+    uint64_t skipped = 0;
+    uint64_t executed = 0;
+    uint64_t start = now_ns();
+    while ((cycles > 0) ? executed + skipped < cycles : frames < frame_count)
+    {
+        // one frame up to the next timer tick, the core ticks the timers at its end
+        uint32_t batch = chip8_cycles_to_tick(&cpu);
+        bool whole_frame = cycles == 0 || cycles - executed - skipped >= batch;
+        if (!whole_frame) { batch = (uint32_t) (cycles - executed - skipped); }
+        uint64_t frame_start = (profile_path != NULL) ? now_ns() : 0;
+        uint32_t idle = fast_forward ? chip8_skip_idle(&cpu, batch) : 0;
+        chip8_jit_run_cycles(jit, &cpu, batch - idle);
+        skipped += idle;
+        if (profile_path != NULL) { chip8_profile_frame(&profile, now_ns() - frame_start); }
+        executed += batch - idle;
+        if (whole_frame) { frames++; }
+    }
+    uint64_t elapsed = now_ns() - start;
+    if (elapsed == 0) { elapsed = 1; }
+
+    double seconds = (double) elapsed / 1e9;
+    // the vip model counts COSMAC VIP machine cycles, the others one cycle per instruction
+    bool machine_cycles = cpu.timing == CHIP8_TIMING_VIP;
+    printf("rom:              %s\n", rom_path);
+    printf("engine:           %s\n", engine_name(engine));
+    printf("seed:             %u\n", seed);
+    printf("quirks:           %s\n", chip8_quirks_name(cpu.quirks));
+    printf("timing:           %s at %u Hz\n", chip8_timing_name(cpu.timing), cpu.hertz);
+    printf("%-18s%llu\n", machine_cycles ? "cycles:" : "instructions:", (unsigned long long) executed);
+    printf("frames:           %llu\n", (unsigned long long) frames);
+    if (fast_forward) { printf("idle skipped:     %llu\n", (unsigned long long) skipped); }
+    printf("elapsed:          %.6f s\n", seconds);
+    printf("%-18s%.0f\n", machine_cycles ? "cycles/sec:" : "instructions/sec:", (double) executed / seconds);
+    printf("frames/sec:       %.0f\n", (double) frames / seconds);
+    printf("%-18s%.3f\n", machine_cycles ? "ns/cycle:" : "ns/instruction:", (double) elapsed / (double) (executed > 0 ? executed : 1));
+    if (profile_path != NULL)
+    {
+        chip8_profile_attach(&cpu, NULL);
+        chip8_profile_write(&profile, profile_path);
+    }
+    if (trace != NULL)
+    {
+        chip8_trace_attach(&cpu, NULL);
+        if (!chip8_trace_dump(trace, &cpu, trace_path)) { perror("CHIP8: Error while writing the trace: "); }
+        chip8_trace_destroy(trace);
+    }
+    chip8_jit_destroy(jit);
+    return 0;
+}
@@ -0,0 +1,137 @@
+/*
+ *  chip8-capture: runs a ROM headless and unthrottled and captures every
+ *  frame as a raw 1bpp stream, a PNG sequence and/or a per-frame hash log.
+ *
+ *  Usage: chip8-capture <rom> [--frames N] [--raw FILE|-] [--png PREFIX] [--hashes FILE|-] [--seed N] [--quirks P]
+ *
+ *  The raw stream goes straight into ffmpeg:
+ *      chip8-capture pong.ch8 --raw - | ffmpeg -f rawvideo -pix_fmt monob -s 64x32 -r 60 -i - pong.mp4
+ */
+
+#include "chip8.h"
+#include "chip8_capture.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define DEFAULT_FRAMES 600  // ten emulated seconds
+#define DEFAULT_SEED 1
+
+static uint64_t now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * 1000000000ull + (uint64_t) ts.tv_nsec;
+}
+
+static void usage(const char* program)
+{
+    printf("Usage: %s <path-to-game-rom> [--frames N] [--raw FILE|-] [--png PREFIX] [--hashes FILE|-] [--seed N] [--quirks P]\n", program);
+    printf("  --frames N     frames to run and capture (default %d)\n", DEFAULT_FRAMES);
+    printf("  --raw F        64x32 1bpp frames back to back, %d bytes each (ffmpeg: -f rawvideo -pix_fmt monob -s 64x32)\n", CHIP8_CAPTURE_FRAME_BYTES);
+    printf("  --png PREFIX   PREFIX000042.png for every frame that differs from the previous PNG\n");
+    printf("  --hashes F     one \"frame hash\" line per frame, for golden comparisons\n");
+    printf("  --seed N       Cxkk random seed (default %d)\n", DEFAULT_SEED);
+    printf("  --quirks P     quirk profile, legacy, vip, chip48 or schip (default: from the ROM table, else legacy)\n");
+}
+
+int main(int argc, const char* argv[])
+{
+    const char* rom_path = NULL;
+    uint64_t frames = DEFAULT_FRAMES;
+    uint32_t seed = DEFAULT_SEED;
+    const char* quirks_name = NULL;
+    Chip8CaptureOptions options = { NULL, NULL, NULL };
+
+    for (int arg = 1; arg < argc; ++arg)
+    {
+        if (strcmp(argv[arg], "--frames") == 0 && arg + 1 < argc)
+        {
+            frames = strtoull(argv[++arg], NULL, 10);
+        }
+        else if (strcmp(argv[arg], "--raw") == 0 && arg + 1 < argc)
+        {
+            options.raw_path = argv[++arg];
+        }
+        else if (strcmp(argv[arg], "--png") == 0 && arg + 1 < argc)
+        {
+            options.png_prefix = argv[++arg];
+        }
+        else if (strcmp(argv[arg], "--hashes") == 0 && arg + 1 < argc)
+        {
+            options.hash_path = argv[++arg];
+        }
+        else if (strcmp(argv[arg], "--seed") == 0 && arg + 1 < argc)
+        {
+            seed = (uint32_t) strtoul(argv[++arg], NULL, 0);
+        }
+        else if (strcmp(argv[arg], "--quirks") == 0 && arg + 1 < argc)
+        {
+            quirks_name = argv[++arg];
+        }
+        else if (argv[arg][0] != '-' && rom_path == NULL)
+        {
+            rom_path = argv[arg];
+        }
+        else
+        {
+            usage(argv[0]);
+            return 1;
+        }
+    }
+    if (rom_path == NULL || frames == 0 || (options.raw_path == NULL && options.png_prefix == NULL && options.hash_path == NULL))
+    {
+        usage(argv[0]);
+        return 1;
+    }
+
+    CHIP8 cpu;
+    chip8_init(&cpu);
+    chip8_seed(&cpu, seed);
+    if (!load_rom(&cpu, rom_path)) { return 1; }
+    if (quirks_name != NULL && !chip8_parse_quirks(quirks_name, &cpu.quirks))
+    {
+        usage(argv[0]);
+        return 1;
+    }
+
+    Chip8Capture* capture = chip8_capture_open(&options);
+    if (capture == NULL) { return 1; }
+
+    uint64_t start = now_ns();
+    for (uint64_t frame = 0; frame < frames; ++frame)
+    {
+        // the frame as the window would show it: the cycles up to and including the timer tick
+        chip8_run_frame(&cpu);
+        chip8_capture_frame(capture, &cpu);
+    }
+    uint64_t emulated = now_ns() - start;
+
+    Chip8CaptureStats stats;
+    bool ok = chip8_capture_close(capture, &stats);
+    uint64_t elapsed = now_ns() - start;
+    if (elapsed == 0) { elapsed = 1; }
+
+    // the summary must not end up in a stream written to stdout
+    bool piped = (options.raw_path != NULL && strcmp(options.raw_path, "-") == 0)
+              || (options.hash_path != NULL && strcmp(options.hash_path, "-") == 0);
+    FILE* out = piped ? stderr : stdout;
+    fprintf(out, "rom:            %s\n", rom_path);
+    fprintf(out, "quirks:         %s\n", chip8_quirks_name(cpu.quirks));
+    fprintf(out, "frames:         %llu\n", (unsigned long long) stats.frames);
+    fprintf(out, "png written:    %llu\n", (unsigned long long) stats.png_written);
+    fprintf(out, "raw bytes:      %llu\n", (unsigned long long) stats.raw_bytes);
+    fprintf(out, "emulation:      %.3f s\n", (double) emulated / 1e9);
+    fprintf(out, "total:          %.3f s\n", (double) elapsed / 1e9);
+    fprintf(out, "frames/sec:     %.0f\n", (double) stats.frames / ((double) elapsed / 1e9));
+    if (!ok)
+    {
+        fprintf(stderr, "CHIP8: some capture output could not be written\n");
+        return 1;
+    }
+    return 0;
+}
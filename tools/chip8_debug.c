@@ -0,0 +1,134 @@
+/*
+ *  chip8-debug: runs a ROM headless in real time (500 Hz, timers at 60 Hz)
+ *  with the debug server listening on a Unix socket, for tools that attach
+ *  and drive it. The protocol is described in chip8_debug_server.c.
+ *
+ *  Usage: chip8-debug <rom> [--socket PATH] [--seed N] [--quirks P] [--run]
+ *
+ *  It starts paused so breakpoints can be set before the first instruction,
+ *  --run starts running right away. Any line-based client works:
+ *      socat - UNIX-CONNECT:chip8.sock
+ */
+
+#include "chip8.h"
+#include "chip8_debug.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define DEFAULT_SOCKET "chip8.sock"
+#define DEFAULT_SEED 1
+#define FRAME_NS (1000000000ull / TIMER_HERTZ)
+
+static uint64_t now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * 1000000000ull + (uint64_t) ts.tv_nsec;
+}
+
+static void usage(const char* program)
+{
+    printf("Usage: %s <path-to-game-rom> [--socket PATH] [--seed N] [--quirks P] [--run]\n", program);
+    printf("  --socket PATH  Unix socket the debugger attaches to (default %s)\n", DEFAULT_SOCKET);
+    printf("  --seed N       Cxkk random seed (default %d)\n", DEFAULT_SEED);
+    printf("  --quirks P     quirk profile, legacy, vip, chip48 or schip (default: from the ROM table, else legacy)\n");
+    printf("  --run          start running instead of paused\n");
+}
+
+int main(int argc, const char* argv[])
+{
+    const char* rom_path = NULL;
+    const char* socket_path = DEFAULT_SOCKET;
+    uint32_t seed = DEFAULT_SEED;
+    const char* quirks_name = NULL;
+    bool run = false;
+
+    for (int arg = 1; arg < argc; ++arg)
+    {
+        if (strcmp(argv[arg], "--socket") == 0 && arg + 1 < argc)
+        {
+            socket_path = argv[++arg];
+        }
+        else if (strcmp(argv[arg], "--seed") == 0 && arg + 1 < argc)
+        {
+            seed = (uint32_t) strtoul(argv[++arg], NULL, 0);
+        }
+        else if (strcmp(argv[arg], "--quirks") == 0 && arg + 1 < argc)
+        {
+            quirks_name = argv[++arg];
+        }
+        else if (strcmp(argv[arg], "--run") == 0)
+        {
+            run = true;
+        }
+        else if (argv[arg][0] != '-' && rom_path == NULL)
+        {
+            rom_path = argv[arg];
+        }
+        else
+        {
+            usage(argv[0]);
+            return 1;
+        }
+    }
+    if (rom_path == NULL)
+    {
+        usage(argv[0]);
+        return 1;
+    }
+
+    static CHIP8 cpu;
+    chip8_init(&cpu);
+    chip8_seed(&cpu, seed);
+    if (!load_rom(&cpu, rom_path)) { return 1; }
+    if (quirks_name != NULL && !chip8_parse_quirks(quirks_name, &cpu.quirks))
+    {
+        printf("CHIP8: unknown quirk profile %s, use legacy, vip, chip48 or schip\n", quirks_name);
+        return 1;
+    }
+
+    Chip8Debugger* debugger = chip8_debug_create();
+    Chip8DebugServer* server = (debugger != NULL) ? chip8_debug_server_open(socket_path) : NULL;
+    if (server == NULL)
+    {
+        chip8_debug_destroy(debugger);
+        return 1;
+    }
+    if (!run) { chip8_debug_pause(debugger, &cpu); }
+    printf("%s: debug server on %s, %s\n", rom_path, socket_path, run ? "running" : "paused until a debugger continues");
+    fflush(stdout);
+
+    // the socket is polled while waiting for the next frame, so commands are answered right away
+    uint64_t next_frame = now_ns();
+    bool keep_running = true;
+    while (keep_running)
+    {
+        if (chip8_debug_paused(debugger))
+        {
+            keep_running = chip8_debug_server_poll(server, debugger, &cpu, -1);
+            next_frame = now_ns();
+            continue;
+        }
+
+        uint64_t now = now_ns();
+        if (now < next_frame)
+        {
+            keep_running = chip8_debug_server_poll(server, debugger, &cpu, (int) ((next_frame - now + 999999) / 1000000));
+            continue;
+        }
+        next_frame += FRAME_NS;
+
+        // a frame that stops on a breakpoint ends before the timer tick
+        chip8_debug_run_cycles(debugger, &cpu, chip8_cycles_to_tick(&cpu));
+        keep_running = chip8_debug_server_poll(server, debugger, &cpu, 0);
+    }
+
+    chip8_debug_server_close(server);
+    chip8_debug_destroy(debugger);
+    return 0;
+}
@@ -0,0 +1,190 @@
+/*
+ *  chip8-env: the vectorized environment from the command line.
+ *
+ *  Usage: chip8-env <rom> [--instances N] [--steps N] [--frames N] [--seed N] [--probe ADDR]
+ *         chip8-env <rom> --serve NAME [--instances N] [--probe ADDR]
+ *         chip8-env --attach NAME [--steps N] [--frames N] [--quit]
+ *
+ *  Without --serve or --attach it steps the instances in this process with
+ *  random actions and reports the throughput. --serve creates the shared
+ *  memory object NAME and runs the calls other processes make on it until
+ *  one of them quits; --attach is such a process, driving a served region
+ *  with random actions (and --quit stops the server afterwards).
+ */
+
+#include "chip8.h"
+#include "chip8_env.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define DEFAULT_INSTANCES 64
+#define DEFAULT_STEPS 10000
+#define DEFAULT_FRAMES 4     // frames per step, a typical action repeat
+
+static uint64_t now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * 1000000000ull + (uint64_t) ts.tv_nsec;
+}
+
+static void usage(const char* program)
+{
+    printf("Usage: %s <path-to-game-rom> [--instances N] [--steps N] [--frames N] [--seed N] [--probe ADDR]\n", program);
+    printf("       %s <path-to-game-rom> --serve NAME [--instances N] [--probe ADDR]\n", program);
+    printf("       %s --attach NAME [--steps N] [--frames N] [--quit]\n", program);
+    printf("  --instances N  machines in the environment (default %d)\n", DEFAULT_INSTANCES);
+    printf("  --steps N      steps to run with random actions (default %d)\n", DEFAULT_STEPS);
+    printf("  --frames N     frames per step (default %d)\n", DEFAULT_FRAMES);
+    printf("  --seed N       instance k is seeded with N + k (default 0)\n");
+    printf("  --probe ADDR   memory address whose changes are the reward (default 0)\n");
+    printf("  --serve NAME   create the shared memory object NAME (\"/chip8-env\") and run other processes' calls\n");
+    printf("  --attach NAME  drive a region served by another chip8-env\n");
+    printf("  --quit         with --attach, stop the server when done\n");
+}
+
+// steps the environment with a fresh random keypad mask per instance per step
+static void run_steps(Chip8Env* env, uint64_t steps, uint32_t frames)
+{
+    uint32_t count = chip8_env_header(env)->count;
+    uint16_t* actions = malloc(sizeof(uint16_t) * count);
+    if (actions == NULL) { return; }
+
+    uint32_t random = 0x9E3779B9u;
+    int64_t reward = 0;
+    uint64_t start = now_ns();
+    for (uint64_t step = 0; step < steps; ++step)
+    {
+        for (uint32_t index = 0; index < count; ++index)
+        {
+            random ^= random << 13;
+            random ^= random >> 17;
+            random ^= random << 5;
+            // one key at a time, most steps press nothing
+            actions[index] = ((random & 7) == 0) ? (uint16_t) (1u << ((random >> 8) & 15)) : 0;
+        }
+        chip8_env_step(env, actions, frames);
+        for (uint32_t index = 0; index < count; ++index)
+        {
+            reward += chip8_env_instance(env, index)->reward;
+        }
+    }
+    uint64_t elapsed = now_ns() - start;
+    if (elapsed == 0) { elapsed = 1; }
+    free(actions);
+
+    double seconds = (double) elapsed / 1e9;
+    printf("instances:            %u\n", count);
+    printf("steps:                %llu of %u frames\n", (unsigned long long) steps, frames);
+    printf("elapsed:              %.3f s\n", seconds);
+    printf("steps/sec:            %.0f\n", (double) steps / seconds);
+    printf("instance steps/sec:   %.0f\n", (double) steps * count / seconds);
+    printf("instance frames/sec:  %.0f\n", (double) steps * count * frames / seconds);
+    printf("total reward:         %lld\n", (long long) reward);
+}
+
+static void print_layout(const Chip8EnvHeader* header)
+{
+    printf("instances %u at offset %u, stride %u, %llu bytes\n", header->count, header->instance_offset, header->instance_stride,
+           (unsigned long long) header->region_bytes);
+    printf("fields: action %u, probe_value %u, reward %u, frames %u, display %u, registers %u, i %u, pc %u, memory %u\n",
+           header->action_offset, header->probe_value_offset, header->reward_offset, header->frames_offset, header->display_offset,
+           header->registers_offset, header->i_offset, header->pc_offset, header->memory_offset);
+}
+
+int main(int argc, const char* argv[])
+{
+    const char* rom_path = NULL;
+    const char* serve_name = NULL;
+    const char* attach_name = NULL;
+    uint32_t instances = DEFAULT_INSTANCES;
+    uint64_t steps = DEFAULT_STEPS;
+    uint32_t frames = DEFAULT_FRAMES;
+    uint32_t seed = 0;
+    uint32_t probe = 0;
+    bool quit = false;
+
+    for (int arg = 1; arg < argc; ++arg)
+    {
+        if (strcmp(argv[arg], "--instances") == 0 && arg + 1 < argc)
+        {
+            instances = (uint32_t) strtoul(argv[++arg], NULL, 10);
+        }
+        else if (strcmp(argv[arg], "--steps") == 0 && arg + 1 < argc)
+        {
+            steps = strtoull(argv[++arg], NULL, 10);
+        }
+        else if (strcmp(argv[arg], "--frames") == 0 && arg + 1 < argc)
+        {
+            frames = (uint32_t) strtoul(argv[++arg], NULL, 10);
+        }
+        else if (strcmp(argv[arg], "--seed") == 0 && arg + 1 < argc)
+        {
+            seed = (uint32_t) strtoul(argv[++arg], NULL, 0);
+        }
+        else if (strcmp(argv[arg], "--probe") == 0 && arg + 1 < argc)
+        {
+            probe = (uint32_t) strtoul(argv[++arg], NULL, 0);
+        }
+        else if (strcmp(argv[arg], "--serve") == 0 && arg + 1 < argc)
+        {
+            serve_name = argv[++arg];
+        }
+        else if (strcmp(argv[arg], "--attach") == 0 && arg + 1 < argc)
+        {
+            attach_name = argv[++arg];
+        }
+        else if (strcmp(argv[arg], "--quit") == 0)
+        {
+            quit = true;
+        }
+        else if (argv[arg][0] != '-' && rom_path == NULL)
+        {
+            rom_path = argv[arg];
+        }
+        else
+        {
+            usage(argv[0]);
+            return 1;
+        }
+    }
+    if ((attach_name == NULL) == (rom_path == NULL) || instances == 0 || frames == 0)
+    {
+        usage(argv[0]);
+        return 1;
+    }
+
+    if (attach_name != NULL)
+    {
+        Chip8Env* env = chip8_env_attach(attach_name);
+        if (env == NULL) { return 1; }
+        chip8_env_reset(env, seed);
+        run_steps(env, steps, frames);
+        if (quit) { chip8_env_quit(env); }
+        chip8_env_destroy(env);
+        return 0;
+    }
+
+    Chip8Env* env = chip8_env_create(rom_path, instances, serve_name);
+    if (env == NULL) { return 1; }
+    chip8_env_set_probe(env, (uint16_t) probe);
+    chip8_env_reset(env, seed);
+    if (serve_name != NULL)
+    {
+        printf("%s: serving %s\n", rom_path, serve_name);
+        print_layout(chip8_env_header(env));
+        fflush(stdout);
+        chip8_env_serve(env);
+    }
+    else
+    {
+        run_steps(env, steps, frames);
+    }
+    chip8_env_destroy(env);
+    return 0;
+}
@@ -0,0 +1,162 @@
+/*
+ *  chip8-trace: turns an execution trace dump (see chip8_trace.h) into
+ *  disassembly, one instruction per line with the registers it changed.
+ *
+ *  Usage: chip8-trace <dump> [--last N] [--pc ADDR]
+ *
+ *  A register shows as "VA 00->05" when its old value is in the trace and
+ *  as "VA=05" when the instruction that last wrote it has already left the
+ *  ring buffer.
+ */
+
+#include "chip8.h"
+#include "chip8_debug.h"
+#include "chip8_trace.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// the registers as far as the trace has shown them
+typedef struct
+{
+    uint8_t v[REGISTER_COUNT];
+    bool v_known[REGISTER_COUNT];
+    uint16_t i;
+    bool i_known;
+} Known;
+
+static void usage(const char* program)
+{
+    printf("Usage: %s <trace-dump> [--last N] [--pc ADDR]\n", program);
+    printf("  --last N    only the newest N instructions (default: all of them)\n");
+    printf("  --pc ADDR   only instructions at ADDR, the changes still follow every instruction\n");
+}
+
+// appends " VA 00->05" or " VA=05" to text when the register changed or was written
+static int describe(char* text, size_t size, const char* name, int digits, uint16_t old_value, bool known, uint16_t value, bool written)
+{
+    if (known && old_value != value) { return snprintf(text, size, " %s %0*X->%0*X", name, digits, old_value, digits, value); }
+    if (!known && written) { return snprintf(text, size, " %s=%0*X", name, digits, value); }
+    return 0;
+}
+
+// whether the handler wrote VF or I in this quirk profile, as opposed to only holding it in its word
+static bool writes_vf(uint8_t op, uint8_t flags)
+{
+    bool logic = op == EXEC_OR_X_Y || op == EXEC_AND_X_Y || op == EXEC_XOR_X_Y;
+    return CHIP8_TRACE_HAS_VF(op) && (!logic || (flags & CHIP8_QUIRK_VF_RESET));
+}
+
+static bool writes_i(uint8_t op, uint8_t flags)
+{
+    bool memory = op == EXEC_STORE_REGS_I || op == EXEC_LOAD_REGS_I;
+    return CHIP8_TRACE_HAS_I(op) && (!memory || (flags & (CHIP8_QUIRK_MEMORY_X | CHIP8_QUIRK_MEMORY_X1)));
+}
+
+// appends the change of register reg to text, then learns its value
+static int learn(Known* known, uint8_t reg, uint8_t value, bool written, char* text, size_t size)
+{
+    char name[4];
+    snprintf(name, sizeof(name), "V%X", reg);
+    int length = describe(text, size, name, 2, known->v[reg], known->v_known[reg], value, written);
+    known->v[reg] = value;
+    known->v_known[reg] = true;
+    return length;
+}
+
+// the changes one entry shows against what was known before it, then learns its values
+static void apply(Known* known, const Chip8TraceEntry* entry, const Instruction* instruction, uint8_t flags, char* text, size_t size)
+{
+    uint8_t op = instruction->op;
+    uint8_t x = instruction->x;
+    int length = 0;
+    text[0] = '\0';
+
+    // a word only holds the registers its instruction can change
+    if (op == EXEC_LOAD_REGS_I)
+    {
+        for (uint8_t reg = 0; reg < x; ++reg)
+        {
+            length += learn(known, reg, entry->loaded[reg], true, text + length, size - (size_t) length);
+        }
+    }
+    if (CHIP8_TRACE_HAS_VX(op)) { length += learn(known, x, entry->vx, true, text + length, size - (size_t) length); }
+    if (CHIP8_TRACE_HAS_VF(op) && x != 0xF)
+    {
+        length += learn(known, 0xF, entry->vf, writes_vf(op, flags), text + length, size - (size_t) length);
+    }
+    if (CHIP8_TRACE_HAS_I(op))
+    {
+        describe(text + length, size - (size_t) length, "I", 3, known->i, known->i_known, entry->i, writes_i(op, flags));
+        known->i = entry->i;
+        known->i_known = true;
+    }
+}
+
+int main(int argc, const char* argv[])
+{
+    const char* dump_path = NULL;
+    uint32_t last = 0;
+    int pc_filter = -1;
+
+    for (int arg = 1; arg < argc; ++arg)
+    {
+        if (strcmp(argv[arg], "--last") == 0 && arg + 1 < argc)
+        {
+            last = (uint32_t) strtoul(argv[++arg], NULL, 10);
+        }
+        else if (strcmp(argv[arg], "--pc") == 0 && arg + 1 < argc)
+        {
+            pc_filter = (int) (strtoul(argv[++arg], NULL, 0) & (SIZE_4KB - 1));
+        }
+        else if (argv[arg][0] != '-' && dump_path == NULL)
+        {
+            dump_path = argv[arg];
+        }
+        else
+        {
+            usage(argv[0]);
+            return 1;
+        }
+    }
+    if (dump_path == NULL)
+    {
+        usage(argv[0]);
+        return 1;
+    }
+
+    Chip8TraceDump dump;
+    if (!chip8_trace_read(dump_path, &dump)) { return 1; }
+
+    uint32_t first = (last > 0 && last < dump.count) ? dump.count - last : 0;
+    printf("trace: %llu instructions recorded, the last %u kept, quirks %s\n", (unsigned long long) dump.recorded, dump.count,
+           chip8_quirks_name(dump.quirks));
+    printf("%12s  %-5s %-4s  %-20s %s\n", "instruction", "addr", "op", "disassembly", "changes");
+
+    uint8_t flags = chip8_quirk_flags(dump.quirks);
+    Known known;
+    memset(&known, 0, sizeof(known));
+    for (uint32_t index = 0; index < dump.count; ++index)
+    {
+        const Chip8TraceEntry* entry = &dump.entries[index];
+        Instruction instruction = chip8_decode(entry->opcode);
+        char changes[256];
+        apply(&known, entry, &instruction, flags, changes, sizeof(changes));
+        if (index < first || (pc_filter >= 0 && entry->pc != pc_filter)) { continue; }
+
+        char text[32];
+        chip8_disassemble(&instruction, text, sizeof(text));
+        uint64_t number = dump.recorded - dump.count + index;
+        printf("%12llu  0x%03X %04X  %-*s%s\n", (unsigned long long) number, entry->pc, entry->opcode, (changes[0] != '\0') ? 20 : 0,
+               text, changes);
+    }
+
+    printf("at dump: pc 0x%03X, I 0x%03X,", dump.pc, dump.i);
+    for (int reg = 0; reg < REGISTER_COUNT; ++reg) { printf(" V%X=%02X", reg, dump.v[reg]); }
+    printf("\n");
+    chip8_trace_free_dump(&dump);
+    return 0;
+}